@@ -0,0 +1,276 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "BxpReplicationComponent.h"
+
+#include "TimerManager.h"
+#include "Net/UnrealNetwork.h"
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/Player/ConstructionPreview/CPPConstructionPreview.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+namespace BxpReplication
+{
+	// Maps signed values to unsigned so small negative values also serialize to few bytes.
+	FORCEINLINE uint32 ZigZagEncode(const int32 Value)
+	{
+		return (static_cast<uint32>(Value) << 1) ^ static_cast<uint32>(Value >> 31);
+	}
+
+	FORCEINLINE int32 ZigZagDecode(const uint32 Value)
+	{
+		return static_cast<int32>(Value >> 1) ^ -static_cast<int32>(Value & 1);
+	}
+
+	void SerializeSignedPacked(FArchive& Ar, int32& Value)
+	{
+		uint32 Encoded = ZigZagEncode(Value);
+		Ar.SerializeIntPacked(Encoded);
+		if (Ar.IsLoading())
+		{
+			Value = ZigZagDecode(Encoded);
+		}
+	}
+}
+
+FQuantizedBxpTransform FQuantizedBxpTransform::Quantize(
+	const FVector& Location,
+	const FRotator& Rotation,
+	const float YawStepDegrees)
+{
+	constexpr float GridSize = DeveloperSettings::GamePlay::Construction::GridSnapSize;
+	FQuantizedBxpTransform Quantized;
+	Quantized.GridX = FMath::RoundToInt(Location.X / GridSize);
+	Quantized.GridY = FMath::RoundToInt(Location.Y / GridSize);
+	Quantized.Height = FMath::RoundToInt(Location.Z);
+	const int32 NumSteps = FMath::Max(FMath::RoundToInt(360.f / YawStepDegrees), 1);
+	const int32 Step = FMath::RoundToInt(FRotator::ClampAxis(Rotation.Yaw) / YawStepDegrees) % NumSteps;
+	Quantized.YawStep = static_cast<uint8>(Step);
+	return Quantized;
+}
+
+FVector FQuantizedBxpTransform::GetLocation() const
+{
+	constexpr float GridSize = DeveloperSettings::GamePlay::Construction::GridSnapSize;
+	return FVector(GridX * GridSize, GridY * GridSize, Height);
+}
+
+FRotator FQuantizedBxpTransform::GetRotation(const float YawStepDegrees) const
+{
+	return FRotator(0.f, YawStep * YawStepDegrees, 0.f);
+}
+
+bool FQuantizedBxpTransform::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	BxpReplication::SerializeSignedPacked(Ar, GridX);
+	BxpReplication::SerializeSignedPacked(Ar, GridY);
+	BxpReplication::SerializeSignedPacked(Ar, Height);
+	Ar << YawStep;
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+void FReplicatedBxpSlot::PostReplicatedAdd(const FReplicatedBxpSlotArray& InArraySerializer)
+{
+	PostReplicatedChange(InArraySerializer);
+}
+
+void FReplicatedBxpSlot::PostReplicatedChange(const FReplicatedBxpSlotArray& InArraySerializer)
+{
+	if (InArraySerializer.OwningComponent)
+	{
+		InArraySerializer.OwningComponent->OnSlotChanged.Broadcast(*this);
+	}
+}
+
+void FReplicatedBxpSlot::PreReplicatedRemove(const FReplicatedBxpSlotArray& InArraySerializer)
+{
+	if (InArraySerializer.OwningComponent)
+	{
+		InArraySerializer.OwningComponent->OnSlotRemoved.Broadcast(*this);
+	}
+}
+
+UBxpReplicationComponent::UBxpReplicationComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+	SetIsReplicatedByDefault(true);
+}
+
+void UBxpReplicationComponent::PostInitProperties()
+{
+	Super::PostInitProperties();
+	// Transient, so it is set for every instance instead of being copied from the archetype.
+	M_ReplicatedSlots.OwningComponent = this;
+}
+
+void UBxpReplicationComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (const UWorld* World = GetWorld())
+	{
+		World->GetTimerManager().ClearTimer(M_ConstructionPollHandle);
+	}
+	M_ExpansionsUnderConstruction.Empty();
+	Super::EndPlay(EndPlayReason);
+}
+
+void UBxpReplicationComponent::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+	DOREPLIFETIME(UBxpReplicationComponent, M_ReplicatedSlots);
+}
+
+void UBxpReplicationComponent::SetSlotState(
+	const int32 SlotIndex,
+	const EBuildingExpansionType ExpansionType,
+	const EBuildingExpansionStatus Status)
+{
+	if (!EnsureHasAuthority("SetSlotState"))
+	{
+		return;
+	}
+	FReplicatedBxpSlot* Slot = FindSlot(SlotIndex);
+	if (!Slot)
+	{
+		Slot = &M_ReplicatedSlots.Slots.AddDefaulted_GetRef();
+		Slot->SlotIndex = static_cast<uint8>(SlotIndex);
+	}
+	else if (Slot->ExpansionType == ExpansionType && Slot->Status == Status)
+	{
+		return;
+	}
+	Slot->ExpansionType = ExpansionType;
+	Slot->Status = Status;
+	M_ReplicatedSlots.MarkItemDirty(*Slot);
+}
+
+void UBxpReplicationComponent::SetSlotTransform(const int32 SlotIndex, const FVector& Location,
+                                               const FRotator& Rotation)
+{
+	if (!EnsureHasAuthority("SetSlotTransform"))
+	{
+		return;
+	}
+	FReplicatedBxpSlot* Slot = FindSlot(SlotIndex);
+	if (!Slot)
+	{
+		RTSFunctionLibrary::ReportError("Attempt to set the transform of an expansion slot that is not in use!"
+			"\n At function SetSlotTransform in BxpReplicationComponent.cpp"
+			"\n Slot: " + FString::FromInt(SlotIndex));
+		return;
+	}
+	const FQuantizedBxpTransform Transform = FQuantizedBxpTransform::Quantize(
+		Location, Rotation, ACPPConstructionPreview::RotationStepDegrees);
+	if (Slot->bIsPlaced && Slot->Transform == Transform)
+	{
+		return;
+	}
+	Slot->Transform = Transform;
+	Slot->bIsPlaced = true;
+	M_ReplicatedSlots.MarkItemDirty(*Slot);
+}
+
+void UBxpReplicationComponent::RemoveSlot(const int32 SlotIndex)
+{
+	if (!EnsureHasAuthority("RemoveSlot"))
+	{
+		return;
+	}
+	const int32 NumRemoved = M_ReplicatedSlots.Slots.RemoveAll([SlotIndex](const FReplicatedBxpSlot& Slot)
+	{
+		return Slot.SlotIndex == SlotIndex;
+	});
+	if (NumRemoved > 0)
+	{
+		M_ReplicatedSlots.MarkArrayDirty();
+	}
+	M_ExpansionsUnderConstruction.Remove(SlotIndex);
+}
+
+void UBxpReplicationComponent::TrackConstruction(const int32 SlotIndex, ABuildingExpansion* BuildingExpansion)
+{
+	if (!EnsureHasAuthority("TrackConstruction") || !IsValid(BuildingExpansion) || !FindSlot(SlotIndex))
+	{
+		return;
+	}
+	M_ExpansionsUnderConstruction.Add(SlotIndex, BuildingExpansion);
+	if (!M_ConstructionPollHandle.IsValid())
+	{
+		GetWorld()->GetTimerManager().SetTimer(M_ConstructionPollHandle, this,
+		                                       &UBxpReplicationComponent::PollConstruction,
+		                                       ConstructionPollIntervalSeconds, true);
+	}
+	// Expansions that finish immediately, e.g. restored ones, do not wait for the first poll.
+	PollConstruction();
+}
+
+void UBxpReplicationComponent::PollConstruction()
+{
+	for (auto It = M_ExpansionsUnderConstruction.CreateIterator(); It; ++It)
+	{
+		const ABuildingExpansion* BuildingExpansion = It.Value().Get();
+		const FReplicatedBxpSlot* Slot = FindSlot(It.Key());
+		if (!BuildingExpansion || !Slot)
+		{
+			// Destroyed or packed; the slot is updated by the code that removed the expansion.
+			It.RemoveCurrent();
+			continue;
+		}
+		const EBuildingExpansionStatus Status = BuildingExpansion->GetBuildingExpansionStatus();
+		SetSlotState(It.Key(), Slot->ExpansionType, Status);
+		if (Status == EBuildingExpansionStatus::BXS_Built)
+		{
+			It.RemoveCurrent();
+		}
+	}
+	if (M_ExpansionsUnderConstruction.IsEmpty())
+	{
+		GetWorld()->GetTimerManager().ClearTimer(M_ConstructionPollHandle);
+	}
+}
+
+FRotator UBxpReplicationComponent::GetSlotRotation(const FReplicatedBxpSlot& Slot) const
+{
+	return Slot.Transform.GetRotation(ACPPConstructionPreview::RotationStepDegrees);
+}
+
+const FReplicatedBxpSlot* UBxpReplicationComponent::GetSlot(const int32 SlotIndex) const
+{
+	return M_ReplicatedSlots.Slots.FindByPredicate([SlotIndex](const FReplicatedBxpSlot& Slot)
+	{
+		return Slot.SlotIndex == SlotIndex;
+	});
+}
+
+int32 UBxpReplicationComponent::FindPlacedSlotIndex(const FVector& Location) const
+{
+	// Placed expansions are grid snapped, so the cell identifies the slot.
+	const FQuantizedBxpTransform Quantized = FQuantizedBxpTransform::Quantize(
+		Location, FRotator::ZeroRotator, ACPPConstructionPreview::RotationStepDegrees);
+	const FReplicatedBxpSlot* PlacedSlot = M_ReplicatedSlots.Slots.FindByPredicate(
+		[&Quantized](const FReplicatedBxpSlot& Slot)
+		{
+			return Slot.bIsPlaced && Slot.Transform.GridX == Quantized.GridX && Slot.Transform.GridY == Quantized.GridY;
+		});
+	return PlacedSlot ? PlacedSlot->SlotIndex : INDEX_NONE;
+}
+
+FReplicatedBxpSlot* UBxpReplicationComponent::FindSlot(const int32 SlotIndex)
+{
+	return M_ReplicatedSlots.Slots.FindByPredicate([SlotIndex](const FReplicatedBxpSlot& Slot)
+	{
+		return Slot.SlotIndex == SlotIndex;
+	});
+}
+
+bool UBxpReplicationComponent::EnsureHasAuthority(const FString& FunctionName) const
+{
+	if (GetOwner() && GetOwner()->HasAuthority())
+	{
+		return true;
+	}
+	RTSFunctionLibrary::ReportError("Attempt to change replicated expansion slots without authority!"
+		"\n At function " + FunctionName + " in BxpReplicationComponent.cpp"
+		"\n Component: " + GetName());
+	return false;
+}
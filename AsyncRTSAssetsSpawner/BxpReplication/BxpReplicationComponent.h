@@ -0,0 +1,204 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "Net/Serialization/FastArraySerializer.h"
+#include "RTS_Survival/Buildings/BuildingExpansion/BuildingExpansion.h"
+
+#include "BxpReplicationComponent.generated.h"
+
+class UBxpReplicationComponent;
+
+/**
+ * @brief Transform of a placed expansion quantized to the construction grid.
+ * The location is stored as grid cell with the height in whole units, the yaw as number of rotation steps.
+ * Serialized with variable length integers so a base near the origin costs a few bytes per expansion.
+ */
+USTRUCT()
+struct FQuantizedBxpTransform
+{
+	GENERATED_BODY()
+
+	int32 GridX = 0;
+
+	int32 GridY = 0;
+
+	int32 Height = 0;
+
+	uint8 YawStep = 0;
+
+	/**
+	 * @param Location The grid snapped location.
+	 * @param Rotation Only the yaw is kept.
+	 * @param YawStepDegrees The rotation step of the construction preview.
+	 */
+	static FQuantizedBxpTransform Quantize(const FVector& Location, const FRotator& Rotation, const float YawStepDegrees);
+
+	FVector GetLocation() const;
+
+	FRotator GetRotation(const float YawStepDegrees) const;
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+
+	bool operator==(const FQuantizedBxpTransform& Other) const
+	{
+		return GridX == Other.GridX && GridY == Other.GridY && Height == Other.Height && YawStep == Other.YawStep;
+	}
+};
+
+template <>
+struct TStructOpsTypeTraits<FQuantizedBxpTransform> : public TStructOpsTypeTraitsBase2<FQuantizedBxpTransform>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true
+	};
+};
+
+/** The replicated state of one expansion slot of an owner. */
+USTRUCT()
+struct FReplicatedBxpSlot : public FFastArraySerializerItem
+{
+	GENERATED_BODY()
+
+	// Index in the array of expansion slots of the owner.
+	UPROPERTY()
+	uint8 SlotIndex = 0;
+
+	UPROPERTY()
+	EBuildingExpansionType ExpansionType = static_cast<EBuildingExpansionType>(0);
+
+	UPROPERTY()
+	EBuildingExpansionStatus Status = static_cast<EBuildingExpansionStatus>(0);
+
+	// Only meaningful once the expansion is placed.
+	UPROPERTY()
+	FQuantizedBxpTransform Transform;
+
+	UPROPERTY()
+	bool bIsPlaced = false;
+
+	void PostReplicatedAdd(const struct FReplicatedBxpSlotArray& InArraySerializer);
+	void PostReplicatedChange(const struct FReplicatedBxpSlotArray& InArraySerializer);
+	void PreReplicatedRemove(const struct FReplicatedBxpSlotArray& InArraySerializer);
+};
+
+/** All expansion slots of an owner; only changed slots are sent. */
+USTRUCT()
+struct FReplicatedBxpSlotArray : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<FReplicatedBxpSlot> Slots;
+
+	// Not replicated; receives the slot callbacks on clients. Set in UBxpReplicationComponent::PostInitProperties.
+	UPROPERTY(NotReplicated, Transient)
+	TObjectPtr<UBxpReplicationComponent> OwningComponent = nullptr;
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		return FastArrayDeltaSerialize<FReplicatedBxpSlot, FReplicatedBxpSlotArray>(Slots, DeltaParms, *this);
+	}
+};
+
+template <>
+struct TStructOpsTypeTraits<FReplicatedBxpSlotArray> : public TStructOpsTypeTraitsBase2<FReplicatedBxpSlotArray>
+{
+	enum
+	{
+		WithNetDeltaSerializer = true
+	};
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnBxpSlotReplicated, const FReplicatedBxpSlot& /*Slot*/);
+
+/**
+ * @brief Replicates the expansion slots of a building expansion owner: type, lifecycle status and placement.
+ * The server writes the slots when the state of an expansion changes; only slots that actually changed are marked
+ * dirty, so an idle base costs no bandwidth. Clients and replays are notified with OnSlotChanged and OnSlotRemoved.
+ * Rotations are replicated in steps of ACPPConstructionPreview::RotationStepDegrees.
+ * @note Add to the actor that implements IBuildingExpansionOwner; the actor needs to replicate.
+ */
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class RTS_SURVIVAL_API UBxpReplicationComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	UBxpReplicationComponent();
+
+	virtual void PostInitProperties() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	/**
+	 * @brief Sets the type and status of the slot, adds the slot if it does not exist yet.
+	 * @note Server only.
+	 */
+	void SetSlotState(
+		const int32 SlotIndex,
+		const EBuildingExpansionType ExpansionType,
+		const EBuildingExpansionStatus Status);
+
+	/**
+	 * @brief Sets where the expansion of the slot is placed.
+	 * @note Server only; the slot needs to exist.
+	 */
+	void SetSlotTransform(const int32 SlotIndex, const FVector& Location, const FRotator& Rotation);
+
+	/** @note Server only. */
+	void RemoveSlot(const int32 SlotIndex);
+
+	/**
+	 * @brief Keeps the status of the slot in sync with the expansion until its construction is finished, after which
+	 * the slot is set to BXS_Built.
+	 * @param SlotIndex The slot of the expansion; needs to exist.
+	 * @param BuildingExpansion The placed expansion of the slot.
+	 * @note Server only. Construction finishes inside the expansion, which does not notify its owner's replication,
+	 * so the status is polled every ConstructionPollIntervalSeconds while an expansion of this owner is built.
+	 */
+	void TrackConstruction(const int32 SlotIndex, ABuildingExpansion* BuildingExpansion);
+
+	TConstArrayView<FReplicatedBxpSlot> GetSlots() const { return M_ReplicatedSlots.Slots; }
+
+	/** @return The replicated slot or null if the slot is not in use. */
+	const FReplicatedBxpSlot* GetSlot(const int32 SlotIndex) const;
+
+	/** @return The index of the slot of which the expansion is placed at the location, INDEX_NONE if there is none. */
+	int32 FindPlacedSlotIndex(const FVector& Location) const;
+
+	FVector GetSlotLocation(const FReplicatedBxpSlot& Slot) const { return Slot.Transform.GetLocation(); }
+
+	FRotator GetSlotRotation(const FReplicatedBxpSlot& Slot) const;
+
+	// Called on clients when a slot is added or changed.
+	FOnBxpSlotReplicated OnSlotChanged;
+
+	// Called on clients before a slot is removed.
+	FOnBxpSlotReplicated OnSlotRemoved;
+
+private:
+	UPROPERTY(Replicated)
+	FReplicatedBxpSlotArray M_ReplicatedSlots;
+
+	static constexpr float ConstructionPollIntervalSeconds = 0.5f;
+
+	// Expansions under construction mapped by their slot index; server only.
+	TMap<int32, TWeakObjectPtr<ABuildingExpansion>> M_ExpansionsUnderConstruction;
+
+	// Runs while M_ExpansionsUnderConstruction is not empty.
+	FTimerHandle M_ConstructionPollHandle;
+
+	/** @brief Copies the status of the tracked expansions to their slots; stops tracking built expansions. */
+	void PollConstruction();
+
+	FReplicatedBxpSlot* FindSlot(const int32 SlotIndex);
+
+	bool EnsureHasAuthority(const FString& FunctionName) const;
+};
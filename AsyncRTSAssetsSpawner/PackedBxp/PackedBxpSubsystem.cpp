@@ -0,0 +1,142 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "PackedBxpSubsystem.h"
+
+#include "RTS_Survival/Buildings/BuildingExpansion/BuildingExpansion.h"
+#include "RTS_Survival/Buildings/BuildingExpansion/Interface/BuildingExpansionOwner.h"
+#include "RTS_Survival/Player/AsyncRTSAssetsSpawner/RTSAsyncSpawner.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+void UPackedBxpSubsystem::PackExpansion(
+	IBuildingExpansionOwner* BxpOwner,
+	ABuildingExpansion* BuildingExpansion,
+	const EBuildingExpansionType ExpansionType,
+	const int32 SlotIndex,
+	ARTSAsyncSpawner* AsyncSpawner,
+	const float HealthFraction,
+	const uint32 UpgradeMask)
+{
+	UObject* OwnerObject = Cast<UObject>(BxpOwner);
+	if (!OwnerObject || SlotIndex < 0 || SlotIndex > MAX_uint8)
+	{
+		RTSFunctionLibrary::ReportError("Cannot pack building expansion without owner or with invalid slot!"
+			"\n At function PackExpansion in PackedBxpSubsystem.cpp"
+			"\n Slot: " + FString::FromInt(SlotIndex));
+		return;
+	}
+	if (IsValid(BuildingExpansion))
+	{
+		// The owner keeps the packed status of the slot for its UI.
+		BxpOwner->DestroyBuildingExpansion(BuildingExpansion, true);
+	}
+	if (FPackedBxpRecord* ExistingRecord = FindRecord(BxpOwner, SlotIndex))
+	{
+		// An unpack that was cancelled; the expansion keeps its state from before the unpack.
+		ExistingRecord->bIsMaterializing = false;
+	}
+	else
+	{
+		RemoveStaleOwners();
+		FPackedBxpRecord Record;
+		Record.ExpansionType = ExpansionType;
+		Record.SlotIndex = static_cast<uint8>(SlotIndex);
+		Record.HealthFraction = HealthFraction;
+		Record.UpgradeMask = UpgradeMask;
+		M_PackedExpansions.FindOrAdd(OwnerObject).Add(Record);
+	}
+	if (AsyncSpawner)
+	{
+		AsyncSpawner->ReleaseBuildingExpansionClass(ExpansionType);
+	}
+}
+
+bool UPackedBxpSubsystem::UnpackExpansion(
+	IBuildingExpansionOwner* BxpOwner,
+	const int32 SlotIndex,
+	ARTSAsyncSpawner* AsyncSpawner)
+{
+	FPackedBxpRecord* Record = FindRecord(BxpOwner, SlotIndex);
+	if (!Record || Record->bIsMaterializing || !AsyncSpawner)
+	{
+		return false;
+	}
+	Record->bIsMaterializing = true;
+	// The placement is not known yet, so the expansion spawns inert until the player places it.
+	AsyncSpawner->AsyncSpawnBuildingExpansion(Record->ExpansionType, BxpOwner, SlotIndex, true);
+	return true;
+}
+
+void UPackedBxpSubsystem::OnUnpackFailed(const IBuildingExpansionOwner* BxpOwner, const int32 SlotIndex)
+{
+	if (!BxpOwner)
+	{
+		RemoveStaleOwners();
+		return;
+	}
+	if (FPackedBxpRecord* Record = FindRecord(BxpOwner, SlotIndex))
+	{
+		Record->bIsMaterializing = false;
+	}
+}
+
+void UPackedBxpSubsystem::OnUnpackedExpansionPlaced(
+	IBuildingExpansionOwner* BxpOwner,
+	ABuildingExpansion* BuildingExpansion,
+	const int32 SlotIndex)
+{
+	TArray<FPackedBxpRecord>* Records = M_PackedExpansions.Find(Cast<UObject>(BxpOwner));
+	if (!Records)
+	{
+		return;
+	}
+	const int32 RecordIndex = Records->IndexOfByPredicate([SlotIndex](const FPackedBxpRecord& Record)
+	{
+		return Record.SlotIndex == SlotIndex;
+	});
+	if (RecordIndex == INDEX_NONE)
+	{
+		return;
+	}
+	const FPackedBxpRecord Record = (*Records)[RecordIndex];
+	Records->RemoveAtSwap(RecordIndex);
+	if (Records->IsEmpty())
+	{
+		M_PackedExpansions.Remove(Cast<UObject>(BxpOwner));
+	}
+	OnPackedBxpUnpacked.Broadcast(BuildingExpansion, Record);
+}
+
+TConstArrayView<FPackedBxpRecord> UPackedBxpSubsystem::GetPackedExpansions(
+	const IBuildingExpansionOwner* BxpOwner) const
+{
+	const TArray<FPackedBxpRecord>* Records = M_PackedExpansions.Find(Cast<const UObject>(BxpOwner));
+	return Records ? TConstArrayView<FPackedBxpRecord>(*Records) : TConstArrayView<FPackedBxpRecord>();
+}
+
+void UPackedBxpSubsystem::RemoveOwner(const IBuildingExpansionOwner* BxpOwner)
+{
+	M_PackedExpansions.Remove(Cast<const UObject>(BxpOwner));
+}
+
+FPackedBxpRecord* UPackedBxpSubsystem::FindRecord(const IBuildingExpansionOwner* BxpOwner, const int32 SlotIndex)
+{
+	TArray<FPackedBxpRecord>* Records = M_PackedExpansions.Find(Cast<const UObject>(BxpOwner));
+	return Records
+		       ? Records->FindByPredicate([SlotIndex](const FPackedBxpRecord& Record)
+		       {
+			       return Record.SlotIndex == SlotIndex;
+		       })
+		       : nullptr;
+}
+
+void UPackedBxpSubsystem::RemoveStaleOwners()
+{
+	for (auto It = M_PackedExpansions.CreateIterator(); It; ++It)
+	{
+		if (!It.Key().ResolveObjectPtr())
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
@@ -0,0 +1,113 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/ObjectKey.h"
+
+#include "PackedBxpSubsystem.generated.h"
+
+class ABuildingExpansion;
+class ARTSAsyncSpawner;
+class IBuildingExpansionOwner;
+enum class EBuildingExpansionType : uint8;
+
+/** Everything a packed expansion needs to be unpacked again; packed expansions exist only as these records. */
+struct FPackedBxpRecord
+{
+	EBuildingExpansionType ExpansionType;
+
+	// Index in the array of expansion slots of the owner.
+	uint8 SlotIndex = 0;
+
+	// Whether an unpack was requested and the expansion is spawned or spawning for placement.
+	bool bIsMaterializing = false;
+
+	// Health of the expansion when it was packed, in [0, 1].
+	float HealthFraction = 1.f;
+
+	// One bit per upgrade the expansion had when it was packed.
+	uint32 UpgradeMask = 0;
+};
+
+static_assert(TIsTriviallyCopyable<FPackedBxpRecord>::Value, "Packed expansion records need to stay plain data.");
+
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnPackedBxpUnpacked, ABuildingExpansion* /*BuildingExpansion*/,
+                                     const FPackedBxpRecord& /*Record*/);
+
+/**
+ * @brief Keeps packed building expansions as compact records per owner instead of live actors.
+ * Packing destroys the expansion actor, stores its record and releases its class from residency; the actor is only
+ * spawned again when the player unpacks it, and the record is removed once the unpacked expansion is placed.
+ * @note A nomadic base that moves carries its packed expansions without any actor, component or tick for them.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UPackedBxpSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Destroys the expansion through its owner and keeps it as a record.
+	 * @param BxpOwner The owner of the expansion; keeps the packed status of the slot.
+	 * @param BuildingExpansion The expansion to pack, may be null if it was never spawned.
+	 * @param ExpansionType The type of the expansion.
+	 * @param SlotIndex The slot of the expansion at the owner.
+	 * @param AsyncSpawner Releases the class of the expansion, may be null.
+	 * @param HealthFraction The health of the expansion.
+	 * @param UpgradeMask The upgrades of the expansion.
+	 * @note If the slot already has a record, e.g. when an unpack is cancelled, its health and upgrades are kept.
+	 */
+	void PackExpansion(
+		IBuildingExpansionOwner* BxpOwner,
+		ABuildingExpansion* BuildingExpansion,
+		const EBuildingExpansionType ExpansionType,
+		const int32 SlotIndex,
+		ARTSAsyncSpawner* AsyncSpawner,
+		const float HealthFraction,
+		const uint32 UpgradeMask);
+
+	/**
+	 * @brief Spawns the packed expansion of the slot for placement.
+	 * @param BxpOwner The owner of the packed expansion.
+	 * @param SlotIndex The slot of the packed expansion.
+	 * @param AsyncSpawner Spawns the expansion; the player controller receives it as an unpacked expansion.
+	 * @return Whether the slot has a packed expansion that is not materializing yet.
+	 */
+	bool UnpackExpansion(IBuildingExpansionOwner* BxpOwner, const int32 SlotIndex, ARTSAsyncSpawner* AsyncSpawner);
+
+	/**
+	 * @brief Lets the packed expansion of the slot be unpacked again after its spawn failed.
+	 * @param BxpOwner The owner of the packed expansion, null if it was destroyed; its records are then removed.
+	 * @param SlotIndex The slot of the packed expansion.
+	 */
+	void OnUnpackFailed(const IBuildingExpansionOwner* BxpOwner, const int32 SlotIndex);
+
+	/**
+	 * @brief Removes the record of an unpacked expansion that is placed and broadcasts OnPackedBxpUnpacked.
+	 * @param BxpOwner The owner of the expansion.
+	 * @param BuildingExpansion The placed expansion.
+	 * @param SlotIndex The slot of the expansion.
+	 */
+	void OnUnpackedExpansionPlaced(IBuildingExpansionOwner* BxpOwner, ABuildingExpansion* BuildingExpansion,
+	                               const int32 SlotIndex);
+
+	/** @return The packed expansions of the owner. */
+	TConstArrayView<FPackedBxpRecord> GetPackedExpansions(const IBuildingExpansionOwner* BxpOwner) const;
+
+	/** @brief Forgets the packed expansions of an owner that is destroyed. */
+	void RemoveOwner(const IBuildingExpansionOwner* BxpOwner);
+
+	// Broadcast when an unpacked expansion is placed, to restore the health and upgrades of its record.
+	FOnPackedBxpUnpacked OnPackedBxpUnpacked;
+
+private:
+	/** @return The record of the slot, null if there is none. */
+	FPackedBxpRecord* FindRecord(const IBuildingExpansionOwner* BxpOwner, const int32 SlotIndex);
+
+	/** @brief Removes the records of owners that no longer exist. */
+	void RemoveStaleOwners();
+
+	TMap<TObjectKey<UObject>, TArray<FPackedBxpRecord>> M_PackedExpansions;
+};
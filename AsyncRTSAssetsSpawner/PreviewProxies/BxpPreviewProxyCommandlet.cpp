@@ -0,0 +1,265 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "BxpPreviewProxyCommandlet.h"
+
+#include "RTS_Survival/Player/AsyncRTSAssetsSpawner/RTSAsyncSpawner.h"
+#include "RTS_Survival/Player/ConstructionPreview/PlacementRules/PlacementRules.h"
+
+#if WITH_EDITOR
+#include "Components/StaticMeshComponent.h"
+#include "Engine/Blueprint.h"
+#include "Engine/MeshMerging.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshSocket.h"
+#include "IMeshMergeUtilities.h"
+#include "MeshMergeModule.h"
+#include "Misc/PackageName.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "UObject/SavePackage.h"
+#endif
+
+UBxpPreviewProxyCommandlet::UBxpPreviewProxyCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 UBxpPreviewProxyCommandlet::Main(const FString& Params)
+{
+#if WITH_EDITOR
+	FString SpawnerPath;
+	if (!FParse::Value(*Params, TEXT("Spawner="), SpawnerPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("BxpPreviewProxy: pass the spawner blueprint with -Spawner=<path>."));
+		return 1;
+	}
+	M_OutputPath = TEXT("/Game/PreviewProxies");
+	FParse::Value(*Params, TEXT("OutputPath="), M_OutputPath);
+	FParse::Value(*Params, TEXT("TrianglePercent="), M_TrianglePercent);
+	FParse::Value(*Params, TEXT("TextureSize="), M_TextureSize);
+	const bool bOverwrite = FParse::Param(*Params, TEXT("Overwrite"));
+
+	UBlueprint* SpawnerBlueprint = LoadObject<UBlueprint>(nullptr, *SpawnerPath);
+	ARTSAsyncSpawner* Spawner = SpawnerBlueprint && SpawnerBlueprint->GeneratedClass
+		                            ? Cast<ARTSAsyncSpawner>(SpawnerBlueprint->GeneratedClass->GetDefaultObject())
+		                            : nullptr;
+	if (!Spawner)
+	{
+		UE_LOG(LogTemp, Error, TEXT("BxpPreviewProxy: %s is not a blueprint of ARTSAsyncSpawner."), *SpawnerPath);
+		return 1;
+	}
+
+	// Expansions are spawned without begin play, only their construction scripts run.
+	UWorld* World = UWorld::CreateWorld(EWorldType::EditorPreview, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::EditorPreview);
+	WorldContext.SetCurrentWorld(World);
+
+	int32 NumGenerated = 0;
+	int32 NumFailed = 0;
+	for (const TPair<EBuildingExpansionType, TSoftClassPtr<ABuildingExpansion>>& Pair : Spawner->BuildingExpansionMap)
+	{
+		const UStaticMesh* const* ExistingPreview = Spawner->BxpPreviewMeshMap.Find(Pair.Key);
+		if (!bOverwrite && ExistingPreview && *ExistingPreview)
+		{
+			continue;
+		}
+		UClass* ExpansionClass = Pair.Value.LoadSynchronous();
+		if (!ExpansionClass)
+		{
+			UE_LOG(LogTemp, Error, TEXT("BxpPreviewProxy: failed to load %s."), *Pair.Value.ToString());
+			++NumFailed;
+			continue;
+		}
+		FString ExpansionName = ExpansionClass->GetName();
+		ExpansionName.RemoveFromEnd(TEXT("_C"));
+		const FString PackageName = M_OutputPath / (TEXT("SM_PreviewProxy_") + ExpansionName);
+		UStaticMesh* ProxyMesh = GenerateProxy(World, ExpansionClass, PackageName);
+		if (!ProxyMesh)
+		{
+			++NumFailed;
+			continue;
+		}
+		Spawner->Modify();
+		Spawner->BxpPreviewMeshMap.Add(Pair.Key, ProxyMesh);
+		++NumGenerated;
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	if (NumGenerated > 0 && !SavePackages({SpawnerBlueprint->GetOutermost()}))
+	{
+		++NumFailed;
+	}
+	UE_LOG(LogTemp, Display, TEXT("BxpPreviewProxy: generated %d preview proxies, %d failed."), NumGenerated,
+	       NumFailed);
+	return NumFailed == 0 ? 0 : 1;
+#else
+	UE_LOG(LogTemp, Error, TEXT("BxpPreviewProxy: preview proxies can only be generated in an editor build."));
+	return 1;
+#endif
+}
+
+#if WITH_EDITOR
+UStaticMesh* UBxpPreviewProxyCommandlet::GenerateProxy(
+	UWorld* World,
+	UClass* ExpansionClass,
+	const FString& PackageName) const
+{
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	AActor* Expansion = World->SpawnActor<AActor>(ExpansionClass, FTransform::Identity, SpawnParams);
+	if (!Expansion)
+	{
+		UE_LOG(LogTemp, Error, TEXT("BxpPreviewProxy: failed to spawn %s."), *ExpansionClass->GetName());
+		return nullptr;
+	}
+
+	TArray<UStaticMeshComponent*> MeshComponents;
+	Expansion->GetComponents<UStaticMeshComponent>(MeshComponents);
+	MeshComponents.RemoveAll([](const UStaticMeshComponent* Component)
+	{
+		return !Component->GetStaticMesh() || !Component->IsVisible();
+	});
+	if (MeshComponents.IsEmpty())
+	{
+		UE_LOG(LogTemp, Error, TEXT("BxpPreviewProxy: %s has no visible static meshes."), *ExpansionClass->GetName());
+		Expansion->Destroy();
+		return nullptr;
+	}
+
+	FMeshMergingSettings Settings;
+	// One material slot; the preview replaces it with the construction material anyway.
+	Settings.bMergeMaterials = true;
+	Settings.MaterialSettings.TextureSize = FIntPoint(M_TextureSize, M_TextureSize);
+	Settings.LODSelectionType = EMeshLODSelectionType::LowestDetailLOD;
+	Settings.bMergePhysicsData = false;
+	Settings.bGenerateLightMapUV = false;
+	Settings.bAllowDistanceField = false;
+	// Spawned at the origin, so a zero pivot is the pivot of the expansion.
+	Settings.bPivotPointAtZero = true;
+
+	const TArray<UPrimitiveComponent*> ComponentsToMerge(MeshComponents);
+	TArray<UObject*> MergedAssets;
+	FVector MergedLocation;
+	const IMeshMergeUtilities& MeshMergeUtilities =
+		FModuleManager::Get().LoadModuleChecked<IMeshMergeModule>("MeshMergeUtilities").GetUtilities();
+	MeshMergeUtilities.MergeComponentsToStaticMesh(ComponentsToMerge, World, Settings, nullptr, nullptr, PackageName,
+	                                               MergedAssets, MergedLocation, TNumericLimits<float>::Max(), true);
+
+	UStaticMesh* ProxyMesh = nullptr;
+	TArray<UPackage*> Packages;
+	for (UObject* Asset : MergedAssets)
+	{
+		if (UStaticMesh* MergedMesh = Cast<UStaticMesh>(Asset))
+		{
+			ProxyMesh = MergedMesh;
+		}
+		Packages.AddUnique(Asset->GetOutermost());
+	}
+	if (ProxyMesh)
+	{
+		// Simplified geometry; a full-detail nanite preview would defeat the purpose of a proxy.
+		ProxyMesh->NaniteSettings.bEnabled = false;
+		ProxyMesh->GetSourceModel(0).ReductionSettings.PercentTriangles = M_TrianglePercent;
+		ProxyMesh->Build(true);
+		SetBoxCollision(ProxyMesh);
+		AddFootprintSockets(ProxyMesh, MeshComponents);
+		ProxyMesh->MarkPackageDirty();
+	}
+	Expansion->Destroy();
+
+	if (!ProxyMesh || !SavePackages(Packages))
+	{
+		UE_LOG(LogTemp, Error, TEXT("BxpPreviewProxy: failed to merge %s."), *ExpansionClass->GetName());
+		return nullptr;
+	}
+	return ProxyMesh;
+}
+
+void UBxpPreviewProxyCommandlet::SetBoxCollision(UStaticMesh* ProxyMesh)
+{
+	ProxyMesh->CreateBodySetup();
+	UBodySetup* BodySetup = ProxyMesh->GetBodySetup();
+	BodySetup->RemoveSimpleCollision();
+	const FBox Bounds = ProxyMesh->GetBoundingBox();
+	const FVector Size = Bounds.GetSize();
+	FKBoxElem BoxElem(Size.X, Size.Y, Size.Z);
+	BoxElem.Center = Bounds.GetCenter();
+	BodySetup->AggGeom.BoxElems.Add(BoxElem);
+	BodySetup->CollisionTraceFlag = CTF_UseSimpleAsComplex;
+	BodySetup->InvalidatePhysicsData();
+	BodySetup->CreatePhysicsMeshes();
+}
+
+void UBxpPreviewProxyCommandlet::AddFootprintSockets(
+	UStaticMesh* ProxyMesh,
+	const TArray<UStaticMeshComponent*>& SourceComponents)
+{
+	constexpr int32 NumSockets = UE_ARRAY_COUNT(PlacementRules::FootprintSocketNames);
+	FVector SocketLocations[NumSockets];
+	bool bFoundSourceSockets = false;
+	for (const UStaticMeshComponent* Component : SourceComponents)
+	{
+		bFoundSourceSockets = true;
+		for (int32 i = 0; i < NumSockets; ++i)
+		{
+			const UStaticMeshSocket* Socket = Component->GetStaticMesh()->FindSocket(
+				PlacementRules::FootprintSocketNames[i]);
+			if (!Socket)
+			{
+				bFoundSourceSockets = false;
+				break;
+			}
+			// The expansion is at the origin so the world location is relative to the proxy pivot.
+			SocketLocations[i] = Component->GetComponentTransform().TransformPosition(Socket->RelativeLocation);
+		}
+		if (bFoundSourceSockets)
+		{
+			break;
+		}
+	}
+	if (!bFoundSourceSockets)
+	{
+		// Same order as the names: front left, front right, rear left, rear right.
+		const FBox Bounds = ProxyMesh->GetBoundingBox();
+		SocketLocations[0] = FVector(Bounds.Max.X, Bounds.Min.Y, Bounds.Min.Z);
+		SocketLocations[1] = FVector(Bounds.Max.X, Bounds.Max.Y, Bounds.Min.Z);
+		SocketLocations[2] = FVector(Bounds.Min.X, Bounds.Min.Y, Bounds.Min.Z);
+		SocketLocations[3] = FVector(Bounds.Min.X, Bounds.Max.Y, Bounds.Min.Z);
+	}
+
+	for (int32 i = 0; i < NumSockets; ++i)
+	{
+		if (UStaticMeshSocket* ExistingSocket = ProxyMesh->FindSocket(PlacementRules::FootprintSocketNames[i]))
+		{
+			ProxyMesh->RemoveSocket(ExistingSocket);
+		}
+		UStaticMeshSocket* Socket = NewObject<UStaticMeshSocket>(ProxyMesh);
+		Socket->SocketName = PlacementRules::FootprintSocketNames[i];
+		Socket->RelativeLocation = SocketLocations[i];
+		ProxyMesh->AddSocket(Socket);
+	}
+}
+
+bool UBxpPreviewProxyCommandlet::SavePackages(const TArray<UPackage*>& Packages)
+{
+	bool bAllSaved = true;
+	FSavePackageArgs SaveArgs;
+	SaveArgs.TopLevelFlags = RF_Public | RF_Standalone;
+	for (UPackage* Package : Packages)
+	{
+		const FString FileName = FPackageName::LongPackageNameToFilename(
+			Package->GetName(), FPackageName::GetAssetPackageExtension());
+		if (!UPackage::SavePackage(Package, nullptr, *FileName, SaveArgs))
+		{
+			UE_LOG(LogTemp, Error, TEXT("BxpPreviewProxy: failed to save %s."), *Package->GetName());
+			bAllSaved = false;
+		}
+	}
+	return bAllSaved;
+}
+#endif
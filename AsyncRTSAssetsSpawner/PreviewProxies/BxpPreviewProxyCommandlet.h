@@ -0,0 +1,71 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "BxpPreviewProxyCommandlet.generated.h"
+
+class ARTSAsyncSpawner;
+class UStaticMesh;
+class UStaticMeshComponent;
+class ABuildingExpansion;
+
+/**
+ * @brief Generates the preview meshes of the building expansions and registers them in BxpPreviewMeshMap.
+ * Each expansion is spawned in a temporary world and its static mesh components are merged into one mesh with a
+ * single baked material, reduced to a fraction of its triangles, given one box collision and the FL, FR, RL and RR
+ * footprint sockets. The proxy keeps the pivot of the expansion so it previews exactly where the expansion is built.
+ * Usage: UnrealEditor-Cmd <Project> -run=BxpPreviewProxy -Spawner=<BP_RTSAsyncSpawner path>
+ * [-OutputPath=/Game/PreviewProxies] [-TrianglePercent=0.1] [-TextureSize=512] [-Overwrite]
+ * @note Only types without a preview mesh are generated unless -Overwrite is passed.
+ * Material baking renders the materials, so do not run with -nullrhi.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UBxpPreviewProxyCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UBxpPreviewProxyCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+#if WITH_EDITOR
+	/**
+	 * @brief Merges the static meshes of the expansion class into a saved preview proxy.
+	 * @param World The temporary world to spawn the expansion in.
+	 * @param ExpansionClass The expansion to generate the proxy of.
+	 * @param PackageName The package path of the generated mesh.
+	 * @return The generated and saved proxy, null if the expansion has no static meshes or merging failed.
+	 */
+	UStaticMesh* GenerateProxy(UWorld* World, UClass* ExpansionClass, const FString& PackageName) const;
+
+	/**
+	 * @brief Replaces the collision of the proxy with one box around its bounds.
+	 * @param ProxyMesh The merged mesh.
+	 */
+	static void SetBoxCollision(UStaticMesh* ProxyMesh);
+
+	/**
+	 * @brief Adds the footprint sockets to the proxy, copied from the source meshes if one of them has all of them,
+	 * otherwise at the bottom corners of the proxy bounds.
+	 * @param ProxyMesh The merged mesh, with its pivot at the pivot of the expansion.
+	 * @param SourceComponents The merged components of the spawned expansion at the origin.
+	 */
+	static void AddFootprintSockets(UStaticMesh* ProxyMesh, const TArray<UStaticMeshComponent*>& SourceComponents);
+
+	/** @return Whether all packages were saved. */
+	static bool SavePackages(const TArray<UPackage*>& Packages);
+#endif
+
+	FString M_OutputPath;
+
+	// Fraction of the merged triangles kept by the reduction.
+	float M_TrianglePercent = 0.1f;
+
+	// Size of the single baked material's textures.
+	int32 M_TextureSize = 512;
+};
@@ -3,10 +3,94 @@
 #include "RTSAsyncSpawner.h"
 #include "Engine/StreamableManager.h"
 #include "Engine/AssetManager.h"
+#include "RTS_Survival/Benchmark/RTSBenchmark.h"
+#include "RTS_Survival/Benchmark/RTSBuildingReplay.h"
 #include "RTS_Survival/Buildings/BuildingExpansion/Interface/BuildingExpansionOwner.h"
+#include "RTS_Survival/Player/AsyncRTSAssetsSpawner/PackedBxp/PackedBxpSubsystem.h"
 #include "RTS_Survival/Player/CPPController.h"
 #include "RTS_Survival/Utils/HFunctionLibary.h"
+#include "Components/PrimitiveComponent.h"
+#include "Engine/SCS_Node.h"
+#include "Engine/SimpleConstructionScript.h"
+#include "Engine/BlueprintGeneratedClass.h"
+#include "Engine/InheritableComponentHandler.h"
+#include "PSOPrecache.h"
+#include "Materials/MaterialInterface.h"
+#include "Algo/StableSort.h"
 
+namespace RTSAsyncSpawnerHelpers
+{
+	/**
+	 * @brief Calls Func with each component template added in the blueprint hierarchy of the class, including the
+	 * templates with which child blueprints override inherited components.
+	 */
+	template <typename TFunc>
+	void ForEachBlueprintComponentTemplate(UClass* ActorClass, TFunc&& Func)
+	{
+		UBlueprintGeneratedClass::ForEachGeneratedClassInHierarchy(
+			ActorClass, [&Func](const UBlueprintGeneratedClass* BlueprintClass)
+			{
+				if (BlueprintClass->SimpleConstructionScript)
+				{
+					for (const USCS_Node* Node : BlueprintClass->SimpleConstructionScript->GetAllNodes())
+					{
+						if (Node->ComponentTemplate)
+						{
+							Func(Node->ComponentTemplate);
+						}
+					}
+				}
+				if (const UInheritableComponentHandler* OverrideHandler =
+					const_cast<UBlueprintGeneratedClass*>(BlueprintClass)->GetInheritableComponentHandler())
+				{
+					TArray<UActorComponent*> OverrideTemplates;
+					OverrideHandler->GetAllTemplates(OverrideTemplates);
+					for (UActorComponent* OverrideTemplate : OverrideTemplates)
+					{
+						Func(OverrideTemplate);
+					}
+				}
+				return true;
+			});
+	}
+
+	/** @return The number of scene parents above the component, zero for non-scene components. */
+	int32 GetAttachDepth(const UActorComponent* Component)
+	{
+		int32 Depth = 0;
+		const USceneComponent* SceneComponent = Cast<USceneComponent>(Component);
+		while (SceneComponent && SceneComponent->GetAttachParent())
+		{
+			SceneComponent = SceneComponent->GetAttachParent();
+			++Depth;
+		}
+		return Depth;
+	}
+
+	/**
+	 * @brief Collects the primitive component templates of an actor class, both the native components of its
+	 * default object and the components added in the blueprint hierarchy.
+	 * @param ActorClass The class to collect the templates of.
+	 * @param OutTemplates The templates.
+	 */
+	void GetPrimitiveComponentTemplates(UClass* ActorClass, TArray<UPrimitiveComponent*>& OutTemplates)
+	{
+		if (const AActor* DefaultActor = Cast<AActor>(ActorClass->GetDefaultObject()))
+		{
+			DefaultActor->GetComponents<UPrimitiveComponent>(OutTemplates);
+		}
+		ForEachBlueprintComponentTemplate(ActorClass, [&OutTemplates](UActorComponent* Template)
+		{
+			if (UPrimitiveComponent* PrimitiveTemplate = Cast<UPrimitiveComponent>(Template))
+			{
+				OutTemplates.AddUnique(PrimitiveTemplate);
+			}
+		});
+	}
+}
+
+
+const FName ARTSAsyncSpawner::InertBxpTag(TEXT("RTSInertBxp"));
 
 ARTSAsyncSpawner::ARTSAsyncSpawner()
 {
@@ -47,97 +131,383 @@ UStaticMesh* ARTSAsyncSpawner::SyncGetBuildingExpansionPreviewMesh(EBuildingExpa
 	}
 }
 
+void ARTSAsyncSpawner::PreloadBuildingExpansionClasses(
+	const TConstArrayView<EBuildingExpansionType> BuildingExpansionTypes,
+	FStreamableDelegate OnPreloaded)
+{
+	for (TPair<EBuildingExpansionType, TSharedPtr<FStreamableHandle>>& ResidentClass : M_ResidentClassHandles)
+	{
+		ResidentClass.Value->ReleaseHandle();
+	}
+	M_ResidentClassHandles.Reset();
+	// One handle per type so each class can be released on its own, see ReleaseBuildingExpansionClass.
+	TArray<TSharedPtr<FStreamableHandle>> ClassHandles;
+	for (const EBuildingExpansionType BuildingExpansionType : BuildingExpansionTypes)
+	{
+		if (const TSoftClassPtr<ABuildingExpansion>* AssetClass = BuildingExpansionMap.Find(BuildingExpansionType))
+		{
+			if (M_ResidentClassHandles.Contains(BuildingExpansionType))
+			{
+				continue;
+			}
+			TSharedPtr<FStreamableHandle> ClassHandle = StreamableManager.RequestAsyncLoad(
+				AssetClass->ToSoftObjectPath(), FStreamableDelegate(), FStreamableManager::AsyncLoadHighPriority);
+			if (ClassHandle.IsValid())
+			{
+				M_ResidentClassHandles.Add(BuildingExpansionType, ClassHandle);
+				ClassHandles.Add(MoveTemp(ClassHandle));
+			}
+		}
+		else
+		{
+			RTSFunctionLibrary::ReportError(
+				"Building expansion type not found in the map! \n At function PreloadBuildingExpansionClasses in RTSAsyncSpawner.cpp"
+				"number of BuildingExpansionType: " + FString::FromInt((int32)BuildingExpansionType));
+		}
+	}
+	M_PreloadHandle = ClassHandles.IsEmpty() ? nullptr : StreamableManager.CreateCombinedHandle(ClassHandles);
+	if (!M_PreloadHandle.IsValid() || M_PreloadHandle->HasLoadCompleted())
+	{
+		M_PreloadHandle.Reset();
+		OnPreloaded.ExecuteIfBound();
+		return;
+	}
+	M_PreloadHandle->BindCompleteDelegate(MoveTemp(OnPreloaded));
+}
+
+void ARTSAsyncSpawner::ReleaseBuildingExpansionClass(const EBuildingExpansionType BuildingExpansionType)
+{
+	TSharedPtr<FStreamableHandle> ClassHandle;
+	if (M_ResidentClassHandles.RemoveAndCopyValue(BuildingExpansionType, ClassHandle))
+	{
+		// The class unloads with the next garbage collection once no expansion of it exists anymore.
+		ClassHandle->ReleaseHandle();
+	}
+}
+
+void ARTSAsyncSpawner::WakeInertBxp(AActor* BuildingExpansion)
+{
+	if (BuildingExpansion && BuildingExpansion->Tags.Remove(InertBxpTag) > 0)
+	{
+		BuildingExpansion->SetActorEnableCollision(true);
+	}
+}
+
+UClass* ARTSAsyncSpawner::GetLoadedBuildingExpansionClass(const EBuildingExpansionType BuildingExpansionType) const
+{
+	const TSoftClassPtr<ABuildingExpansion>* AssetClass = BuildingExpansionMap.Find(BuildingExpansionType);
+	return AssetClass ? AssetClass->Get() : nullptr;
+}
+
 void ARTSAsyncSpawner::AsyncSpawnBuildingExpansion(
 	EBuildingExpansionType BuildingExpansionType,
 	IBuildingExpansionOwner* BuildingExpansionOwner,
 	const int ExpansionSlotIndex,
 	const bool bIsUnpackedExpansion)
 {
-	if (BuildingExpansionType == EBuildingExpansionType::BXT_Invalid)
+	if (!BuildingExpansionOwner)
+	{
+		RTSFunctionLibrary::ReportError(
+			"Attempt to spawn a building expansion without owner! \n At function AsyncSpawnBuildingExpansion in RTSAsyncSpawner.cpp"
+			"\n Use AsyncSpawnBenchmarkExpansion to measure the spawn pipeline.");
+		return;
+	}
+	FBxpSpawnRequest Request;
+	Request.BuildingExpansionType = BuildingExpansionType;
+	Request.BuildingExpansionOwner = BuildingExpansionOwner;
+	Request.OwnerObject = Cast<UObject>(BuildingExpansionOwner);
+	Request.ExpansionSlotIndex = ExpansionSlotIndex;
+	Request.bIsUnpackedExpansion = bIsUnpackedExpansion;
+	RequestBxpSpawn(MoveTemp(Request));
+}
+
+void ARTSAsyncSpawner::AsyncSpawnBenchmarkExpansion(const EBuildingExpansionType BuildingExpansionType)
+{
+	FBxpSpawnRequest Request;
+	Request.BuildingExpansionType = BuildingExpansionType;
+	Request.ExpansionSlotIndex = INDEX_NONE;
+	Request.bIsBenchmarkRequest = true;
+	RequestBxpSpawn(MoveTemp(Request));
+}
+
+void ARTSAsyncSpawner::RequestBxpSpawn(FBxpSpawnRequest&& Request)
+{
+	if (Request.BuildingExpansionType == EBuildingExpansionType::BXT_Invalid)
 	{
 		RTSFunctionLibrary::ReportError(
-			"Attempt to spawn invalid building expansion type! \n At function AsyncSpawnBuildingExpansion in RTSAsyncSpawner.cpp"
+			"Attempt to spawn invalid building expansion type! \n At function RequestBxpSpawn in RTSAsyncSpawner.cpp"
 			"\n the function will return without spawning the expansion.");
 		return;
 	}
 	// Check if the map contains the specified building expansion type
-	if (BuildingExpansionMap.Contains(BuildingExpansionType))
+	const TSoftClassPtr<ABuildingExpansion>* AssetClass = BuildingExpansionMap.Find(Request.BuildingExpansionType);
+	if (!AssetClass)
+	{
+		RTSFunctionLibrary::ReportError(
+			"Building expansion type not found in the map! \n At function RequestBxpSpawn in RTSAsyncSpawner.cpp"
+			"number of BuildingExpansionType: " + FString::FromInt((int32)Request.BuildingExpansionType));
+		return;
+	}
+	const FSoftObjectPath AssetPath = AssetClass->ToSoftObjectPath();
+	Request.RequestCycles = FPlatformTime::Cycles64();
+	// If the asset is already loaded, handle it immediately (possible if recently used)
+	Request.bWasLoadedOnRequest = AssetClass->IsValid();
+	if (Request.bWasLoadedOnRequest)
+	{
+		HandleAsyncBxpLoadComplete(AssetPath, MoveTemp(Request));
+		return;
+	}
+	// If the asset is not loaded, request asynchronous loading
+	StreamableManager.RequestAsyncLoad(
+		AssetPath,
+		FStreamableDelegate::CreateUObject(this, &ARTSAsyncSpawner::HandleAsyncBxpLoadComplete, AssetPath,
+		                                   MoveTemp(Request)));
+}
+
+void ARTSAsyncSpawner::HandleAsyncBxpLoadComplete(FSoftObjectPath AssetPath, FBxpSpawnRequest Request)
+{
+	// Resolve the loaded asset and cast it to a UClass to obtain actor class
+	if (UClass* AssetClass = Cast<UClass>(AssetPath.ResolveObject()))
+	{
+		Request.AssetClass = AssetClass;
+		PrecacheBxpPSOs(MoveTemp(Request));
+		return;
+	}
+	OnBxpSpawnFailed(Request);
+}
+
+void ARTSAsyncSpawner::PrecacheBxpPSOs(FBxpSpawnRequest&& Request)
+{
+	UClass* AssetClass = Request.AssetClass.Get();
+	bool bIsAlreadyInSet = false;
+	M_PrecachedClasses.Add(FSoftObjectPath(AssetClass), &bIsAlreadyInSet);
+	if (!IsComponentPSOPrecachingEnabled())
 	{
-		// Get the soft class reference for the specified building expansion type
-		const TSoftClassPtr<ABuildingExpansion> AssetClass = BuildingExpansionMap[BuildingExpansionType];
+		SpawnBxp(Request);
+		return;
+	}
 
-		// If the asset is already loaded, handle it immediately (possible if recently used)
-		if (AssetClass.IsValid())
+	FPendingBxpPrecache PendingPrecache;
+	if (bIsAlreadyInSet)
+	{
+		// The same class may still be precaching for an earlier request; wait for the same events.
+		const FPendingBxpPrecache* EarlierPrecache = M_PendingPrecaches.FindByPredicate(
+			[AssetClass](const FPendingBxpPrecache& Pending) { return Pending.Request.AssetClass == AssetClass; });
+		if (!EarlierPrecache)
 		{
-			HandleAsyncBxpLoadComplete(AssetClass.ToSoftObjectPath(),
-			                           BuildingExpansionType,
-			                           BuildingExpansionOwner,
-			                           ExpansionSlotIndex,
-			                           bIsUnpackedExpansion);
+			SpawnBxp(Request);
+			return;
 		}
-		else
+		PendingPrecache.PrecacheEvents = EarlierPrecache->PrecacheEvents;
+	}
+	else
+	{
+		RTS_BENCHMARK_SCOPE("AsyncSpawner.RequestPSOPrecache");
+		TArray<UPrimitiveComponent*> ComponentTemplates;
+		RTSAsyncSpawnerHelpers::GetPrimitiveComponentTemplates(AssetClass, ComponentTemplates);
+		FPSOPrecacheParams PrecacheParams;
+		FMaterialInterfacePSOPrecacheParamsList PrecacheParamsList;
+		for (UPrimitiveComponent* ComponentTemplate : ComponentTemplates)
 		{
-			// If the asset is not loaded, request asynchronous loading
-			StreamableManager.RequestAsyncLoad(
-				AssetClass.ToSoftObjectPath(),
-				FStreamableDelegate::CreateUObject(
-					this,
-					&ARTSAsyncSpawner::HandleAsyncBxpLoadComplete,
-					AssetClass.ToSoftObjectPath(),
-					BuildingExpansionType,
-					BuildingExpansionOwner,
-					ExpansionSlotIndex,
-					bIsUnpackedExpansion
-				)
-			);
+			ComponentTemplate->CollectPSOPrecacheData(PrecacheParams, PrecacheParamsList);
 		}
+		TArray<FMaterialPSOPrecacheRequestID> RequestIDs;
+		PendingPrecache.PrecacheEvents = PrecachePSOs(PrecacheParamsList, RequestIDs);
 	}
-	else
+	if (PendingPrecache.PrecacheEvents.IsEmpty())
+	{
+		SpawnBxp(Request);
+		return;
+	}
+	PendingPrecache.Request = MoveTemp(Request);
+	PendingPrecache.StartTime = GetWorld()->GetRealTimeSeconds();
+	M_PendingPrecaches.Add(MoveTemp(PendingPrecache));
+	GetWorldTimerManager().SetTimerForNextTick(this, &ARTSAsyncSpawner::CheckPendingPrecaches);
+}
+
+void ARTSAsyncSpawner::CheckPendingPrecaches()
+{
+	const double Now = GetWorld()->GetRealTimeSeconds();
+	// Collected first as spawning calls back into the controller which may request another expansion.
+	TArray<FBxpSpawnRequest, TInlineAllocator<4>> ReadyRequests;
+	for (int32 i = M_PendingPrecaches.Num() - 1; i >= 0; --i)
+	{
+		FPendingBxpPrecache& PendingPrecache = M_PendingPrecaches[i];
+		const bool bIsTimedOut = Now - PendingPrecache.StartTime >= PSOPrecacheTimeoutSeconds;
+		const bool bIsPrecached = !PendingPrecache.PrecacheEvents.ContainsByPredicate(
+			[](const FGraphEventRef& Event) { return Event.IsValid() && !Event->IsComplete(); });
+		if (!bIsPrecached && !bIsTimedOut)
+		{
+			continue;
+		}
+		FRTSBenchmark::Get().AddSample(bIsPrecached
+			                               ? FName("AsyncSpawner.PSOPrecache")
+			                               : FName("AsyncSpawner.PSOPrecache.TimedOut"),
+		                               (Now - PendingPrecache.StartTime) * 1000.0);
+		ReadyRequests.Add(MoveTemp(PendingPrecache.Request));
+		M_PendingPrecaches.RemoveAtSwap(i);
+	}
+	if (!M_PendingPrecaches.IsEmpty())
+	{
+		GetWorldTimerManager().SetTimerForNextTick(this, &ARTSAsyncSpawner::CheckPendingPrecaches);
+	}
+	for (const FBxpSpawnRequest& Request : ReadyRequests)
+	{
+		SpawnBxp(Request);
+	}
+}
+
+void ARTSAsyncSpawner::SpawnBxp(const FBxpSpawnRequest& Request)
+{
+	UClass* AssetClass = Request.AssetClass.Get();
+	if (!AssetClass || Request.IsOwnerLost())
+	{
+		OnBxpSpawnFailed(Request);
+		return;
+	}
+	RTS_BENCHMARK_SCOPE("AsyncSpawner.SpawnDeferred");
+	// Parked at this spawner until the player places it.
+	const FTransform SpawnTransform(GetActorLocation());
+	AActor* SpawnedActor = GetWorld()->SpawnActorDeferred<AActor>(AssetClass, SpawnTransform, nullptr, nullptr,
+	                                                              ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	if (!SpawnedActor)
 	{
 		RTSFunctionLibrary::ReportError(
-			"Building expansion type not found in the map! \n At function AsyncSpawnBuildingExpansion in RTSAsyncSpawner.cpp"
-			"number of BuildingExpansionType: " + FString::FromInt((int32)BuildingExpansionType));
+			"Failed to spawn building expansion of type " + FString::FromInt((int32)Request.BuildingExpansionType) +
+			". \n At function SpawnBxp in RTSAsyncSpawner.cpp"
+			"Class name: ARTSAsyncSpawner. \n result: No callback to playercontroller is made.");
+		OnBxpSpawnFailed(Request);
+		return;
 	}
+
+	// Components without collision generate no overlaps and are not relevant to navigation, so moving the
+	// expansion to its placement later costs no physics or navigation work.
+	SpawnedActor->SetActorEnableCollision(false);
+	SpawnedActor->Tags.Add(InertBxpTag);
+	// The construction script creates the blueprint components, including inherited overrides, unregistered so
+	// their registration, which creates their render and physics state, can be spread over the next frames.
+	// The templates are restored before anything else can spawn from them.
+	TArray<UActorComponent*, TInlineAllocator<16>> AutoRegisterTemplates;
+	RTSAsyncSpawnerHelpers::ForEachBlueprintComponentTemplate(AssetClass, [&AutoRegisterTemplates](UActorComponent* Template)
+	{
+		if (Template->bAutoRegister)
+		{
+			Template->bAutoRegister = false;
+			AutoRegisterTemplates.Add(Template);
+		}
+	});
+	SpawnedActor->FinishSpawning(SpawnTransform);
+	for (UActorComponent* Template : AutoRegisterTemplates)
+	{
+		Template->bAutoRegister = true;
+	}
+
+	FPendingBxpRegistration PendingRegistration;
+	PendingRegistration.Request = Request;
+	PendingRegistration.SpawnedActor = SpawnedActor;
+	for (UActorComponent* Component : SpawnedActor->GetComponents())
+	{
+		// Components instanced from cooked template data may have registered regardless; those are left as is.
+		if (Component && !Component->IsRegistered() && Component->CreationMethod ==
+			EComponentCreationMethod::SimpleConstructionScript)
+		{
+			Component->bAutoRegister = true;
+			PendingRegistration.ComponentsToRegister.Add(Component);
+		}
+	}
+	// Attach parents are registered before their children.
+	Algo::StableSortBy(PendingRegistration.ComponentsToRegister, [](const TWeakObjectPtr<UActorComponent>& Component)
+	{
+		return RTSAsyncSpawnerHelpers::GetAttachDepth(Component.Get());
+	});
+	M_PendingRegistrations.Add(MoveTemp(PendingRegistration));
+	// Registration starts next frame, this frame already paid for the spawn and construction.
+	GetWorldTimerManager().SetTimerForNextTick(this, &ARTSAsyncSpawner::RegisterPendingComponents);
 }
 
-void ARTSAsyncSpawner::HandleAsyncBxpLoadComplete(
-	FSoftObjectPath AssetPath,
-	const EBuildingExpansionType BuildingExpansionType,
-	IBuildingExpansionOwner* BuildingExpansionOwner,
-	const int ExpansionSlotIndex,
-	const bool bIsUnpackedExpansion)
+void ARTSAsyncSpawner::RegisterPendingComponents()
 {
-	// Resolve the loaded asset
-	UObject* LoadedAsset = AssetPath.ResolveObject();
-	if (LoadedAsset)
+	RTS_BENCHMARK_SCOPE("AsyncSpawner.RegisterComponentsFrame");
+	const uint64 BudgetEndCycles = FPlatformTime::Cycles64() +
+		static_cast<uint64>(ComponentRegistrationBudgetMs / 1000.0 / FPlatformTime::GetSecondsPerCycle64());
+	TArray<FPendingBxpRegistration, TInlineAllocator<4>> FinishedRegistrations;
+	// First in, first finished; at least one component is registered per frame to always make progress.
+	bool bIsFirstRegistration = true;
+	for (int32 i = 0; i < M_PendingRegistrations.Num(); ++i)
 	{
-		// Cast the loaded asset to a UClass to obtain actor class
-		UClass* AssetClass = Cast<UClass>(LoadedAsset);
-		if (AssetClass)
+		FPendingBxpRegistration& PendingRegistration = M_PendingRegistrations[i];
+		if (!PendingRegistration.SpawnedActor.IsValid())
 		{
-			// Spawn the building expansion actor at the current location of this spawner
-			FActorSpawnParameters SpawnParams;
-			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
-			AActor* SpawnedActor = GetWorld()->SpawnActor<AActor>(AssetClass, GetActorLocation(), FRotator::ZeroRotator,
-			                                                      SpawnParams);
-
-			// If the actor was spawned successfully, call the blueprint-implementable event
-			if (SpawnedActor)
-			{
-				OnBuildingExpansionSpawned(SpawnedActor, BuildingExpansionOwner, BuildingExpansionType,
-				                           ExpansionSlotIndex, bIsUnpackedExpansion);
-			}
-			else
+			OnBxpSpawnFailed(PendingRegistration.Request);
+			M_PendingRegistrations.RemoveAt(i--);
+			continue;
+		}
+		while (PendingRegistration.NextComponentIndex < PendingRegistration.ComponentsToRegister.Num()
+			&& (bIsFirstRegistration || FPlatformTime::Cycles64() < BudgetEndCycles))
+		{
+			UActorComponent* Component =
+				PendingRegistration.ComponentsToRegister[PendingRegistration.NextComponentIndex++].Get();
+			if (Component && !Component->IsRegistered())
 			{
-				RTSFunctionLibrary::ReportError(
-					"Failed to spawn building expansion of type " + FString::FromInt((int32)BuildingExpansionType) +
-					". \n At function HandleAsyncBxpLoadComplete in RTSAsyncSpawner.cpp"
-					"Class name: ARTSAsyncSpawner. \n result: No callback to playercontroller is made.");
+				Component->RegisterComponent();
+				bIsFirstRegistration = false;
 			}
 		}
+		if (PendingRegistration.NextComponentIndex < PendingRegistration.ComponentsToRegister.Num())
+		{
+			break;
+		}
+		FinishedRegistrations.Add(MoveTemp(PendingRegistration));
+		M_PendingRegistrations.RemoveAt(i--);
+	}
+	if (!M_PendingRegistrations.IsEmpty())
+	{
+		GetWorldTimerManager().SetTimerForNextTick(this, &ARTSAsyncSpawner::RegisterPendingComponents);
+	}
+	for (const FPendingBxpRegistration& FinishedRegistration : FinishedRegistrations)
+	{
+		OnBxpFullyRegistered(FinishedRegistration.Request, FinishedRegistration.SpawnedActor.Get());
 	}
 }
 
+void ARTSAsyncSpawner::OnBxpFullyRegistered(const FBxpSpawnRequest& Request, AActor* SpawnedActor)
+{
+	if (Request.IsOwnerLost())
+	{
+		SpawnedActor->Destroy();
+		OnBxpSpawnFailed(Request);
+		return;
+	}
+	FRTSBenchmark::Get().AddSample(
+		Request.bWasLoadedOnRequest
+			? FName("AsyncSpawner.RequestToSpawn.Warm")
+			: FName("AsyncSpawner.RequestToSpawn.Cold"),
+		FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - Request.RequestCycles));
+	if (Request.bIsBenchmarkRequest)
+	{
+		// Only the spawn pipeline is measured.
+		SpawnedActor->Destroy();
+		return;
+	}
+	FBuildingReplayRecorder::Get().RecordExpansionInput(
+		EBuildingReplayEvent::BRE_BxpSpawned, Cast<AActor>(Request.BuildingExpansionOwner),
+		static_cast<uint8>(Request.BuildingExpansionType), Request.ExpansionSlotIndex,
+		Request.bWasLoadedOnRequest);
+	OnBuildingExpansionSpawned(SpawnedActor, Request.BuildingExpansionOwner, Request.BuildingExpansionType,
+	                           Request.ExpansionSlotIndex, Request.bIsUnpackedExpansion);
+}
+
+void ARTSAsyncSpawner::OnBxpSpawnFailed(const FBxpSpawnRequest& Request) const
+{
+	if (!Request.bIsUnpackedExpansion)
+	{
+		return;
+	}
+	// The packed expansion would otherwise stay materializing and could never be unpacked again.
+	GetWorld()->GetSubsystem<UPackedBxpSubsystem>()->OnUnpackFailed(
+		Request.IsOwnerLost() ? nullptr : Request.BuildingExpansionOwner, Request.ExpansionSlotIndex);
+}
+
 void ARTSAsyncSpawner::OnBuildingExpansionSpawned(
 	AActor* SpawnedActor,
 	IBuildingExpansionOwner* BuildingExpansionOwner,
@@ -146,6 +516,14 @@ void ARTSAsyncSpawner::OnBuildingExpansionSpawned(
 	const bool bIsUnpackedExpansion
 )
 {
+	if (!BuildingExpansionOwner)
+	{
+		RTSFunctionLibrary::ReportError(
+			"Spawned building expansion has no owner! \n At function OnBuildingExpansionSpawned in RTSAsyncSpawner.cpp"
+			"\n The expansion is destroyed. Name of spawned actor: " + SpawnedActor->GetName());
+		SpawnedActor->Destroy();
+		return;
+	}
 	if (M_PlayerController)
 	{
 		if (ABuildingExpansion* BuildingExpansion = Cast<ABuildingExpansion>(SpawnedActor))
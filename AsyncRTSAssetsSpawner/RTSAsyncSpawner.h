@@ -12,11 +12,66 @@ class ACPPController;
 enum class EBuildingExpansionType : uint8;
 class ABuildingExpansion;
 
+/** A loaded building expansion class that waits to be spawned. */
+struct FBxpSpawnRequest
+{
+	TWeakObjectPtr<UClass> AssetClass;
+
+	EBuildingExpansionType BuildingExpansionType;
+
+	IBuildingExpansionOwner* BuildingExpansionOwner = nullptr;
+
+	// Detects an owner that was destroyed while the request was waiting.
+	TWeakObjectPtr<UObject> OwnerObject;
+
+	int ExpansionSlotIndex = 0;
+
+	bool bIsUnpackedExpansion = false;
+
+	// Cycle counter at the time of the request, used for the request to spawn latency.
+	uint64 RequestCycles = 0;
+
+	// Whether the class was already loaded when requested (warm cache).
+	bool bWasLoadedOnRequest = false;
+
+	// Only measures the spawn pipeline; the spawned expansion is destroyed instead of handed to the controller.
+	bool bIsBenchmarkRequest = false;
+
+	/** @return Whether the request had an owner that no longer exists. */
+	inline bool IsOwnerLost() const { return BuildingExpansionOwner && !OwnerObject.IsValid(); }
+};
+
+/** A spawn request that waits for the pipeline state precaching of the materials of its class. */
+struct FPendingBxpPrecache
+{
+	FBxpSpawnRequest Request;
+
+	FGraphEventArray PrecacheEvents;
+
+	double StartTime = 0.0;
+};
+
+/** A spawned expansion of which the blueprint components are registered over several frames. */
+struct FPendingBxpRegistration
+{
+	FBxpSpawnRequest Request;
+
+	TWeakObjectPtr<AActor> SpawnedActor;
+
+	// Sorted so attach parents come before their children.
+	TArray<TWeakObjectPtr<UActorComponent>> ComponentsToRegister;
+
+	int32 NextComponentIndex = 0;
+};
+
 UCLASS()
 class RTS_SURVIVAL_API ARTSAsyncSpawner : public AActorObjectsMaster
 {
 	GENERATED_BODY()
 
+	// Registers the generated preview proxies in BxpPreviewMeshMap.
+	friend class UBxpPreviewProxyCommandlet;
+
 public:
 	ARTSAsyncSpawner();
 
@@ -26,6 +81,7 @@ public:
 	 * @param BuildingExpansionOwner The owner of the building expansion.
 	 * @param ExpansionSlotIndex The index of the expansion slot to spawn the expansion in.
 	 * @param bIsUnpackedExpansion Whether the expansion is an unpacked expansion or not.
+	 * @note The expansion is spawned inert at the spawner until it is placed, see WakeInertBxp.
 	 * @pre The BuildingExpansionType is set to the correct mapping in the BuildingExpansionMap.
 	 */
 	void AsyncSpawnBuildingExpansion(
@@ -34,6 +90,21 @@ public:
 		const int ExpansionSlotIndex,
 		const bool bIsUnpackedExpansion);
 
+	/**
+	 * @brief Runs the full spawn pipeline for the expansion type without an owner, to measure it.
+	 * @param BuildingExpansionType The type of building expansion to spawn.
+	 * @post The spawned expansion is destroyed once all of its components are registered.
+	 */
+	void AsyncSpawnBenchmarkExpansion(const EBuildingExpansionType BuildingExpansionType);
+
+	/**
+	 * @brief Enables the collision, and with that the navigation relevance, of a bxp that was spawned inert.
+	 * @param BuildingExpansion The expansion that is placed at its final transform.
+	 * @note Call right after StartExpansionConstructionAtLocation moved the expansion to its placement, so it only
+	 * updates overlaps and navigation there. Does nothing for expansions that were not spawned by this spawner.
+	 */
+	static void WakeInertBxp(AActor* BuildingExpansion);
+
 	UFUNCTION(BlueprintCallable, Category = "ReferenceCasts")
 	void InitRTSAsyncSpawner(ACPPController* PlayerController);
 
@@ -45,6 +116,31 @@ public:
 	 */
 	UStaticMesh* SyncGetBuildingExpansionPreviewMesh(EBuildingExpansionType BuildingExpansionType);
 
+	/** @return Whether a preview mesh is mapped for the type, without reporting an error if it is not. */
+	inline bool HasBuildingExpansionPreviewMesh(const EBuildingExpansionType BuildingExpansionType) const
+	{
+		return BxpPreviewMeshMap.Contains(BuildingExpansionType);
+	}
+
+	/**
+	 * @brief Loads the classes of all provided expansion types in one request and keeps them loaded until the next
+	 * preload or until they are released with ReleaseBuildingExpansionClass.
+	 * @param BuildingExpansionTypes The types to load.
+	 * @param OnPreloaded Called when all classes are loaded, directly if they already were.
+	 */
+	void PreloadBuildingExpansionClasses(
+		TConstArrayView<EBuildingExpansionType> BuildingExpansionTypes,
+		FStreamableDelegate OnPreloaded);
+
+	/**
+	 * @brief Stops keeping the class of the expansion type resident.
+	 * @param BuildingExpansionType The type of which no expansion needs to be spawned soon, e.g. when packed.
+	 */
+	void ReleaseBuildingExpansionClass(const EBuildingExpansionType BuildingExpansionType);
+
+	/** @return The class of the expansion type if it is loaded, null otherwise. */
+	UClass* GetLoadedBuildingExpansionClass(const EBuildingExpansionType BuildingExpansionType) const;
+
 
 protected:
 	virtual void BeginPlay() override;
@@ -53,7 +149,17 @@ protected:
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Async Spawning")
 	TMap<EBuildingExpansionType, TSoftClassPtr<ABuildingExpansion>> BuildingExpansionMap;
 
+	// How long a loaded expansion waits for the pipeline states of its materials before it is spawned anyway.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Async Spawning")
+	float PSOPrecacheTimeoutSeconds = 1.5f;
+
+	// Time per frame spent on registering the components of spawned expansions; at least one component is
+	// registered each frame.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Async Spawning")
+	float ComponentRegistrationBudgetMs = 1.f;
+
 	// Associates the building expansion type with the associated preview mesh using a hashmap.
+	// Types without a preview mesh are filled in by UBxpPreviewProxyCommandlet.
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category = "Async Spawning")
 	TMap<EBuildingExpansionType, UStaticMesh*> BxpPreviewMeshMap;
 
@@ -61,26 +167,73 @@ private:
 	// Used to load assets asynchronously.
 	FStreamableManager StreamableManager;
 
+	// Waits for all classes of the last preload.
+	TSharedPtr<FStreamableHandle> M_PreloadHandle;
+
+	// Keeps the preloaded classes loaded, per type so they can be released one at a time.
+	TMap<EBuildingExpansionType, TSharedPtr<FStreamableHandle>> M_ResidentClassHandles;
+
 	// Safe refeence using GC system.
 	UPROPERTY()
 	ACPPController* M_PlayerController;
 
+	/**
+	 * @brief Loads the class of the requested type if needed and continues with HandleAsyncBxpLoadComplete.
+	 * @param Request The request; the asset class, cycles and warm cache flag are filled in here.
+	 */
+	void RequestBxpSpawn(FBxpSpawnRequest&& Request);
+
 	/**
 	 * @brief Handles the loaded hard reference to a bxp.
-	 * will attempt to spawn the bxp and propagate to the player controller using OnBuildingExpansionSpawned.
+	 * Precaches the pipeline states of its materials, then spawns the bxp and propagates it to the player controller
+	 * using OnBuildingExpansionSpawned.
 	 * @param AssetPath Path to the asset to load.
-	 * @param BuildingExpansionType The type of building expansion to spawn.
-	 * @param BuildingExpansionOwner The owner of the building expansion.
-	 * @param ExpansionSlotIndex The index of the expansion slot to spawn the expansion in.
-	 * @param bIsUnpackedExpansion The expansion is an unpacked expansion or not.
+	 * @param Request The spawn request of the loaded class.
 	 * @note Makes no callback when the assset fails to spawn.
 	 */
-	void HandleAsyncBxpLoadComplete(
-		FSoftObjectPath AssetPath,
-		const EBuildingExpansionType BuildingExpansionType,
-		IBuildingExpansionOwner* BuildingExpansionOwner,
-		const int ExpansionSlotIndex,
-	const bool bIsUnpackedExpansion);
+	void HandleAsyncBxpLoadComplete(FSoftObjectPath AssetPath, FBxpSpawnRequest Request);
+
+	// Marks expansions that were spawned without collision until they are placed.
+	static const FName InertBxpTag;
+
+	/**
+	 * @brief Starts compiling the pipeline states of all materials of the class's meshes and spawns the expansion
+	 * once they are done or PSOPrecacheTimeoutSeconds passed; the construction preview covers the wait.
+	 * @param Request The spawn request of the loaded class.
+	 * @note Spawns directly if PSO precaching is disabled or the class was precached before.
+	 */
+	void PrecacheBxpPSOs(FBxpSpawnRequest&& Request);
+
+	/** @brief Spawns the expansions of which the precaching finished or timed out, re-arms itself while any wait. */
+	void CheckPendingPrecaches();
+
+	/**
+	 * @brief Spawns the expansion of the request deferred, with its blueprint components left unregistered, and
+	 * queues their registration. Spawns inert at the spawner as the placement is not known yet.
+	 * @note Makes no callback when the asset fails to spawn or the owner of the request was destroyed.
+	 */
+	void SpawnBxp(const FBxpSpawnRequest& Request);
+
+	/**
+	 * @brief Registers queued components within ComponentRegistrationBudgetMs and re-arms itself while any remain.
+	 * Expansions of which all components are registered are handed to OnBxpFullyRegistered.
+	 */
+	void RegisterPendingComponents();
+
+	/** @brief Notifies the player controller of an expansion that is fully ready. */
+	void OnBxpFullyRegistered(const FBxpSpawnRequest& Request, AActor* SpawnedActor);
+
+	/** @brief Releases the packed record of an unpack request that will not reach the player controller. */
+	void OnBxpSpawnFailed(const FBxpSpawnRequest& Request) const;
+
+	// Spawned expansions of which the components are being registered, in order of spawning.
+	TArray<FPendingBxpRegistration> M_PendingRegistrations;
+
+	// Spawn requests that wait for their pipeline states.
+	TArray<FPendingBxpPrecache> M_PendingPrecaches;
+
+	// Classes of which the pipeline states were already requested; requesting them again finds nothing new.
+	TSet<FSoftObjectPath> M_PrecachedClasses;
 
 	/** @brief Notifies the playercontroller that the building expansion was spawned. */
 	void OnBuildingExpansionSpawned(
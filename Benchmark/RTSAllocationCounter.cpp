@@ -0,0 +1,50 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "RTSAllocationCounter.h"
+
+FRTSAllocationCounter* FRTSAllocationCounter::GInstance = nullptr;
+
+void FRTSAllocationCounter::Install()
+{
+	check(IsInGameThread());
+	if (GInstance)
+	{
+		return;
+	}
+	// Allocated with the inner malloc on purpose; the proxy lives until the process exits.
+	GInstance = new FRTSAllocationCounter(GMalloc);
+	FPlatformMisc::MemoryBarrier();
+	GMalloc = GInstance;
+}
+
+void* FRTSAllocationCounter::Malloc(SIZE_T Count, uint32 Alignment)
+{
+	CountAllocation();
+	return M_InnerMalloc->Malloc(Count, Alignment);
+}
+
+void* FRTSAllocationCounter::TryMalloc(SIZE_T Count, uint32 Alignment)
+{
+	CountAllocation();
+	return M_InnerMalloc->TryMalloc(Count, Alignment);
+}
+
+void* FRTSAllocationCounter::Realloc(void* Original, SIZE_T Count, uint32 Alignment)
+{
+	// Shrinking to zero is a free.
+	if (Count != 0)
+	{
+		CountAllocation();
+	}
+	return M_InnerMalloc->Realloc(Original, Count, Alignment);
+}
+
+void* FRTSAllocationCounter::TryRealloc(void* Original, SIZE_T Count, uint32 Alignment)
+{
+	if (Count != 0)
+	{
+		CountAllocation();
+	}
+	return M_InnerMalloc->TryRealloc(Original, Count, Alignment);
+}
@@ -0,0 +1,72 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/MemoryBase.h"
+
+/**
+ * @brief Malloc proxy that counts the heap allocations made on the game thread.
+ * Installed over GMalloc on the first benchmark recording when -RTSBenchmarkAllocs is on the command line;
+ * it forwards every call and is never removed as memory allocated through it may still be freed later.
+ */
+class RTS_SURVIVAL_API FRTSAllocationCounter final : public FMalloc
+{
+public:
+	/** @brief Wraps GMalloc with the counter if that has not happened yet. */
+	static void Install();
+
+	/** @return Whether the counter is installed. */
+	static bool IsInstalled() { return GInstance != nullptr; }
+
+	/** @return The number of allocations and reallocations on the game thread since the counter was installed. */
+	static uint64 GetGameThreadAllocations() { return GInstance ? GInstance->M_GameThreadAllocations : 0; }
+
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override;
+	virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override;
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override;
+	virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override;
+	virtual void Free(void* Original) override { M_InnerMalloc->Free(Original); }
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override
+	{
+		return M_InnerMalloc->QuantizeSize(Count, Alignment);
+	}
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override
+	{
+		return M_InnerMalloc->GetAllocationSize(Original, SizeOut);
+	}
+	virtual void Trim(bool bTrimThreadCaches) override { M_InnerMalloc->Trim(bTrimThreadCaches); }
+	virtual void SetupTLSCachesOnCurrentThread() override { M_InnerMalloc->SetupTLSCachesOnCurrentThread(); }
+	virtual void ClearAndDisableTLSCachesOnCurrentThread() override
+	{
+		M_InnerMalloc->ClearAndDisableTLSCachesOnCurrentThread();
+	}
+	virtual void InitializeStatsMetadata() override { M_InnerMalloc->InitializeStatsMetadata(); }
+	virtual void UpdateStats() override { M_InnerMalloc->UpdateStats(); }
+	virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { M_InnerMalloc->GetAllocatorStats(OutStats); }
+	virtual void DumpAllocatorStats(FOutputDevice& Ar) override { M_InnerMalloc->DumpAllocatorStats(Ar); }
+	virtual bool IsInternallyThreadSafe() const override { return M_InnerMalloc->IsInternallyThreadSafe(); }
+	virtual bool ValidateHeap() override { return M_InnerMalloc->ValidateHeap(); }
+	virtual const TCHAR* GetDescriptiveName() override { return M_InnerMalloc->GetDescriptiveName(); }
+
+private:
+	explicit FRTSAllocationCounter(FMalloc* InnerMalloc)
+		: M_InnerMalloc(InnerMalloc)
+	{
+	}
+
+	inline void CountAllocation()
+	{
+		// Only the game thread writes the counter, other threads are not part of the measured hot paths.
+		if (IsInGameThread())
+		{
+			++M_GameThreadAllocations;
+		}
+	}
+
+	static FRTSAllocationCounter* GInstance;
+
+	FMalloc* M_InnerMalloc;
+
+	uint64 M_GameThreadAllocations = 0;
+};
@@ -0,0 +1,150 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "RTSBenchmark.h"
+
+#include "Dom/JsonObject.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+namespace RTSBenchmarkConsole
+{
+	static FAutoConsoleCommand StartCommand(
+		TEXT("RTS.Benchmark.Start"),
+		TEXT("Starts recording benchmark samples of the building systems. Optional argument: label."),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			FRTSBenchmark::Get().StartRecording(Args.IsEmpty() ? FString("Benchmark") : Args[0]);
+		}));
+
+	static FAutoConsoleCommand StopCommand(
+		TEXT("RTS.Benchmark.Stop"),
+		TEXT("Stops the benchmark recording and writes the results to Saved/Benchmarks."),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			FRTSBenchmark::Get().StopRecordingAndWriteJson();
+		}));
+}
+
+FRTSBenchmark& FRTSBenchmark::Get()
+{
+	static FRTSBenchmark Benchmark;
+	return Benchmark;
+}
+
+void FRTSBenchmark::StartRecording(const FString& Label)
+{
+	check(IsInGameThread());
+	M_Samples.Reset();
+	M_AllocationSamples.Reset();
+	M_Label = Label;
+	if (FParse::Param(FCommandLine::Get(), TEXT("RTSBenchmarkAllocs")))
+	{
+		FRTSAllocationCounter::Install();
+	}
+	bM_IsRecording = true;
+}
+
+void FRTSBenchmark::AddSample(const FName Metric, const double Milliseconds)
+{
+	if (!bM_IsRecording || !IsInGameThread())
+	{
+		return;
+	}
+	M_Samples.FindOrAdd(Metric).Add(Milliseconds);
+}
+
+void FRTSBenchmark::AddAllocationSample(const FName Metric, const uint64 NumAllocations)
+{
+	if (!bM_IsRecording || !IsInGameThread())
+	{
+		return;
+	}
+	M_AllocationSamples.FindOrAdd(Metric).Add(static_cast<double>(NumAllocations));
+}
+
+FString FRTSBenchmark::StopRecordingAndWriteJson()
+{
+	check(IsInGameThread());
+	if (!bM_IsRecording)
+	{
+		return FString();
+	}
+	bM_IsRecording = false;
+
+	FString Commit;
+	FParse::Value(FCommandLine::Get(), TEXT("RTSBenchmarkCommit="), Commit);
+
+	const TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+	Root->SetStringField(TEXT("label"), M_Label);
+	Root->SetStringField(TEXT("commit"), Commit);
+	Root->SetStringField(TEXT("timestamp"), FDateTime::UtcNow().ToIso8601());
+
+	const TSharedRef<FJsonObject> Metrics = MakeShared<FJsonObject>();
+	for (TPair<FName, TArray<double>>& Pair : M_Samples)
+	{
+		TArray<double>& Samples = Pair.Value;
+		if (Samples.IsEmpty())
+		{
+			continue;
+		}
+		Samples.Sort();
+		double Total = 0;
+		for (const double Sample : Samples)
+		{
+			Total += Sample;
+		}
+		const auto Percentile = [&Samples](const double Fraction)
+		{
+			return Samples[FMath::Clamp(FMath::FloorToInt(Fraction * Samples.Num()), 0, Samples.Num() - 1)];
+		};
+		const TSharedRef<FJsonObject> Metric = MakeShared<FJsonObject>();
+		Metric->SetNumberField(TEXT("count"), Samples.Num());
+		Metric->SetNumberField(TEXT("mean_ms"), Total / Samples.Num());
+		Metric->SetNumberField(TEXT("min_ms"), Samples[0]);
+		Metric->SetNumberField(TEXT("max_ms"), Samples.Last());
+		Metric->SetNumberField(TEXT("p50_ms"), Percentile(0.5));
+		Metric->SetNumberField(TEXT("p95_ms"), Percentile(0.95));
+		Metric->SetNumberField(TEXT("p99_ms"), Percentile(0.99));
+		if (TArray<double>* AllocationSamples = M_AllocationSamples.Find(Pair.Key))
+		{
+			double TotalAllocations = 0;
+			double MaxAllocations = 0;
+			for (const double Allocations : *AllocationSamples)
+			{
+				TotalAllocations += Allocations;
+				MaxAllocations = FMath::Max(MaxAllocations, Allocations);
+			}
+			// Steady state hot paths should report zero; the first samples may allocate caches.
+			AllocationSamples->Sort();
+			Metric->SetNumberField(TEXT("allocations_mean"), TotalAllocations / AllocationSamples->Num());
+			Metric->SetNumberField(TEXT("allocations_p50"), (*AllocationSamples)[AllocationSamples->Num() / 2]);
+			Metric->SetNumberField(TEXT("allocations_max"), MaxAllocations);
+		}
+		Metrics->SetObjectField(Pair.Key.ToString(), Metric);
+	}
+	Root->SetObjectField(TEXT("metrics"), Metrics);
+	M_Samples.Reset();
+	M_AllocationSamples.Reset();
+
+	FString Json;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Root, Writer);
+
+	const FString FilePath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / (M_Label + TEXT(".json"));
+	if (!FFileHelper::SaveStringToFile(Json, *FilePath))
+	{
+		RTSFunctionLibrary::ReportError(
+			"Failed to write benchmark results!"
+			"\n At function StopRecordingAndWriteJson in RTSBenchmark.cpp"
+			"\n Path: " + FilePath);
+		return FString();
+	}
+	UE_LOG(LogTemp, Display, TEXT("RTS benchmark written to %s"), *FilePath);
+	return FilePath;
+}
@@ -0,0 +1,96 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RTSAllocationCounter.h"
+
+/**
+ * @brief Collects timing samples of the building systems and writes them to a json file.
+ * Samples are only stored while a recording is active, outside of a recording a sample costs one branch.
+ * Start and stop a recording with the console commands RTS.Benchmark.Start [Label] and RTS.Benchmark.Stop
+ * or use ARTSBenchmarkRunner for a fully automated, headless (-nullrhi) run.
+ * @note Output is written to Saved/Benchmarks/<Label>.json; pass -RTSBenchmarkCommit=<sha> to tag the results.
+ * With -RTSBenchmarkAllocs each scoped sample also records the number of game thread heap allocations in its scope.
+ */
+class RTS_SURVIVAL_API FRTSBenchmark
+{
+public:
+	static FRTSBenchmark& Get();
+
+	inline bool IsRecording() const { return bM_IsRecording; }
+
+	/**
+	 * @brief Starts a new recording, samples of a previous recording that was not written are discarded.
+	 * @param Label Name of the recording, used as file name.
+	 */
+	void StartRecording(const FString& Label);
+
+	/**
+	 * @brief Stops the recording and writes the statistics of every metric to the json file.
+	 * @return The path of the written file, empty if there was no active recording or writing failed.
+	 */
+	FString StopRecordingAndWriteJson();
+
+	/**
+	 * @brief Adds a sample to the metric if a recording is active.
+	 * @param Metric The name of the measured metric, e.g. "ConstructionPreview.Tick".
+	 * @param Milliseconds The measured duration.
+	 */
+	void AddSample(const FName Metric, const double Milliseconds);
+
+	/**
+	 * @brief Adds the number of heap allocations made during one sample of the metric.
+	 * @param Metric The name of the measured metric.
+	 * @param NumAllocations The allocations counted by FRTSAllocationCounter.
+	 */
+	void AddAllocationSample(const FName Metric, const uint64 NumAllocations);
+
+	/** Measures the duration of its scope and adds it as sample to the metric. */
+	struct FScopedSample
+	{
+		explicit FScopedSample(const FName InMetric)
+			: Metric(InMetric),
+			  StartAllocations(FRTSAllocationCounter::GetGameThreadAllocations()),
+			  StartCycles(FRTSBenchmark::Get().IsRecording() ? FPlatformTime::Cycles64() : 0)
+		{
+		}
+
+		~FScopedSample()
+		{
+			if (StartCycles != 0)
+			{
+				const uint64 EndCycles = FPlatformTime::Cycles64();
+				// Read before adding the samples as storing them may allocate.
+				const uint64 NumAllocations = FRTSAllocationCounter::GetGameThreadAllocations() - StartAllocations;
+				FRTSBenchmark& Benchmark = FRTSBenchmark::Get();
+				Benchmark.AddSample(Metric, FPlatformTime::ToMilliseconds64(EndCycles - StartCycles));
+				if (FRTSAllocationCounter::IsInstalled())
+				{
+					Benchmark.AddAllocationSample(Metric, NumAllocations);
+				}
+			}
+		}
+
+		FName Metric;
+		uint64 StartAllocations;
+		uint64 StartCycles;
+	};
+
+private:
+	FRTSBenchmark() = default;
+
+	bool bM_IsRecording = false;
+
+	FString M_Label;
+
+	// Samples in milliseconds per metric; only accessed on the game thread.
+	TMap<FName, TArray<double>> M_Samples;
+
+	// Heap allocations per sample per metric; only accessed on the game thread.
+	TMap<FName, TArray<double>> M_AllocationSamples;
+};
+
+#define RTS_BENCHMARK_SCOPE(MetricName) \
+	static const FName PREPROCESSOR_JOIN(RTSBenchmarkMetric_, __LINE__)(MetricName); \
+	const FRTSBenchmark::FScopedSample PREPROCESSOR_JOIN(RTSBenchmarkScope_, __LINE__)(PREPROCESSOR_JOIN(RTSBenchmarkMetric_, __LINE__))
@@ -0,0 +1,347 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "RTSBenchmarkRunner.h"
+
+#include "Blueprint/UserWidget.h"
+#include "Engine/StaticMeshActor.h"
+#include "Misc/CommandLine.h"
+#include "RTSBenchmark.h"
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/RTSCollisionTraceChannels.h"
+#include "RTS_Survival/Player/CPPController.h"
+#include "RTS_Survival/Player/AsyncRTSAssetsSpawner/RTSAsyncSpawner.h"
+#include "RTS_Survival/Player/ConstructionPreview/CPPConstructionPreview.h"
+#include "RTS_Survival/RTSComponents/TimeProgressBarWidget.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+
+ARTSBenchmarkRunner::ARTSBenchmarkRunner()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
+	M_ProgressBarAnchor = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("ProgressBarAnchor"));
+	M_ProgressBarAnchor->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	RootComponent = M_ProgressBarAnchor;
+}
+
+void ARTSBenchmarkRunner::BeginPlay()
+{
+	Super::BeginPlay();
+	if (!bRunWithoutCommandLine && !FParse::Param(FCommandLine::Get(), TEXT("RTSBenchmark")))
+	{
+		return;
+	}
+	// Fixed seed so every commit measures the same building layouts and cursor positions.
+	M_RandomStream.Initialize(1337);
+	if (LoadReplay())
+	{
+		FRTSBenchmark::Get().StartRecording("Replay_" + GetWorld()->GetMapName());
+		// Records the completion order of the replay to compare it with the recording.
+		FBuildingReplayRecorder::Get().StartRecording();
+		SetActorTickEnabled(true);
+		M_ReplayStartSeconds = GetWorld()->GetTimeSeconds();
+		StartPhase(ERTSBenchmarkPhase::BP_Replay);
+		return;
+	}
+	FRTSBenchmark::Get().StartRecording(GetWorld()->GetMapName());
+	SetActorTickEnabled(true);
+	StartPhase(ERTSBenchmarkPhase::BP_Placement);
+}
+
+void ARTSBenchmarkRunner::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	switch (M_Phase)
+	{
+	case ERTSBenchmarkPhase::BP_Placement:
+		TickPlacement();
+		break;
+	case ERTSBenchmarkPhase::BP_SpawnerCold:
+	case ERTSBenchmarkPhase::BP_SpawnerWarm:
+		M_PhaseSeconds += DeltaTime;
+		if (M_PhaseSeconds >= SpawnerPhaseSeconds)
+		{
+			StartPhase(M_Phase == ERTSBenchmarkPhase::BP_SpawnerCold
+				           ? ERTSBenchmarkPhase::BP_SpawnerWarm
+				           : ERTSBenchmarkPhase::BP_ProgressBars);
+		}
+		break;
+	case ERTSBenchmarkPhase::BP_Replay:
+		TickReplay(DeltaTime);
+		break;
+	case ERTSBenchmarkPhase::BP_ProgressBars:
+		M_PhaseSeconds += DeltaTime;
+		FRTSBenchmark::Get().AddSample("Frame.ProgressBars", DeltaTime * 1000.0);
+		if (M_PhaseSeconds >= ProgressBarSeconds + 1.f)
+		{
+			StopProgressBars();
+			StartPhase(ERTSBenchmarkPhase::BP_Done);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void ARTSBenchmarkRunner::StartPhase(const ERTSBenchmarkPhase NewPhase)
+{
+	M_Phase = NewPhase;
+	M_PhaseSeconds = 0.f;
+	M_PlacementFrames = 0;
+	switch (NewPhase)
+	{
+	case ERTSBenchmarkPhase::BP_Placement:
+		if (!ConstructionPreview || !PreviewMeshToPlace || BuildingDensities.IsEmpty())
+		{
+			StartPhase(ERTSBenchmarkPhase::BP_SpawnerCold);
+			return;
+		}
+		M_DensityIndex = 0;
+		SpawnBuildingsForDensity();
+		ConstructionPreview->StartBuildingPreview(PreviewMeshToPlace);
+		break;
+	case ERTSBenchmarkPhase::BP_SpawnerCold:
+	case ERTSBenchmarkPhase::BP_SpawnerWarm:
+		RequestAllExpansionTypes();
+		break;
+	case ERTSBenchmarkPhase::BP_ProgressBars:
+		StartProgressBars();
+		break;
+	case ERTSBenchmarkPhase::BP_Done:
+		FinishBenchmark();
+		break;
+	default:
+		break;
+	}
+}
+
+void ARTSBenchmarkRunner::TickPlacement()
+{
+	FVector CursorLocation;
+	const bool bIsValidCursorLocation = GetRandomTerrainLocation(CursorLocation);
+	{
+		// Without the stats widget, its text formatting is not part of the placement.
+		const FRTSBenchmark::FScopedSample Sample(M_PlacementMetric);
+		ConstructionPreview->ValidatePreviewAtLocation(CursorLocation, bIsValidCursorLocation);
+	}
+
+	if (++M_PlacementFrames < PlacementFramesPerDensity)
+	{
+		return;
+	}
+	M_PlacementFrames = 0;
+	DestroySpawnedBuildings();
+	if (++M_DensityIndex < BuildingDensities.Num())
+	{
+		SpawnBuildingsForDensity();
+		return;
+	}
+	ConstructionPreview->StopBuildingPreview();
+	StartPhase(ERTSBenchmarkPhase::BP_SpawnerCold);
+}
+
+void ARTSBenchmarkRunner::SpawnBuildingsForDensity()
+{
+	const int32 Density = BuildingDensities[M_DensityIndex];
+	M_PlacementMetric = FName(FString::Printf(TEXT("ConstructionPreview.Tick.Density_%d"), Density));
+	if (!BuildingMesh)
+	{
+		return;
+	}
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	for (int32 i = 0; i < Density; ++i)
+	{
+		FVector Location;
+		if (!GetRandomTerrainLocation(Location))
+		{
+			continue;
+		}
+		const FRotator Rotation(0.f, M_RandomStream.FRandRange(0.f, 360.f), 0.f);
+		AStaticMeshActor* Building = GetWorld()->SpawnActor<AStaticMeshActor>(Location, Rotation, SpawnParams);
+		if (!Building)
+		{
+			RTSFunctionLibrary::ReportError(
+				"Failed to spawn a benchmark building!"
+				"\n At function SpawnBuildingsForDensity in RTSBenchmarkRunner.cpp");
+			return;
+		}
+		Building->SetMobility(EComponentMobility::Movable);
+		UStaticMeshComponent* MeshComponent = Building->GetStaticMeshComponent();
+		MeshComponent->SetStaticMesh(BuildingMesh);
+		MeshComponent->SetCollisionObjectType(COLLISION_OBJ_BUILDING_PLACEMENT);
+		MeshComponent->SetGenerateOverlapEvents(true);
+		M_SpawnedBuildings.Add(Building);
+	}
+}
+
+void ARTSBenchmarkRunner::DestroySpawnedBuildings()
+{
+	for (AActor* Building : M_SpawnedBuildings)
+	{
+		if (IsValid(Building))
+		{
+			Building->Destroy();
+		}
+	}
+	M_SpawnedBuildings.Reset();
+}
+
+bool ARTSBenchmarkRunner::GetRandomTerrainLocation(FVector& OutLocation)
+{
+	const FVector Offset(M_RandomStream.FRandRange(-AreaHalfSize, AreaHalfSize),
+	                     M_RandomStream.FRandRange(-AreaHalfSize, AreaHalfSize), 0.f);
+	const FVector Start = GetActorLocation() + Offset + FVector(0.f, 0.f, 50000.f);
+	const FVector End = GetActorLocation() + Offset - FVector(0.f, 0.f, 50000.f);
+	FHitResult Hit;
+	if (GetWorld()->LineTraceSingleByChannel(Hit, Start, End, ECC_Visibility))
+	{
+		OutLocation = Hit.Location;
+		return true;
+	}
+	OutLocation = GetActorLocation() + Offset;
+	return false;
+}
+
+void ARTSBenchmarkRunner::RequestAllExpansionTypes() const
+{
+	if (!AsyncSpawner)
+	{
+		return;
+	}
+	for (const EBuildingExpansionType ExpansionType : ExpansionTypes)
+	{
+		// Only measures the request to spawn latency; the spawner destroys the bxp.
+		AsyncSpawner->AsyncSpawnBenchmarkExpansion(ExpansionType);
+	}
+}
+
+void ARTSBenchmarkRunner::StartProgressBars()
+{
+	if (!ProgressBarClass)
+	{
+		return;
+	}
+	for (int32 i = 0; i < NumProgressBars; ++i)
+	{
+		UTimeProgressBarWidget* ProgressBar = CreateWidget<UTimeProgressBarWidget>(GetWorld(), ProgressBarClass);
+		if (!ProgressBar)
+		{
+			RTSFunctionLibrary::ReportError(
+				"Failed to create progress bar widget!"
+				"\n At function StartProgressBars in RTSBenchmarkRunner.cpp");
+			return;
+		}
+		ProgressBar->InitTimeProgressComponent(M_ProgressBarAnchor, M_ProgressBarAnchor);
+		ProgressBar->OnProgressCompleted.AddUObject(this, &ARTSBenchmarkRunner::OnProgressBarCompleted);
+		ProgressBar->StartProgressBar(ProgressBarSeconds);
+		M_ProgressBars.Add(ProgressBar);
+	}
+}
+
+void ARTSBenchmarkRunner::OnProgressBarCompleted(UTimeProgressBarWidget* ProgressBar) const
+{
+	static const FName CompletionDelayMetric("ProgressBar.CompletionDelayMs");
+	const double DelaySeconds = GetWorld()->GetTimeSeconds() - ProgressBar->GetTimedProgress().GetEndTime();
+	FRTSBenchmark::Get().AddSample(CompletionDelayMetric, DelaySeconds * 1000.0);
+}
+
+void ARTSBenchmarkRunner::StopProgressBars()
+{
+	for (UTimeProgressBarWidget* ProgressBar : M_ProgressBars)
+	{
+		if (IsValid(ProgressBar))
+		{
+			ProgressBar->OnProgressCompleted.RemoveAll(this);
+			ProgressBar->StopProgressBar();
+		}
+	}
+	M_ProgressBars.Reset();
+}
+
+bool ARTSBenchmarkRunner::LoadReplay()
+{
+	FString ReplayPath;
+	if (!FParse::Value(FCommandLine::Get(), TEXT("RTSReplay="), ReplayPath))
+	{
+		return false;
+	}
+	return FBuildingReplayRecorder::LoadFromJson(ReplayPath, M_ReplayEvents);
+}
+
+void ARTSBenchmarkRunner::TickReplay(const float DeltaTime)
+{
+	FRTSBenchmark::Get().AddSample("Frame.Replay", DeltaTime * 1000.0);
+	const double ReplaySeconds = GetWorld()->GetTimeSeconds() - M_ReplayStartSeconds;
+	ACPPController* PlayerController = Cast<ACPPController>(GetWorld()->GetFirstPlayerController());
+	while (PlayerController && M_ReplayEvents.IsValidIndex(M_NextReplayEvent)
+		&& M_ReplayEvents[M_NextReplayEvent].Time <= ReplaySeconds)
+	{
+		const FBuildingReplayEvent& Event = M_ReplayEvents[M_NextReplayEvent++];
+		if (Event.Type == EBuildingReplayEvent::BRE_BxpSpawned)
+		{
+			continue;
+		}
+		const FRTSBenchmark::FScopedSample Sample(FName("Replay." + BuildingReplayEventToString(Event.Type)));
+		PlayerController->ReplayBuildingInput(Event);
+	}
+	const double EndTime = M_ReplayEvents.IsEmpty() ? 0.0 : M_ReplayEvents.Last().Time;
+	if (M_NextReplayEvent >= M_ReplayEvents.Num() && ReplaySeconds >= EndTime + ReplayTailSeconds)
+	{
+		CompareReplayCompletionOrder();
+		FBuildingReplayRecorder::Get().StopRecording();
+		StartPhase(ERTSBenchmarkPhase::BP_Done);
+	}
+}
+
+void ARTSBenchmarkRunner::CompareReplayCompletionOrder() const
+{
+	const auto GetCompletions = [](const TArray<FBuildingReplayEvent>& Events, TArray<FBuildingReplayEvent>& Out)
+	{
+		for (const FBuildingReplayEvent& Event : Events)
+		{
+			if (Event.Type == EBuildingReplayEvent::BRE_BxpSpawned)
+			{
+				Out.Add(Event);
+			}
+		}
+	};
+	TArray<FBuildingReplayEvent> ReplayedEvents;
+	FBuildingReplayRecorder::Get().GetEvents(ReplayedEvents);
+	TArray<FBuildingReplayEvent> Recorded, Replayed;
+	GetCompletions(M_ReplayEvents, Recorded);
+	GetCompletions(ReplayedEvents, Replayed);
+
+	int32 NumMismatches = FMath::Abs(Recorded.Num() - Replayed.Num());
+	for (int32 i = 0; i < FMath::Min(Recorded.Num(), Replayed.Num()); ++i)
+	{
+		// Ids are assigned per recording; the owner is compared by its class.
+		if (Recorded[i].ActorClass != Replayed[i].ActorClass
+			|| Recorded[i].ExpansionSlotIndex != Replayed[i].ExpansionSlotIndex)
+		{
+			++NumMismatches;
+		}
+	}
+	FRTSBenchmark::Get().AddSample("Replay.CompletionOrderMismatches", NumMismatches);
+	if (NumMismatches > 0)
+	{
+		if constexpr (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+		{
+			RTSFunctionLibrary::PrintString(
+				"Building replay: " + FString::FromInt(NumMismatches) +
+				" bxp spawns completed in a different order than recorded.", FColor::Orange);
+		}
+	}
+}
+
+void ARTSBenchmarkRunner::FinishBenchmark()
+{
+	SetActorTickEnabled(false);
+	FRTSBenchmark::Get().StopRecordingAndWriteJson();
+	if (FParse::Param(FCommandLine::Get(), TEXT("RTSBenchmarkExit")))
+	{
+		FPlatformMisc::RequestExit(false);
+	}
+}
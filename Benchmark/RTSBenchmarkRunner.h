@@ -0,0 +1,165 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "RTSBuildingReplay.h"
+
+#include "RTSBenchmarkRunner.generated.h"
+
+class ACPPConstructionPreview;
+class ARTSAsyncSpawner;
+class UTimeProgressBarWidget;
+enum class EBuildingExpansionType : uint8;
+
+UENUM()
+enum class ERTSBenchmarkPhase : uint8
+{
+	BP_None,
+	// Drives the construction preview over the terrain with increasing building densities.
+	BP_Placement,
+	// Requests every expansion type once while none of the classes are loaded.
+	BP_SpawnerCold,
+	// Requests every expansion type again, now with loaded classes.
+	BP_SpawnerWarm,
+	// Runs NumProgressBars progress bars at the same time.
+	BP_ProgressBars,
+	// Re-drives the inputs of a recorded building replay; replaces the other phases.
+	BP_Replay,
+	BP_Done
+};
+
+/**
+ * @brief Place in a benchmark map to measure the building systems without player input.
+ * Runs the placement, async spawner and progress bar phases after each other and writes the results
+ * with FRTSBenchmark to Saved/Benchmarks/<MapName>.json. Each benchmark map provides its own terrain.
+ * @note Runs headless: -nullrhi -RTSBenchmark [-RTSBenchmarkExit] [-RTSBenchmarkCommit=<sha>].
+ * Without -RTSBenchmark on the command line the runner does nothing unless bRunWithoutCommandLine is set.
+ * With -RTSReplay=<file> the runner instead replays a recording of FBuildingReplayRecorder in real time and
+ * measures the frame time and the duration of every replayed input.
+ */
+UCLASS()
+class RTS_SURVIVAL_API ARTSBenchmarkRunner : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	ARTSBenchmarkRunner();
+
+	virtual void Tick(float DeltaTime) override;
+
+protected:
+	virtual void BeginPlay() override;
+
+	UPROPERTY(EditAnywhere, Category="Benchmark")
+	bool bRunWithoutCommandLine = false;
+
+	// Initialized construction preview in the benchmark map.
+	UPROPERTY(EditAnywhere, Category="Benchmark|Placement")
+	TObjectPtr<ACPPConstructionPreview> ConstructionPreview;
+
+	UPROPERTY(EditAnywhere, Category="Benchmark|Placement")
+	TObjectPtr<UStaticMesh> PreviewMeshToPlace;
+
+	// Mesh of the buildings that are scattered over the terrain, needs building placement collision.
+	UPROPERTY(EditAnywhere, Category="Benchmark|Placement")
+	TObjectPtr<UStaticMesh> BuildingMesh;
+
+	// Number of buildings scattered over the terrain; each density is measured separately.
+	UPROPERTY(EditAnywhere, Category="Benchmark|Placement")
+	TArray<int32> BuildingDensities = {0, 50, 250};
+
+	// Half the size of the square around the runner in which buildings and cursor positions are sampled.
+	UPROPERTY(EditAnywhere, Category="Benchmark|Placement")
+	float AreaHalfSize = 10000.f;
+
+	UPROPERTY(EditAnywhere, Category="Benchmark|Placement")
+	int32 PlacementFramesPerDensity = 300;
+
+	UPROPERTY(EditAnywhere, Category="Benchmark|Spawner")
+	TObjectPtr<ARTSAsyncSpawner> AsyncSpawner;
+
+	UPROPERTY(EditAnywhere, Category="Benchmark|Spawner")
+	TArray<EBuildingExpansionType> ExpansionTypes;
+
+	// How long to wait for the async loads of one spawner phase.
+	UPROPERTY(EditAnywhere, Category="Benchmark|Spawner")
+	float SpawnerPhaseSeconds = 10.f;
+
+	UPROPERTY(EditAnywhere, Category="Benchmark|ProgressBars")
+	TSubclassOf<UTimeProgressBarWidget> ProgressBarClass;
+
+	UPROPERTY(EditAnywhere, Category="Benchmark|ProgressBars")
+	int32 NumProgressBars = 2000;
+
+	UPROPERTY(EditAnywhere, Category="Benchmark|ProgressBars")
+	float ProgressBarSeconds = 10.f;
+
+	// Time to keep measuring after the last replayed input so its async work completes.
+	UPROPERTY(EditAnywhere, Category="Benchmark|Replay")
+	float ReplayTailSeconds = 5.f;
+
+private:
+	// Used as camera sphere and bar mesh of the benchmarked progress bars.
+	UPROPERTY()
+	TObjectPtr<UStaticMeshComponent> M_ProgressBarAnchor;
+
+	UPROPERTY()
+	TArray<TObjectPtr<UTimeProgressBarWidget>> M_ProgressBars;
+
+	UPROPERTY()
+	TArray<TObjectPtr<AActor>> M_SpawnedBuildings;
+
+	ERTSBenchmarkPhase M_Phase = ERTSBenchmarkPhase::BP_None;
+
+	// Seconds spent in the current phase.
+	float M_PhaseSeconds = 0.f;
+
+	// Frames spent on the current building density of the placement phase.
+	int32 M_PlacementFrames = 0;
+
+	int32 M_DensityIndex = 0;
+
+	FName M_PlacementMetric;
+
+	FRandomStream M_RandomStream;
+
+	TArray<FBuildingReplayEvent> M_ReplayEvents;
+
+	int32 M_NextReplayEvent = 0;
+
+	// World time at which the replay started; recorded inputs are timed with the world time as well.
+	double M_ReplayStartSeconds = 0.0;
+
+	/** @return Whether a replay file was provided and could be read. */
+	bool LoadReplay();
+
+	void TickReplay(const float DeltaTime);
+
+	/** @brief Adds the number of bxp spawns that completed in a different order than recorded as sample. */
+	void CompareReplayCompletionOrder() const;
+
+	void StartPhase(const ERTSBenchmarkPhase NewPhase);
+
+	void TickPlacement();
+
+	/** @brief Scatters the buildings of the current density over the terrain. */
+	void SpawnBuildingsForDensity();
+
+	void DestroySpawnedBuildings();
+
+	/** @return Whether the terrain was hit at the random location. */
+	bool GetRandomTerrainLocation(FVector& OutLocation);
+
+	void RequestAllExpansionTypes() const;
+
+	void StartProgressBars();
+
+	/** @brief Adds how late the bar completed compared to its end time as sample. */
+	void OnProgressBarCompleted(UTimeProgressBarWidget* ProgressBar) const;
+
+	void StopProgressBars();
+
+	void FinishBenchmark();
+};
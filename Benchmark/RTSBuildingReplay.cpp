@@ -0,0 +1,244 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "RTSBuildingReplay.h"
+
+#include "Dom/JsonObject.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+namespace RTSBuildingReplayConsole
+{
+	static FAutoConsoleCommand StartCommand(
+		TEXT("RTS.Replay.Start"),
+		TEXT("Starts recording the inputs of the building pipeline into the replay ring buffer."),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			FBuildingReplayRecorder::Get().StartRecording();
+		}));
+
+	static FAutoConsoleCommand SaveCommand(
+		TEXT("RTS.Replay.Save"),
+		TEXT("Writes the replay ring buffer to Saved/Replays. Optional argument: label."),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			FBuildingReplayRecorder::Get().SaveToJson(Args.IsEmpty() ? FString("Replay") : Args[0]);
+		}));
+}
+
+FBuildingReplayRecorder& FBuildingReplayRecorder::Get()
+{
+	static FBuildingReplayRecorder Recorder;
+	static bool bCheckedCommandLine = false;
+	if (!bCheckedCommandLine)
+	{
+		bCheckedCommandLine = true;
+		if (FParse::Param(FCommandLine::Get(), TEXT("RTSReplayRecord")))
+		{
+			Recorder.StartRecording();
+		}
+	}
+	return Recorder;
+}
+
+void FBuildingReplayRecorder::StartRecording()
+{
+	check(IsInGameThread());
+	M_Events.SetNum(Capacity);
+	M_Head = 0;
+	M_NumEvents = 0;
+	M_RecordedActors.Reset();
+	M_World.Reset();
+	bM_IsRecording = true;
+}
+
+void FBuildingReplayRecorder::RecordActorInput(const EBuildingReplayEvent Type, const AActor* Actor,
+                                               const bool bFlag)
+{
+	if (!bM_IsRecording || !Actor)
+	{
+		return;
+	}
+	FBuildingReplayEvent Event;
+	Event.Type = Type;
+	SetEventActor(Event, Actor);
+	Event.bFlag = bFlag;
+	Record(Actor->GetWorld(), Event);
+}
+
+void FBuildingReplayRecorder::RecordExpansionInput(
+	const EBuildingReplayEvent Type,
+	const AActor* Owner,
+	const uint8 ExpansionType,
+	const int32 ExpansionSlotIndex,
+	const bool bFlag)
+{
+	if (!bM_IsRecording || !Owner)
+	{
+		return;
+	}
+	FBuildingReplayEvent Event;
+	Event.Type = Type;
+	SetEventActor(Event, Owner);
+	Event.ExpansionType = ExpansionType;
+	Event.ExpansionSlotIndex = ExpansionSlotIndex;
+	Event.bFlag = bFlag;
+	Record(Owner->GetWorld(), Event);
+}
+
+void FBuildingReplayRecorder::RecordPlacement(const UWorld* World, const FVector& Location, const float Yaw,
+                                              const EBuildingReplayEvent Type)
+{
+	if (!bM_IsRecording)
+	{
+		return;
+	}
+	FBuildingReplayEvent Event;
+	Event.Type = Type;
+	Event.Location = Location;
+	Event.Yaw = Yaw;
+	Record(World, Event);
+}
+
+void FBuildingReplayRecorder::Record(const UWorld* World, FBuildingReplayEvent& Event)
+{
+	if (!World || !IsInGameThread())
+	{
+		return;
+	}
+	if (M_World != World)
+	{
+		// World times of different worlds cannot be compared; a replay runs in one map.
+		if (M_World.IsValid() && M_NumEvents > 0)
+		{
+			StartRecording();
+		}
+		M_World = World;
+	}
+	Event.Time = World->GetTimeSeconds();
+	FBuildingReplayEvent& Slot = M_Events[M_Head];
+	Slot = Event;
+	M_Head = (M_Head + 1) % Capacity;
+	M_NumEvents = FMath::Min(M_NumEvents + 1, Capacity);
+}
+
+void FBuildingReplayRecorder::SetEventActor(FBuildingReplayEvent& Event, const AActor* Actor)
+{
+	if (!Actor || !IsInGameThread())
+	{
+		return;
+	}
+	FRecordedActor* RecordedActor = M_RecordedActors.Find(Actor);
+	if (!RecordedActor)
+	{
+		RecordedActor = &M_RecordedActors.Add(
+			Actor, {static_cast<uint32>(M_RecordedActors.Num() + 1), FName(Actor->GetClass()->GetPathName())});
+	}
+	Event.ActorId = RecordedActor->Id;
+	Event.ActorClass = RecordedActor->Class;
+	Event.ActorLocation = Actor->GetActorLocation();
+}
+
+void FBuildingReplayRecorder::GetEvents(TArray<FBuildingReplayEvent>& OutEvents) const
+{
+	OutEvents.Reset(M_NumEvents);
+	const int32 Oldest = (M_Head - M_NumEvents + Capacity) % Capacity;
+	for (int32 i = 0; i < M_NumEvents; ++i)
+	{
+		OutEvents.Add(M_Events[(Oldest + i) % Capacity]);
+	}
+}
+
+FString FBuildingReplayRecorder::SaveToJson(const FString& Label) const
+{
+	TArray<FBuildingReplayEvent> Events;
+	GetEvents(Events);
+	// Replays start at the first kept event, older events were overwritten.
+	const double FirstTime = Events.IsEmpty() ? 0.0 : Events[0].Time;
+
+	TArray<TSharedPtr<FJsonValue>> JsonEvents;
+	for (const FBuildingReplayEvent& Event : Events)
+	{
+		const TSharedRef<FJsonObject> JsonEvent = MakeShared<FJsonObject>();
+		JsonEvent->SetNumberField(TEXT("time"), Event.Time - FirstTime);
+		JsonEvent->SetStringField(TEXT("type"), BuildingReplayEventToString(Event.Type));
+		JsonEvent->SetNumberField(TEXT("type_id"), static_cast<int32>(Event.Type));
+		JsonEvent->SetNumberField(TEXT("actor_id"), Event.ActorId);
+		JsonEvent->SetStringField(TEXT("actor_class"), Event.ActorClass.ToString());
+		JsonEvent->SetNumberField(TEXT("actor_x"), Event.ActorLocation.X);
+		JsonEvent->SetNumberField(TEXT("actor_y"), Event.ActorLocation.Y);
+		JsonEvent->SetNumberField(TEXT("actor_z"), Event.ActorLocation.Z);
+		JsonEvent->SetNumberField(TEXT("x"), Event.Location.X);
+		JsonEvent->SetNumberField(TEXT("y"), Event.Location.Y);
+		JsonEvent->SetNumberField(TEXT("z"), Event.Location.Z);
+		JsonEvent->SetNumberField(TEXT("yaw"), Event.Yaw);
+		JsonEvent->SetNumberField(TEXT("expansion_type"), Event.ExpansionType);
+		JsonEvent->SetNumberField(TEXT("slot"), Event.ExpansionSlotIndex);
+		JsonEvent->SetBoolField(TEXT("flag"), Event.bFlag);
+		JsonEvents.Add(MakeShared<FJsonValueObject>(JsonEvent));
+	}
+	const TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+	Root->SetArrayField(TEXT("events"), JsonEvents);
+
+	FString Json;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	FJsonSerializer::Serialize(Root, Writer);
+
+	const FString FilePath = FPaths::ProjectSavedDir() / TEXT("Replays") / (Label + TEXT(".json"));
+	if (!FFileHelper::SaveStringToFile(Json, *FilePath))
+	{
+		RTSFunctionLibrary::ReportError(
+			"Failed to write building replay!"
+			"\n At function SaveToJson in RTSBuildingReplay.cpp"
+			"\n Path: " + FilePath);
+		return FString();
+	}
+	if constexpr (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+	{
+		RTSFunctionLibrary::PrintString("Building replay written to " + FilePath);
+	}
+	return FilePath;
+}
+
+bool FBuildingReplayRecorder::LoadFromJson(const FString& FilePath, TArray<FBuildingReplayEvent>& OutEvents)
+{
+	FString Json;
+	TSharedPtr<FJsonObject> Root;
+	if (!FFileHelper::LoadFileToString(Json, *FilePath)
+		|| !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(Json), Root) || !Root.IsValid())
+	{
+		RTSFunctionLibrary::ReportError(
+			"Failed to read building replay!"
+			"\n At function LoadFromJson in RTSBuildingReplay.cpp"
+			"\n Path: " + FilePath);
+		return false;
+	}
+	OutEvents.Reset();
+	for (const TSharedPtr<FJsonValue>& JsonValue : Root->GetArrayField(TEXT("events")))
+	{
+		const TSharedPtr<FJsonObject>& JsonEvent = JsonValue->AsObject();
+		FBuildingReplayEvent& Event = OutEvents.AddDefaulted_GetRef();
+		Event.Time = JsonEvent->GetNumberField(TEXT("time"));
+		Event.Type = static_cast<EBuildingReplayEvent>(JsonEvent->GetIntegerField(TEXT("type_id")));
+		Event.ActorId = static_cast<uint32>(JsonEvent->GetNumberField(TEXT("actor_id")));
+		Event.ActorClass = FName(JsonEvent->GetStringField(TEXT("actor_class")));
+		Event.ActorLocation = FVector(JsonEvent->GetNumberField(TEXT("actor_x")),
+		                              JsonEvent->GetNumberField(TEXT("actor_y")),
+		                              JsonEvent->GetNumberField(TEXT("actor_z")));
+		Event.Location = FVector(JsonEvent->GetNumberField(TEXT("x")), JsonEvent->GetNumberField(TEXT("y")),
+		                         JsonEvent->GetNumberField(TEXT("z")));
+		Event.Yaw = JsonEvent->GetNumberField(TEXT("yaw"));
+		Event.ExpansionType = static_cast<uint8>(JsonEvent->GetIntegerField(TEXT("expansion_type")));
+		Event.ExpansionSlotIndex = JsonEvent->GetIntegerField(TEXT("slot"));
+		Event.bFlag = JsonEvent->GetBoolField(TEXT("flag"));
+	}
+	return true;
+}
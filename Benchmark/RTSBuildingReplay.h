@@ -0,0 +1,174 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+enum class EBuildingReplayEvent : uint8
+{
+	// Inputs of ACPPController.
+	BRE_ConstructBuilding,
+	BRE_CancelBuilding,
+	BRE_ConvertBackToVehicle,
+	BRE_CancelVehicleConversion,
+	BRE_ExpandBuilding,
+	BRE_PlaceBuilding,
+	// Placement click that deploys all selected nomadic trucks in a formation.
+	BRE_PlaceFormation,
+	BRE_StopBxpPlacement,
+	// Completion of an async bxp spawn of ARTSAsyncSpawner; recorded to compare the completion order.
+	BRE_BxpSpawned,
+	// A truck deployed by the next BRE_PlaceFormation; recorded once per truck right before it.
+	BRE_FormationTruck
+};
+
+static FString BuildingReplayEventToString(const EBuildingReplayEvent Event)
+{
+	switch (Event)
+	{
+	case EBuildingReplayEvent::BRE_ConstructBuilding:
+		return "ConstructBuilding";
+	case EBuildingReplayEvent::BRE_CancelBuilding:
+		return "CancelBuilding";
+	case EBuildingReplayEvent::BRE_ConvertBackToVehicle:
+		return "ConvertBackToVehicle";
+	case EBuildingReplayEvent::BRE_CancelVehicleConversion:
+		return "CancelVehicleConversion";
+	case EBuildingReplayEvent::BRE_ExpandBuilding:
+		return "ExpandBuilding";
+	case EBuildingReplayEvent::BRE_PlaceBuilding:
+		return "PlaceBuilding";
+	case EBuildingReplayEvent::BRE_PlaceFormation:
+		return "PlaceFormation";
+	case EBuildingReplayEvent::BRE_StopBxpPlacement:
+		return "StopBxpPlacement";
+	case EBuildingReplayEvent::BRE_BxpSpawned:
+		return "BxpSpawned";
+	case EBuildingReplayEvent::BRE_FormationTruck:
+		return "FormationTruck";
+	default:
+		return "Unknown";
+	}
+}
+
+/** One recorded input; fields that do not apply to the event type are left at their defaults. */
+struct FBuildingReplayEvent
+{
+	// World time of the input; saved relative to the first kept event.
+	double Time = 0.0;
+
+	EBuildingReplayEvent Type = EBuildingReplayEvent::BRE_ConstructBuilding;
+
+	// Identifies the requesting actor or expansion owner within the recording, 0 if there is none.
+	// Runtime actor names differ between sessions, so the actor is resolved by its class and location once per id.
+	uint32 ActorId = 0;
+
+	// Path of the class of the actor.
+	FName ActorClass = NAME_None;
+
+	// Location of the actor at the time of the input.
+	FVector ActorLocation = FVector::ZeroVector;
+
+	FVector Location = FVector::ZeroVector;
+
+	float Yaw = 0.f;
+
+	// Underlying value of EBuildingExpansionType.
+	uint8 ExpansionType = 0;
+
+	int32 ExpansionSlotIndex = INDEX_NONE;
+
+	// bIsUnpackedExpansion, bIsCancelledPackedExpansion or whether the bxp class was loaded on request.
+	bool bFlag = false;
+};
+
+/**
+ * @brief Records the inputs of the building pipeline into a fixed size ring buffer.
+ * Records the building functions of ACPPController and the completion order of ARTSAsyncSpawner so a session
+ * with hitches can be replayed headless with ARTSBenchmarkRunner (-RTSReplay=<file>) for reproducible timings.
+ * @note Enabled with -RTSReplayRecord or RTS.Replay.Start; RTS.Replay.Save [Label] writes the buffer to
+ * Saved/Replays/<Label>.json. Recording costs one branch when disabled and only allocates for the first input of
+ * an actor when enabled.
+ * Inputs are timed with the world time so the replay, which advances with the world, keeps the recorded spacing
+ * under time dilation and pauses. An input from another world restarts the recording.
+ */
+class RTS_SURVIVAL_API FBuildingReplayRecorder
+{
+public:
+	static FBuildingReplayRecorder& Get();
+
+	inline bool IsRecording() const { return bM_IsRecording; }
+
+	/** @brief Clears the buffer and starts recording. */
+	void StartRecording();
+
+	void StopRecording() { bM_IsRecording = false; }
+
+	/** @brief Records an input on an actor, e.g. ConstructBuilding; inputs without actor are not recorded. */
+	void RecordActorInput(const EBuildingReplayEvent Type, const AActor* Actor, const bool bFlag = false);
+
+	/** @brief Records ExpandBuildingWithType or a bxp spawn completion. */
+	void RecordExpansionInput(const EBuildingReplayEvent Type, const AActor* Owner, const uint8 ExpansionType,
+	                          const int32 ExpansionSlotIndex, const bool bFlag);
+
+	/**
+	 * @brief Records a placement click.
+	 * @param World The world the click was made in.
+	 * @param Type BRE_PlaceBuilding, or BRE_PlaceFormation for a click that deploys the trucks recorded with
+	 * BRE_FormationTruck right before it.
+	 */
+	void RecordPlacement(const UWorld* World, const FVector& Location, const float Yaw,
+	                     const EBuildingReplayEvent Type = EBuildingReplayEvent::BRE_PlaceBuilding);
+
+	/** @param OutEvents The recorded events from oldest to newest. */
+	void GetEvents(TArray<FBuildingReplayEvent>& OutEvents) const;
+
+	/**
+	 * @brief Writes the recorded events to Saved/Replays/<Label>.json.
+	 * @return The path of the written file, empty if writing failed.
+	 */
+	FString SaveToJson(const FString& Label) const;
+
+	/**
+	 * @brief Reads the events of a replay file written by SaveToJson.
+	 * @return Whether the file was read.
+	 */
+	static bool LoadFromJson(const FString& FilePath, TArray<FBuildingReplayEvent>& OutEvents);
+
+private:
+	FBuildingReplayRecorder() = default;
+
+	// Number of events kept; older events are overwritten.
+	static constexpr int32 Capacity = 4096;
+
+	void Record(const UWorld* World, FBuildingReplayEvent& Event);
+
+	/** @brief Writes the id, class and location of the actor to the event. */
+	void SetEventActor(FBuildingReplayEvent& Event, const AActor* Actor);
+
+	struct FRecordedActor
+	{
+		// In order of the first input of the actor, starting at 1.
+		uint32 Id = 0;
+
+		// Path of the class, resolved once on the first input.
+		FName Class = NAME_None;
+	};
+
+	// The actors referenced since the recording started.
+	TMap<TObjectKey<AActor>, FRecordedActor> M_RecordedActors;
+
+	bool bM_IsRecording = false;
+
+	// The world of the recorded inputs.
+	TWeakObjectPtr<const UWorld> M_World;
+
+	// Ring buffer, allocated once on the first recording.
+	TArray<FBuildingReplayEvent> M_Events;
+
+	// Index where the next event is written.
+	int32 M_Head = 0;
+
+	int32 M_NumEvents = 0;
+};
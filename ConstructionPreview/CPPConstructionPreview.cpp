@@ -4,13 +4,14 @@
 #include "CPPConstructionPreview.h"
 
 #include "Blueprint/UserWidget.h"
+#include "PlacementRules/PlacementValidationSubsystem.h"
 #include "PreviewWidget/W_PreviewStats.h"
+#include "RTS_Survival/Benchmark/RTSBenchmark.h"
 #include "RTS_Survival/Player/CPPController.h"
 #include "RTS_Survival/Utils/HFunctionLibary.h"
 #include "StaticMeshPreview/StaticPreviewMesh.h"
 #include "RTS_Survival/DeveloperSettings.h"
 #include "RTS_Survival/RTSCollisionTraceChannels.h"
-#include "RTS_Survival/Player/Camera/CameraPawn.h"
 FName ACPPConstructionPreview::PreviewMeshComponentName(TEXT("PreviewMesh"));
 
 
@@ -32,21 +33,31 @@ ACPPConstructionPreview::ACPPConstructionPreview()
 	// Initialize the preview mesh component
 	PreviewMesh = CreateDefaultSubobject<UStaticMeshComponent>(PreviewMeshComponentName);
 	PreviewMesh->BodyInstance.bSimulatePhysics = false;
-	PreviewMesh->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
-	PreviewMesh->SetCollisionObjectType(ECollisionChannel::COLLISION_OBJ_BUILDING_PLACEMENT);
-	PreviewMesh->SetCollisionResponseToChannel(
-		ECollisionChannel::COLLISION_OBJ_BUILDING_PLACEMENT, ECollisionResponse::ECR_Overlap);
-	PreviewMesh->SetCollisionResponseToChannel(
-		ECollisionChannel::COLLISION_OBJ_ENEMY, ECollisionResponse::ECR_Overlap);
-	PreviewMesh->SetCollisionResponseToChannel(
-		ECollisionChannel::COLLISION_TRACE_ENEMY, ECollisionResponse::ECR_Overlap);
-	PreviewMesh->SetGenerateOverlapEvents(true);
+	PreviewMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	PreviewMesh->SetGenerateOverlapEvents(false);
 	PreviewMesh->SetCanEverAffectNavigation(false);
 	PreviewMesh->SetCastShadow(false);
 	RootComponent = PreviewMesh;
 
+	// Sized to the footprint of each previewed mesh in StartBuildingPreview.
+	FootprintCollision = CreateDefaultSubobject<UBoxComponent>(TEXT("FootprintCollision"));
+	FootprintCollision->SetupAttachment(PreviewMesh);
+	// Only generates overlaps while a preview is active.
+	FootprintCollision->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	FootprintCollision->SetCollisionObjectType(ECollisionChannel::COLLISION_OBJ_BUILDING_PLACEMENT);
+	FootprintCollision->SetCollisionResponseToAllChannels(ECollisionResponse::ECR_Ignore);
+	FootprintCollision->SetCollisionResponseToChannel(
+		ECollisionChannel::COLLISION_OBJ_BUILDING_PLACEMENT, ECollisionResponse::ECR_Overlap);
+	FootprintCollision->SetCollisionResponseToChannel(
+		ECollisionChannel::COLLISION_OBJ_ENEMY, ECollisionResponse::ECR_Overlap);
+	FootprintCollision->SetCollisionResponseToChannel(
+		ECollisionChannel::COLLISION_TRACE_ENEMY, ECollisionResponse::ECR_Overlap);
+	FootprintCollision->SetGenerateOverlapEvents(true);
+	FootprintCollision->SetCanEverAffectNavigation(false);
+	FootprintCollision->SetHiddenInGame(true);
+
 	// Initialize rotation degrees
-	RotationDegrees = 10.f;
+	RotationDegrees = RotationStepDegrees;
 }
 
 
@@ -60,29 +71,9 @@ FVector ACPPConstructionPreview::GetGridSnapAdjusted(
 	const FVector& MouseWorldPosition,
 	const float ExtraHeight) const
 {
-	constexpr float GridSize = DeveloperSettings::GamePlay::Construction::GridSnapSize;
-	const float X = FMath::RoundToFloat(MouseWorldPosition.X / GridSize) * GridSize;
-	const float Y = FMath::RoundToFloat(MouseWorldPosition.Y / GridSize) * GridSize;
-	const float Z = MouseWorldPosition.Z + ExtraHeight;
-	return FVector(X, Y, Z);
-}
-
-bool ACPPConstructionPreview::IsOverlapping() const
-{
-	TArray<AActor*> OverlappingActors;
-	// m_CollisionBox->GetOverlappingActors(OverlappingActors);
-	PreviewMesh->GetOverlappingActors(OverlappingActors);
-	if (DeveloperSettings::Debugging::GConstruction_Preview_Compile_DebugSymbols)
-	{
-		RTSFunctionLibrary::PrintString("Number of overlapping actors: " + FString::FromInt(OverlappingActors.Num()),
-		                                FColor::Red);
-		RTSFunctionLibrary::PrintString("name of preview mesh: " + PreviewMesh->GetStaticMesh()->GetName(), FColor::Blue);
-	}
-
-	return OverlappingActors.Num() >= 1;
+	return PlacementRules::SnapToGrid(MouseWorldPosition, ExtraHeight);
 }
 
-
 void ACPPConstructionPreview::InitConstructionPreview(
 	ACPPController* NewPlayerController,
 	UMaterialInstance* ConstructionMaterial,
@@ -94,6 +85,10 @@ void ACPPConstructionPreview::InitConstructionPreview(
 	M_PreviewStatsWidget = PreviewStatsWidget;
 	PreviewStatsWidget->InitW_PreviewStats();
 	M_PreviewStatsWidgetComponent = PreviewStatsWidgetComponent;
+	// Drawn on the HUD at the projected component location, so it always faces the camera without being
+	// rotated and re-rendered in the world every tick.
+	M_PreviewStatsWidgetComponent->SetWidgetSpace(EWidgetSpace::Screen);
+	M_PreviewStatsWidgetComponent->SetDrawAtDesiredSize(true);
 
 	// Initialize the pool of dynamic material instances
 	InitializeDynamicMaterialPool(ConstructionMaterial);
@@ -102,47 +97,78 @@ void ACPPConstructionPreview::InitConstructionPreview(
 
 void ACPPConstructionPreview::Tick(float DeltaTime)
 {
-	bool bIsSlopeValid = false;
 	Super::Tick(DeltaTime);
 	if (bM_BHasActivePreview)
 	{
-		SetCursorPosition(
-			PlayerController->GetCursorWorldPosition(DeveloperSettings::UIUX::SightDistanceMouse,
-			                                         bM_IsValidCursorLocation));
-		if (bM_IsValidCursorLocation)
+		// Shared with every other cursor consumer this frame.
+		const FCursorTraceResult& CursorTrace = PlayerController->GetCursorTrace();
+		bool bIsSlopeValid;
+		{
+			RTS_BENCHMARK_SCOPE("ConstructionPreview.Tick");
+			bIsSlopeValid = ValidatePreviewAtLocation(CursorTrace.Location, CursorTrace.bIsValid, &CursorTrace.Normal,
+			                                          &CursorTrace.GridCell);
+		}
+		// Measured apart from the placement as the widget formats its text.
+		RTS_BENCHMARK_SCOPE("ConstructionPreview.StatsWidget");
+		UpdatePreviewStatsWidget(bIsSlopeValid);
+	}
+}
+
+void ACPPConstructionPreview::UpdatePreviewAtLocation(const FVector& CursorLocation, const bool bIsValidCursorLocation,
+                                                      const FVector* GroundNormal)
+{
+	UpdatePreviewStatsWidget(ValidatePreviewAtLocation(CursorLocation, bIsValidCursorLocation, GroundNormal));
+}
+
+bool ACPPConstructionPreview::ValidatePreviewAtLocation(const FVector& CursorLocation,
+                                                        const bool bIsValidCursorLocation,
+                                                        const FVector* GroundNormal,
+                                                        const FIntPoint* GridCell)
+{
+	bool bIsSlopeValid = false;
+	bM_IsValidCursorLocation = bIsValidCursorLocation;
+	SetCursorPosition(CursorLocation);
+	if (bM_IsValidCursorLocation)
+	{
+		// Move preview along grid; at the same snapped location the overlaps of the footprint are still up to date.
+		// Rotating the preview moves the footprint with it, so rotation changes update the overlaps as well.
+		const FIntPoint Cell = GridCell ? *GridCell : PlacementRules::GetGridCell(CursorWorldPosition);
+		if (!M_SnappedCell.IsSet() || M_SnappedCell.GetValue() != Cell
+			|| !FMath::IsNearlyEqual(M_SnappedHeight, CursorWorldPosition.Z))
 		{
-			// Move preview along grid.
+			M_SnappedCell = Cell;
+			M_SnappedHeight = CursorWorldPosition.Z;
 			SetActorLocation(GetGridSnapAdjusted(CursorWorldPosition));
-			// Check if the slope is valid for the current cursor position.
-			bIsSlopeValid = IsSlopeValid(CursorWorldPosition);
-			if (!bIsSlopeValid || IsOverlapping())
-			{
-				// Invalid location due to slope or overlap.
-				if (DeveloperSettings::Debugging::GConstruction_Preview_Compile_DebugSymbols)
-				{
-					RTSFunctionLibrary::PrintString("Cannot place building here", FColor::Red);
-				}
-				UpdatePreviewMaterial(false);
-				bM_IsValidBuildingLocation = false;
-			}
-			else
-			{
-				// Valid location.
-				UpdatePreviewMaterial(true);
-				bM_IsValidBuildingLocation = true;
-			}
 		}
-		else
+		// The slope is traced from the cursor position, the overlaps from the footprint collision.
+		FPlacementContext PlacementContext;
+		PlacementContext.World = GetWorld();
+		PlacementContext.Footprint = &M_Footprint;
+		PlacementContext.Transform = FTransform(PreviewMesh->GetComponentQuat(), CursorWorldPosition);
+		PlacementContext.HostLocation = M_HostLocation;
+		PlacementContext.BuildRadius = M_BuildRadius;
+		PlacementContext.OverlapComponent = FootprintCollision;
+		if (GroundNormal)
 		{
-			// Location outside of view.
-			if (DeveloperSettings::Debugging::GConstruction_Preview_Compile_DebugSymbols)
-			{
-				RTSFunctionLibrary::PrintString("location outside of view", FColor::Red);
-			}
-			bM_IsValidBuildingLocation = false;
+			PlacementContext.GroundNormal = *GroundNormal;
+			PlacementContext.bHasGroundNormal = true;
 		}
-		UpdatePreviewStatsWidget(bIsSlopeValid);
+		PlacementContext.SlopeAngle = M_SlopeAngle;
+		bM_IsValidBuildingLocation = M_PlacementValidator(PlacementContext);
+		bIsSlopeValid = PlacementContext.bIsSlopeValid;
+		M_SlopeAngle = PlacementContext.SlopeAngle;
+		UpdatePreviewMaterial(bM_IsValidBuildingLocation);
+	}
+	else
+	{
+		// Location outside of view.
+		if (DeveloperSettings::Debugging::GConstruction_Preview_Compile_DebugSymbols)
+		{
+			RTSFunctionLibrary::PrintString("location outside of view", FColor::Red);
+		}
+		bM_IsValidBuildingLocation = false;
 	}
+	return bIsSlopeValid;
 }
 
 void ACPPConstructionPreview::SetCursorPosition(const FVector& CursorLocation)
@@ -170,14 +196,24 @@ AStaticPreviewMesh* ACPPConstructionPreview::CreateStaticMeshActor(const FRotato
 void ACPPConstructionPreview::StartBuildingPreview(
 	UStaticMesh* NewPreviewMesh,
 	const FVector HostLocation,
-	const float BuildRadius)
+	const float BuildRadius,
+	const EPlacementCategory PlacementCategory)
 {
 	bM_IsValidBuildingLocation = false;
 	if (NewPreviewMesh)
 	{
 		PreviewMesh->SetStaticMesh(NewPreviewMesh);
+		M_HostLocation = HostLocation;
+		M_BuildRadius = BuildRadius;
+		M_Footprint = GetWorld()->GetSubsystem<UPlacementValidationSubsystem>()->GetFootprint(NewPreviewMesh);
+		FootprintCollision->SetRelativeLocation(M_Footprint.LocalBounds.GetCenter());
+		FootprintCollision->SetBoxExtent(M_Footprint.LocalBounds.GetExtent());
+		M_SnappedCell.Reset();
+		FootprintCollision->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+		M_PlacementValidator = PlacementPolicies::GetValidator(PlacementCategory, M_Footprint, true);
 		bM_BHasActivePreview = true;
 		M_PreviewStatsWidget->SetVisibility(ESlateVisibility::Visible);
+		M_ShownStatsValues.Reset();
 		MoveWidgetToMeshHeight();
 
 		// Apply a dynamic material from the pool to each material slot.
@@ -200,131 +236,33 @@ void ACPPConstructionPreview::StartBuildingPreview(
 void ACPPConstructionPreview::StopBuildingPreview()
 {
 	PreviewMesh->SetStaticMesh(nullptr);
+	FootprintCollision->SetCollisionEnabled(ECollisionEnabled::NoCollision);
 	bM_BHasActivePreview = false;
 	// Reset rotation.
 	PreviewMesh->SetWorldRotation(FRotator::ZeroRotator);
 	M_PreviewStatsWidget->SetVisibility(ESlateVisibility::Hidden);
 }
 
-void ACPPConstructionPreview::UpdatePreviewStatsWidget(const bool bIsInclineValid) const
+void ACPPConstructionPreview::UpdatePreviewStatsWidget(const bool bIsInclineValid)
 {
 	if (M_PreviewStatsWidget && bM_BHasActivePreview)
 	{
-		RotatePreviewStatsToCamera();
-		const FVector CursorLocation = CursorWorldPosition;
-		const float Distance = (CursorLocation - M_HostLocation).Size();
-		const float Degrees = PreviewMesh->GetComponentRotation().Yaw;
-
-		M_PreviewStatsWidget->UpdateInformation(Degrees, M_SlopeAngle, bIsInclineValid, M_BuildRadius > 0, Distance,
-		                                        M_BuildRadius);
-	}
-}
-
-
-void ACPPConstructionPreview::RotatePreviewStatsToCamera() const
-{
-	if (PlayerController && PlayerController->CameraRef)
-	{
-		const FRotator NewRotation = UKismetMathLibrary::FindLookAtRotation(
-			M_PreviewStatsWidgetComponent->GetComponentLocation(),
-			PlayerController->CameraRef->GetCameraComponent()->GetComponentLocation());
-		// Apply the calculated rotation to the widget component
-		M_PreviewStatsWidgetComponent->SetWorldRotation(NewRotation);
-	}
-}
-
-
-bool ACPPConstructionPreview::IsWithinBuildRadius(const FVector& Location) const
-{
-	return (Location - M_HostLocation).Size() <= M_BuildRadius;
-}
-
-bool ACPPConstructionPreview::IsSlopeValid(const FVector& Location)
-{
-	TArray<FVector> TraceStartPoints;
-	TArray<FName> SocketNames = { "FL", "FR", "RL", "RR" };
-	bool bSocketsFound = true;
-
-	// Check for sockets and add their locations to the trace points
-	for (const FName& SocketName : SocketNames)
-	{
-		if (PreviewMesh->DoesSocketExist(SocketName))
-		{
-			TraceStartPoints.Add(PreviewMesh->GetSocketLocation(SocketName) + FVector(0.0f, 0.0f,
-				DeveloperSettings::GamePlay::Construction::AddedHeightToTraceSlopeCheckPoint));
-		}
-		else
-		{
-			bSocketsFound = false;
-			break;
-		}
-	}
-
-	// The sockets are not found, we fall back to the box extend of the preview mesh.
-	if (!bSocketsFound)
-	{
-		TraceStartPoints.Empty();
-		FVector BoxExtent = PreviewMesh->GetStaticMesh()->GetBounds().GetBox().GetExtent();
-		AddBoxExtentToTracePoints(TraceStartPoints, Location, BoxExtent);
-	}
-	else
-	{
-		// Add pivot location as the first trace point
-		TraceStartPoints.Insert(Location + FVector(0.0f, 0.0f, 100.0f), 0);
-	}
-
-	bool bAllPointsValid = true;
-	float SlopeAngle = 0;
-	constexpr float EndHeightDifference = 2*DeveloperSettings::GamePlay::Construction::AddedHeightToTraceSlopeCheckPoint;
-	for (const FVector& StartPoint : TraceStartPoints)
-	{
-		FHitResult Hit;
-		// Adjust height for added z above the original point.
-		FVector EndPoint = StartPoint - FVector(0.0f, 0.0f, EndHeightDifference);
-		
-		if (GetWorld()->LineTraceSingleByChannel(Hit, StartPoint, EndPoint, ECC_Visibility))
+		FPreviewStatsValues Values;
+		Values.Degrees = FMath::RoundToInt(PreviewMesh->GetComponentRotation().Yaw);
+		Values.SlopeAngle = FMath::RoundToInt(M_SlopeAngle);
+		Values.Distance = FMath::RoundToInt(
+			(CursorWorldPosition - M_HostLocation).Size() / FPreviewStatsValues::DistanceStep);
+		Values.bIsInclineValid = bIsInclineValid;
+		Values.bHasBuildRadius = M_BuildRadius > 0;
+		if (M_ShownStatsValues.IsSet() && M_ShownStatsValues.GetValue() == Values)
 		{
-			SlopeAngle = FMath::RadiansToDegrees(acosf(FVector::DotProduct(Hit.Normal, FVector::UpVector)));
-			if (DeveloperSettings::Debugging::GConstruction_Preview_Compile_DebugSymbols)
-			{
-				RTSFunctionLibrary::PrintString("Hit angle at (" + StartPoint.ToString() + "): " + FString::SanitizeFloat(SlopeAngle), FColor::Red);
-			}
-			
-			if (SlopeAngle > DeveloperSettings::GamePlay::Construction::DegreesAllowedOnHill)
-			{
-				bAllPointsValid = false;
-				M_SlopeAngle = SlopeAngle;
-			}
-		}
-		else
-		{
-			// If any trace doesn't hit, consider it invalid
-			bAllPointsValid = false;
+			return;
 		}
+		M_ShownStatsValues = Values;
+		M_PreviewStatsWidget->UpdateInformation(Values.Degrees, Values.SlopeAngle, Values.bIsInclineValid,
+		                                        Values.bHasBuildRadius,
+		                                        Values.Distance * FPreviewStatsValues::DistanceStep, M_BuildRadius);
 	}
-
-	if (bAllPointsValid)
-	{
-		// All valid; take the last slope as the comparison.
-		M_SlopeAngle = SlopeAngle;
-	}
-
-	return bAllPointsValid;
-}
-
-void ACPPConstructionPreview::AddBoxExtentToTracePoints(
-	TArray<FVector>& OutTracePoints,
-	const FVector& Location,
-	const FVector& BoxExtent) const
-{
-	constexpr float Height = DeveloperSettings::GamePlay::Construction::AddedHeightToTraceSlopeCheckPoint;
-	// Add pivot location
-	OutTracePoints.Add(Location + FVector(0.0f, 0.0f,Height));
-	// Add the box extend points
-	OutTracePoints.Add(Location + FVector(BoxExtent.X, BoxExtent.Y, Height));
-	OutTracePoints.Add(Location + FVector(-BoxExtent.X, BoxExtent.Y, Height));
-	OutTracePoints.Add(Location + FVector(BoxExtent.X, -BoxExtent.Y, Height));
-	OutTracePoints.Add(Location + FVector(-BoxExtent.X, -BoxExtent.Y, Height));
 }
 
 
@@ -339,11 +277,12 @@ void ACPPConstructionPreview::InitializeDynamicMaterialPool(UMaterialInstance* B
 
 void ACPPConstructionPreview::UpdatePreviewMaterial(bool bIsValidLocation)
 {
+	static const FName PlacementOkayParameter("PlacementOkay");
 	for (UMaterialInstanceDynamic* DynMaterial : M_DynamicMaterialPool)
 	{
 		if (DynMaterial)
 		{
-			DynMaterial->SetScalarParameterValue(FName("PlacementOkay"), bIsValidLocation);
+			DynMaterial->SetScalarParameterValue(PlacementOkayParameter, bIsValidLocation);
 		}
 	}
 }
@@ -361,6 +300,14 @@ void ACPPConstructionPreview::MoveWidgetToMeshHeight() const
 }
 
 
+void ACPPConstructionPreview::SetPreviewYaw(const float Yaw) const
+{
+	if (bM_BHasActivePreview)
+	{
+		PreviewMesh->SetWorldRotation(FRotator(0.f, Yaw, 0.f));
+	}
+}
+
 void ACPPConstructionPreview::RotatePreviewClockwise() const
 {
 	if (bM_BHasActivePreview)
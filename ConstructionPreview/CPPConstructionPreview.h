@@ -6,6 +6,7 @@
 #include "RTS_Survival/MasterObjects/ActorObjectsMaster.h"
 #include "Components/BoxComponent.h"
 #include "Components/WidgetComponent.h"
+#include "PlacementRules/PlacementPolicies.h"
 
 
 #include "CPPConstructionPreview.generated.h"
@@ -40,13 +41,15 @@ public:
 	 * @param NewPreviewMesh The mesh that will be displayed.
 	 * @param HostLocation The location of the expanding building that wants to place an expansion.
 	 * @param BuildRadius How far the building can be placed from the host location.
+	 * @param PlacementCategory Selects the placement rules that validate the preview.
 	 * @note Do not call directly but use the CppController::StartBuildingPreview.
 	 */
 	UFUNCTION(BlueprintCallable)
 	void StartBuildingPreview(
 		UStaticMesh* NewPreviewMesh,
 		const FVector HostLocation = FVector::ZeroVector,
-		const float BuildRadius = 0);
+		const float BuildRadius = 0,
+		const EPlacementCategory PlacementCategory = EPlacementCategory::PC_NomadicHQ);
 
 	inline UStaticMesh* GetPreviewMesh() const { return PreviewMesh->GetStaticMesh(); }
 
@@ -77,6 +80,34 @@ public:
 
 	FRotator GetPreviewRotation() const;
 
+	/** @brief Sets the yaw of the active preview, used to replay recorded placements. */
+	void SetPreviewYaw(const float Yaw) const;
+
+	/**
+	 * @brief Moves the active preview to the grid cell of the location, validates the placement there and updates
+	 * the stats widget.
+	 * @param CursorLocation The location on the landscape under the cursor.
+	 * @param bIsValidCursorLocation Whether the cursor hit the landscape, if not the placement is invalid.
+	 * @param GroundNormal The surface normal at the cursor location if known, replaces the slope trace at the pivot.
+	 * @pre There is an active preview.
+	 */
+	void UpdatePreviewAtLocation(const FVector& CursorLocation, const bool bIsValidCursorLocation,
+	                             const FVector* GroundNormal = nullptr);
+
+	/**
+	 * @brief Moves the active preview to the grid cell of the location and validates the placement there, without
+	 * updating the stats widget.
+	 * @param CursorLocation The location on the landscape under the cursor.
+	 * @param bIsValidCursorLocation Whether the cursor hit the landscape, if not the placement is invalid.
+	 * @param GroundNormal The surface normal at the cursor location if known, replaces the slope trace at the pivot.
+	 * @param GridCell The grid cell of the cursor location if known, e.g. from the cursor trace.
+	 * @return Whether the incline at the location is valid, to show on the stats widget.
+	 * @note Public so the benchmark can measure the placement without input and without the widget text formatting.
+	 * @pre There is an active preview.
+	 */
+	bool ValidatePreviewAtLocation(const FVector& CursorLocation, const bool bIsValidCursorLocation,
+	                               const FVector* GroundNormal = nullptr, const FIntPoint* GridCell = nullptr);
+
 protected:
 	/**
 	 * Call in begin play.
@@ -112,10 +143,20 @@ protected:
 	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Transient)
 	TObjectPtr<UStaticMeshComponent> PreviewMesh;
 
+	/**
+	 * The oriented box around the footprint of the previewed mesh, the only collision of the preview.
+	 * The visual mesh has no collision, so moving it does not update the overlaps of a complex body.
+	 */
+	UPROPERTY(VisibleDefaultsOnly, BlueprintReadOnly, Transient)
+	TObjectPtr<UBoxComponent> FootprintCollision;
+
 	UPROPERTY(BlueprintReadOnly)
 	FVector CursorWorldPosition;
 
-	// Degrees to rotate the building preview
+	// Default of RotationDegrees; placed rotations are replicated and saved in steps of this size.
+	static constexpr float RotationStepDegrees = 10.f;
+
+	// Degrees to rotate the building preview; keep a multiple of RotationStepDegrees.
 	UPROPERTY(EditDefaultsOnly, BlueprintReadWrite, Category="Building Rotation")
 	float RotationDegrees;
 
@@ -127,9 +168,6 @@ private:
 	// Whether there is a preview active.
 	bool bM_BHasActivePreview;
 
-	/** @return Whether the construction preview overlaps with something. */
-	bool IsOverlapping() const;
-
 	// The Displayed building Material.
 	// Safe non-owning reference using GC system.
 	UPROPERTY()
@@ -156,42 +194,49 @@ private:
 	UPROPERTY()
 	UWidgetComponent* M_PreviewStatsWidgetComponent;
 
+	/** The values shown by the stats widget, quantized to the precision the widget displays. */
+	struct FPreviewStatsValues
+	{
+		int32 Degrees = 0;
+		int32 SlopeAngle = 0;
+		// In units of DistanceStep.
+		int32 Distance = 0;
+		bool bIsInclineValid = false;
+		bool bHasBuildRadius = false;
+
+		// The widget shows whole degrees and distances in steps of 10 units.
+		static constexpr float DistanceStep = 10.f;
+
+		inline bool operator==(const FPreviewStatsValues& Other) const
+		{
+			return Degrees == Other.Degrees && SlopeAngle == Other.SlopeAngle && Distance == Other.Distance
+				&& bIsInclineValid == Other.bIsInclineValid && bHasBuildRadius == Other.bHasBuildRadius;
+		}
+	};
+
+	// What the stats widget currently shows; unset when the widget needs a full update.
+	TOptional<FPreviewStatsValues> M_ShownStatsValues;
+
 	/**
-	 * @brief Updates the preview widget with the data of the preview.
+	 * @brief Updates the preview widget with the data of the preview if any of the shown values changed.
 	 * @param bIsInclineValid Whether the preview's incline results in valid placement.
+	 * @note The widget re-formats its text on every update, so unchanged values are not sent.
 	 */
-	void UpdatePreviewStatsWidget(const bool bIsInclineValid) const;
+	void UpdatePreviewStatsWidget(const bool bIsInclineValid);
 
-	void RotatePreviewStatsToCamera() const;
+	// Validates the placement with the rules of the category of the previewed building.
+	// Selected once per preview so the per-tick check contains only the rules the category needs.
+	PlacementPolicies::FPlacementValidatorFn M_PlacementValidator = nullptr;
 
-	/** @return Whether the location is within the build radius of the host location. */
-	bool IsWithinBuildRadius(const FVector& Location) const;
+	// Footprint of the previewed mesh, taken from the UPlacementValidationSubsystem cache.
+	PlacementRules::FPlacementFootprint M_Footprint;
 
-	/**
-	 * @brief Checks if the slope at a given location is within the allowed angle for building placement.
-	 *
-	 * This function performs a line trace at the specified location to determine the surface normal.
-	 * It then calculates the angle between this normal and the world's up vector. If the angle is less than
-	 * or equal to m_DegreesAllowedOnHill, the function returns true, indicating the slope is valid for building.
-	 *
-	 * @param Location The world location where the slope's validity is to be checked.
-	 * @return bool True if the slope angle at the location is within the allowed limit, false otherwise.
-	 *
-	 * @note Attemps to trace from the preview mesh at the predetermined socket points ["FL", "FR", "RL", "RR"].
-	 * If these are not found we revert back to the box extend of the preview mesh.
-	 */
-	bool IsSlopeValid(const FVector& Location);
+	// The grid cell the preview is snapped to; the preview and its overlaps are only moved when it or
+	// M_SnappedHeight changes.
+	TOptional<FIntPoint> M_SnappedCell;
 
-	/**
-	 * @brief Adds the box extent to the provided trace points.
-	 * @param OutTracePoints The collection of trace points to add the box extent to.
-	 * @param Location The pivot location.
-	 * @param BoxExtent The box extend of the preview mesh.
-	 */
-	void AddBoxExtentToTracePoints(
-		TArray<FVector>& OutTracePoints,
-		const FVector& Location,
-		const FVector& BoxExtent) const;
+	// The height of the preview, which is not snapped and changes within a cell on slopes.
+	double M_SnappedHeight = 0.0;
 
 	// Pool to store dynamic material instances for each material slot.
 	UPROPERTY()
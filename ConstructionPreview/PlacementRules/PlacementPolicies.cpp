@@ -0,0 +1,39 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "PlacementPolicies.h"
+
+namespace PlacementPolicies
+{
+	template <class TFootprint, class TOverlapRule>
+	FPlacementValidatorFn GetCategoryValidator(const EPlacementCategory Category)
+	{
+		switch (Category)
+		{
+		case EPlacementCategory::PC_NomadicHQ:
+			return &TPlacementValidator<TFootprint, FHillSlopeRule, TOverlapRule, FNoRadiusRule>::Validate;
+		case EPlacementCategory::PC_Expansion:
+			return &TPlacementValidator<TFootprint, FHillSlopeRule, TOverlapRule, FHostRadiusRule>::Validate;
+		default:
+			return &TPlacementValidator<FBoundsFootprint, FHillSlopeRule, TOverlapRule, FNoRadiusRule>::Validate;
+		}
+	}
+}
+
+PlacementPolicies::FPlacementValidatorFn PlacementPolicies::GetValidator(
+	const EPlacementCategory Category,
+	const PlacementRules::FPlacementFootprint& Footprint,
+	const bool bUseComponentOverlap)
+{
+	// The sockets are not found, we fall back to the box extent of the mesh.
+	const bool bHasSockets = Footprint.bHasFootprintSockets;
+	if (bUseComponentOverlap)
+	{
+		return bHasSockets
+			       ? GetCategoryValidator<FSocketFootprint, FComponentOverlapRule>(Category)
+			       : GetCategoryValidator<FBoundsFootprint, FComponentOverlapRule>(Category);
+	}
+	return bHasSockets
+		       ? GetCategoryValidator<FSocketFootprint, FFootprintOverlapRule>(Category)
+		       : GetCategoryValidator<FBoundsFootprint, FFootprintOverlapRule>(Category);
+}
@@ -0,0 +1,199 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/PrimitiveComponent.h"
+#include "PlacementRules.h"
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+#include "PlacementPolicies.generated.h"
+
+/** The categories of buildings that each have their own set of placement rules. */
+UENUM(BlueprintType)
+enum class EPlacementCategory : uint8
+{
+	// A nomadic truck converting into its building; drives to the location so no build radius applies.
+	PC_NomadicHQ,
+	// An expansion placed around its owner; needs to be within the owner's build radius.
+	PC_Expansion
+};
+
+/** Input and output of one placement validation. */
+struct FPlacementContext
+{
+	const UWorld* World = nullptr;
+
+	// Cached footprint of the building's mesh.
+	const PlacementRules::FPlacementFootprint* Footprint = nullptr;
+
+	// Snapped pivot and rotation of the building.
+	FTransform Transform;
+
+	// Location of the building that places an expansion.
+	FVector HostLocation = FVector::ZeroVector;
+
+	// How far the building can be placed from the host; zero or less means no limit.
+	float BuildRadius = 0.f;
+
+	// Ground normal at the pivot if it is already known, e.g. from the cursor trace; saves the first slope trace.
+	FVector GroundNormal = FVector::UpVector;
+
+	bool bHasGroundNormal = false;
+
+	// The component of which the overlaps are used by FComponentOverlapRule.
+	const UPrimitiveComponent* OverlapComponent = nullptr;
+
+	// Set by the slope rule.
+	float SlopeAngle = 0.f;
+
+	// Set by the slope rule.
+	bool bIsSlopeValid = false;
+};
+
+/**
+ * @brief Policy types that together make up the placement validator of a building category.
+ * A validator is a TPlacementValidator instantiated with one policy of each kind:
+ * - Footprint source: provides the slope trace points, the pivot first (FSocketFootprint, FBoundsFootprint).
+ * - Slope rule: validates the terrain under the footprint (FHillSlopeRule).
+ * - Overlap rule: checks for blocking buildings and units (FComponentOverlapRule, FFootprintOverlapRule).
+ * - Radius rule: checks the distance to the host (FHostRadiusRule, FNoRadiusRule).
+ * All choices are made at compile time so each validator is a straight, inlined sequence of only the checks it needs.
+ */
+namespace PlacementPolicies
+{
+	/** Traces from the FL, FR, RL and RR sockets. Only selected for footprints that have all of them. */
+	struct FSocketFootprint
+	{
+		static FORCEINLINE void GetTracePoints(const FPlacementContext& Context,
+		                                       PlacementRules::FSlopeTracePoints& OutTracePoints)
+		{
+			constexpr float Height = DeveloperSettings::GamePlay::Construction::AddedHeightToTraceSlopeCheckPoint;
+			OutTracePoints.Add(Context.Transform.GetLocation() + FVector(0.0f, 0.0f, Height));
+			for (const FVector& SocketLocation : Context.Footprint->SocketLocations)
+			{
+				OutTracePoints.Add(Context.Transform.TransformPosition(SocketLocation) + FVector(0.0f, 0.0f, Height));
+			}
+		}
+	};
+
+	/** Traces from the corners of the box extent of the mesh bounds. */
+	struct FBoundsFootprint
+	{
+		static FORCEINLINE void GetTracePoints(const FPlacementContext& Context,
+		                                       PlacementRules::FSlopeTracePoints& OutTracePoints)
+		{
+			constexpr float Height = DeveloperSettings::GamePlay::Construction::AddedHeightToTraceSlopeCheckPoint;
+			const FVector Location = Context.Transform.GetLocation();
+			const FVector BoxExtent = Context.Footprint->LocalBounds.GetExtent();
+			OutTracePoints.Add(Location + FVector(0.0f, 0.0f, Height));
+			OutTracePoints.Add(Location + FVector(BoxExtent.X, BoxExtent.Y, Height));
+			OutTracePoints.Add(Location + FVector(-BoxExtent.X, BoxExtent.Y, Height));
+			OutTracePoints.Add(Location + FVector(BoxExtent.X, -BoxExtent.Y, Height));
+			OutTracePoints.Add(Location + FVector(-BoxExtent.X, -BoxExtent.Y, Height));
+		}
+	};
+
+	/** The terrain under every trace point may not be steeper than DegreesAllowedOnHill. */
+	struct FHillSlopeRule
+	{
+		static FORCEINLINE bool IsSlopeValid(FPlacementContext& Context,
+		                                     const PlacementRules::FSlopeTracePoints& TracePoints)
+		{
+			if (!Context.bHasGroundNormal)
+			{
+				return PlacementRules::IsSlopeValid(Context.World, TracePoints, Context.SlopeAngle);
+			}
+			// The pivot is the first trace point; its normal is known so only the others are traced.
+			const bool bIsRestValid = PlacementRules::IsSlopeValid(
+				Context.World, TConstArrayView<FVector>(TracePoints).RightChop(1), Context.SlopeAngle);
+			const float PivotAngle = PlacementRules::GetSlopeAngle(Context.GroundNormal);
+			if (PivotAngle > DeveloperSettings::GamePlay::Construction::DegreesAllowedOnHill)
+			{
+				Context.SlopeAngle = PivotAngle;
+				return false;
+			}
+			return bIsRestValid;
+		}
+	};
+
+	/** Uses the overlaps that the overlap component already generated when it was moved. */
+	struct FComponentOverlapRule
+	{
+		static FORCEINLINE bool IsOverlapping(const FPlacementContext& Context)
+		{
+			return Context.OverlapComponent->GetOverlapInfos().Num() >= 1;
+		}
+	};
+
+	/** Queries the world with the box footprint of the mesh, for validation without a preview component. */
+	struct FFootprintOverlapRule
+	{
+		static FORCEINLINE bool IsOverlapping(const FPlacementContext& Context)
+		{
+			return PlacementRules::IsFootprintOverlapping(Context.World, Context.Footprint->LocalBounds,
+			                                              Context.Transform);
+		}
+	};
+
+	/** The building needs to be within the build radius of its host. */
+	struct FHostRadiusRule
+	{
+		static FORCEINLINE bool IsWithinRadius(const FPlacementContext& Context)
+		{
+			return Context.BuildRadius <= 0.f ||
+				FVector::DistSquared(Context.Transform.GetLocation(), Context.HostLocation) <=
+				FMath::Square(Context.BuildRadius);
+		}
+	};
+
+	struct FNoRadiusRule
+	{
+		static FORCEINLINE bool IsWithinRadius(const FPlacementContext&) { return true; }
+	};
+
+	template <class TFootprint, class TSlopeRule, class TOverlapRule, class TRadiusRule>
+	struct TPlacementValidator
+	{
+		/**
+		 * @brief Validates the placement in the context, cheapest checks first.
+		 * @param Context The placement to validate; receives the slope results.
+		 * @return Whether the building can be placed.
+		 */
+		static bool Validate(FPlacementContext& Context)
+		{
+			PlacementRules::FSlopeTracePoints TracePoints;
+			TFootprint::GetTracePoints(Context, TracePoints);
+			Context.bIsSlopeValid = TSlopeRule::IsSlopeValid(Context, TracePoints);
+			const bool bIsValid = Context.bIsSlopeValid
+				&& TRadiusRule::IsWithinRadius(Context)
+				&& !TOverlapRule::IsOverlapping(Context);
+			if constexpr (DeveloperSettings::Debugging::GConstruction_Preview_Compile_DebugSymbols)
+			{
+				if (IsInGameThread())
+				{
+					RTSFunctionLibrary::PrintString(
+						bIsValid ? FString("Valid placement") : FString("Cannot place building here"),
+						bIsValid ? FColor::Green : FColor::Red);
+				}
+			}
+			return bIsValid;
+		}
+	};
+
+	using FPlacementValidatorFn = bool (*)(FPlacementContext&);
+
+	/**
+	 * @brief Selects the validator of the category; call once when the mesh or category changes, not per check.
+	 * @param Category The category of the building.
+	 * @param Footprint The footprint of the building, decides between the socket and bounds footprint source.
+	 * @param bUseComponentOverlap Whether the overlaps of FPlacementContext::OverlapComponent are used instead of
+	 * a footprint query, true for the construction preview.
+	 * @return The validator to call for each placement check.
+	 */
+	RTS_SURVIVAL_API FPlacementValidatorFn GetValidator(
+		const EPlacementCategory Category,
+		const PlacementRules::FPlacementFootprint& Footprint,
+		const bool bUseComponentOverlap);
+}
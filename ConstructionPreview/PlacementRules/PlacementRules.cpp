@@ -0,0 +1,136 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "PlacementRules.h"
+
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshSocket.h"
+#include "Engine/World.h"
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/RTSCollisionTraceChannels.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+
+PlacementRules::FPlacementFootprint PlacementRules::MakeFootprint(const UStaticMesh* Mesh)
+{
+	FPlacementFootprint Footprint;
+	Footprint.LocalBounds = Mesh->GetBounds().GetBox();
+	// The bounds need not be centered on the pivot; take the furthest corner from the pivot.
+	const FVector& Min = Footprint.LocalBounds.Min;
+	const FVector& Max = Footprint.LocalBounds.Max;
+	Footprint.Radius = FVector2D(FMath::Max(FMath::Abs(Min.X), FMath::Abs(Max.X)),
+	                             FMath::Max(FMath::Abs(Min.Y), FMath::Abs(Max.Y))).Size();
+
+	Footprint.bHasFootprintSockets = true;
+	for (int32 i = 0; i < UE_ARRAY_COUNT(FootprintSocketNames); ++i)
+	{
+		const UStaticMeshSocket* Socket = Mesh->FindSocket(FootprintSocketNames[i]);
+		if (!Socket)
+		{
+			// The sockets are not found, placement falls back to the box extent of the mesh.
+			Footprint.bHasFootprintSockets = false;
+			break;
+		}
+		Footprint.SocketLocations[i] = Socket->RelativeLocation;
+	}
+	return Footprint;
+}
+
+FVector PlacementRules::SnapToGrid(const FVector& Location, const float ExtraHeight)
+{
+	constexpr float GridSize = DeveloperSettings::GamePlay::Construction::GridSnapSize;
+	return FVector(FMath::RoundToFloat(Location.X / GridSize) * GridSize,
+	               FMath::RoundToFloat(Location.Y / GridSize) * GridSize,
+	               Location.Z + ExtraHeight);
+}
+
+FIntPoint PlacementRules::GetGridCell(const FVector& Location)
+{
+	constexpr float GridSize = DeveloperSettings::GamePlay::Construction::GridSnapSize;
+	return FIntPoint(FMath::RoundToInt(Location.X / GridSize), FMath::RoundToInt(Location.Y / GridSize));
+}
+
+bool PlacementRules::ProjectSiteToGround(const UWorld* World, const FVector& Candidate, FVector& OutSite)
+{
+	// Half the height of the trace that projects a candidate site onto the landscape.
+	constexpr float GroundTraceHalfHeight = 5000.f;
+	FHitResult GroundHit;
+	const FVector Start = Candidate + FVector(0.f, 0.f, GroundTraceHalfHeight);
+	const FVector End = Candidate - FVector(0.f, 0.f, GroundTraceHalfHeight);
+	if (!World->LineTraceSingleByChannel(GroundHit, Start, End, ECC_Visibility))
+	{
+		return false;
+	}
+	OutSite = SnapToGrid(FVector(Candidate.X, Candidate.Y, GroundHit.Location.Z));
+	return true;
+}
+
+bool PlacementRules::IsSlopeValid(
+	const UWorld* World,
+	const TConstArrayView<FVector> TraceStartPoints,
+	float& OutSlopeAngle)
+{
+	bool bAllPointsValid = true;
+	float SlopeAngle = 0;
+	constexpr float EndHeightDifference = 2 * DeveloperSettings::GamePlay::Construction::AddedHeightToTraceSlopeCheckPoint;
+	for (const FVector& StartPoint : TraceStartPoints)
+	{
+		FHitResult Hit;
+		// Adjust height for added z above the original point.
+		const FVector EndPoint = StartPoint - FVector(0.0f, 0.0f, EndHeightDifference);
+
+		if (World->LineTraceSingleByChannel(Hit, StartPoint, EndPoint, ECC_Visibility))
+		{
+			SlopeAngle = GetSlopeAngle(Hit.Normal);
+			if constexpr (DeveloperSettings::Debugging::GConstruction_Preview_Compile_DebugSymbols)
+			{
+				if (IsInGameThread())
+				{
+					RTSFunctionLibrary::PrintString(
+						"Hit angle at (" + StartPoint.ToString() + "): " + FString::SanitizeFloat(SlopeAngle), FColor::Red);
+				}
+			}
+
+			if (SlopeAngle > DeveloperSettings::GamePlay::Construction::DegreesAllowedOnHill)
+			{
+				bAllPointsValid = false;
+				OutSlopeAngle = SlopeAngle;
+			}
+		}
+		else
+		{
+			// If any trace doesn't hit, consider it invalid
+			bAllPointsValid = false;
+		}
+	}
+
+	if (bAllPointsValid)
+	{
+		// All valid; take the last slope as the comparison.
+		OutSlopeAngle = SlopeAngle;
+	}
+	return bAllPointsValid;
+}
+
+bool PlacementRules::IsFootprintOverlapping(
+	const UWorld* World,
+	const FBox& LocalBounds,
+	const FTransform& Transform)
+{
+	FVector Origin, Extent;
+	LocalBounds.GetCenterAndExtents(Origin, Extent);
+
+	// Respond to the same channels as the construction preview mesh.
+	FCollisionResponseParams ResponseParams(ECR_Ignore);
+	ResponseParams.CollisionResponse.SetResponse(COLLISION_OBJ_BUILDING_PLACEMENT, ECR_Overlap);
+	ResponseParams.CollisionResponse.SetResponse(COLLISION_OBJ_ENEMY, ECR_Overlap);
+	ResponseParams.CollisionResponse.SetResponse(COLLISION_TRACE_ENEMY, ECR_Overlap);
+
+	return World->OverlapAnyTestByChannel(
+		Transform.TransformPosition(Origin),
+		Transform.GetRotation(),
+		COLLISION_OBJ_BUILDING_PLACEMENT,
+		FCollisionShape::MakeBox(Extent),
+		FCollisionQueryParams(SCENE_QUERY_STAT(PlacementFootprintOverlap)),
+		ResponseParams);
+}
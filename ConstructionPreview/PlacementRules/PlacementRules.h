@@ -0,0 +1,100 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UWorld;
+class UStaticMesh;
+
+/**
+ * @brief The slope and overlap rules used to validate building placement.
+ * Shared by the construction preview and the systems that validate locations without a preview actor.
+ * @note All functions only read from the world and can be called from worker threads.
+ */
+namespace PlacementRules
+{
+	// Sockets on a (preview) mesh that mark the corners of the footprint for the slope check.
+	static const FName FootprintSocketNames[] = {"FL", "FR", "RL", "RR"};
+
+	// The pivot and the four corners of the footprint.
+	constexpr int32 MaxSlopeTracePoints = 5;
+
+	// Trace points live on the stack so the per-tick placement check does not allocate.
+	using FSlopeTracePoints = TArray<FVector, TInlineAllocator<MaxSlopeTracePoints>>;
+
+	/**
+	 * @brief The data of a mesh that placement validation needs, extracted once so validation does not
+	 * touch the mesh and can run on any thread.
+	 */
+	struct FPlacementFootprint
+	{
+		// Bounding box of the mesh in local space.
+		FBox LocalBounds = FBox(ForceInit);
+
+		// Local locations of the FootprintSocketNames, only valid if bHasFootprintSockets.
+		FVector SocketLocations[UE_ARRAY_COUNT(FootprintSocketNames)];
+
+		// Whether the mesh has all of the FootprintSocketNames.
+		bool bHasFootprintSockets = false;
+
+		// Radius of the circle around the pivot that contains the footprint at any rotation.
+		float Radius = 0.f;
+	};
+
+	/**
+	 * @param Mesh The mesh to extract the footprint of.
+	 * @return The footprint of the mesh.
+	 */
+	FPlacementFootprint MakeFootprint(const UStaticMesh* Mesh);
+
+	/**
+	 * @brief Traces down from each of the start points and checks the angle of the hit normal with the up vector.
+	 * @param World The world to trace in.
+	 * @param TraceStartPoints The start points of the traces.
+	 * @param OutSlopeAngle The last slope angle that is too steep, or the last angle if all points are valid.
+	 * Not changed if no slope is too steep but a trace did not hit.
+	 * @return Whether all traces hit and none of the slopes exceeds DegreesAllowedOnHill.
+	 */
+	bool IsSlopeValid(
+		const UWorld* World,
+		TConstArrayView<FVector> TraceStartPoints,
+		float& OutSlopeAngle);
+
+	/**
+	 * @param Location The location to snap.
+	 * @param ExtraHeight Added to the height of the location, which is not snapped.
+	 * @return The location with X and Y snapped to the construction grid.
+	 */
+	FVector SnapToGrid(const FVector& Location, const float ExtraHeight = 0.f);
+
+	/** @return The construction grid cell of the location; SnapToGrid snaps to the centre of this cell. */
+	FIntPoint GetGridCell(const FVector& Location);
+
+	/**
+	 * @brief Projects a candidate building site onto the landscape and snaps it to the construction grid.
+	 * @param World The world to trace in.
+	 * @param Candidate The site to project, only X and Y are used.
+	 * @param OutSite The snapped site on the ground.
+	 * @return Whether the ground was found under the candidate.
+	 */
+	bool ProjectSiteToGround(const UWorld* World, const FVector& Candidate, FVector& OutSite);
+
+	/** @return The angle in degrees between the surface normal and the up vector. */
+	FORCEINLINE float GetSlopeAngle(const FVector& Normal)
+	{
+		return FMath::RadiansToDegrees(acosf(FVector::DotProduct(Normal, FVector::UpVector)));
+	}
+
+	/**
+	 * @brief Tests the box footprint of a mesh against everything the construction preview overlaps with.
+	 * @param World The world to test in.
+	 * @param LocalBounds The bounding box of the mesh in local space.
+	 * @param Transform Where the mesh is placed.
+	 * @return Whether the footprint overlaps with anything.
+	 */
+	bool IsFootprintOverlapping(
+		const UWorld* World,
+		const FBox& LocalBounds,
+		const FTransform& Transform);
+}
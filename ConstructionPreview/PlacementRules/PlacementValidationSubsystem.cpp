@@ -0,0 +1,179 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "PlacementValidationSubsystem.h"
+
+#include "Async/Async.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+void UPlacementValidationSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	M_WorldGuard = MakeShared<FPlacementWorldGuard, ESPMode::ThreadSafe>(GetWorld());
+	M_WorldCleanupHandle = FWorldDelegates::OnWorldCleanup.AddUObject(
+		this, &UPlacementValidationSubsystem::OnWorldCleanup);
+}
+
+void UPlacementValidationSubsystem::Deinitialize()
+{
+	FWorldDelegates::OnWorldCleanup.Remove(M_WorldCleanupHandle);
+	M_WorldGuard->Revoke();
+	{
+		FWriteScopeLock WriteLock(M_FootprintCacheLock);
+		M_FootprintCache.Empty();
+	}
+	Super::Deinitialize();
+}
+
+void UPlacementValidationSubsystem::OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources)
+{
+	// Before the physics scene is released; running worker queries finish first.
+	if (World == GetWorld())
+	{
+		M_WorldGuard->Revoke();
+	}
+}
+
+PlacementRules::FPlacementFootprint UPlacementValidationSubsystem::GetFootprint(const UStaticMesh* Mesh)
+{
+	const TObjectKey<UStaticMesh> Key(Mesh);
+	{
+		FReadScopeLock ReadLock(M_FootprintCacheLock);
+		if (const PlacementRules::FPlacementFootprint* Footprint = M_FootprintCache.Find(Key))
+		{
+			return *Footprint;
+		}
+	}
+	if (!IsInGameThread())
+	{
+		// The mesh may not be read from workers; ValidatePlacements gathers the footprints up front.
+		ensureMsgf(false, TEXT("Footprint of %s is not cached, extract it on the game thread first."),
+		           *GetNameSafe(Mesh));
+		return PlacementRules::FPlacementFootprint();
+	}
+	const PlacementRules::FPlacementFootprint Footprint = PlacementRules::MakeFootprint(Mesh);
+	FWriteScopeLock WriteLock(M_FootprintCacheLock);
+	M_FootprintCache.Add(Key, Footprint);
+	return Footprint;
+}
+
+FPlacementQueryResult UPlacementValidationSubsystem::ValidatePlacement(
+	const UStaticMesh* Mesh,
+	const FTransform& Transform,
+	const FVector& HostLocation,
+	const float BuildRadius,
+	const EPlacementCategory Category)
+{
+	if (!Mesh)
+	{
+		RTSFunctionLibrary::ReportError("Attempt to validate placement with null mesh!"
+			"\n At function ValidatePlacement in PlacementValidationSubsystem.cpp");
+		return FPlacementQueryResult();
+	}
+	return ValidateWithFootprint(*GetWorld(), GetFootprint(Mesh), Transform, HostLocation, BuildRadius, Category);
+}
+
+FPlacementQueryResult UPlacementValidationSubsystem::ValidateWithFootprint(
+	const UWorld& World,
+	const PlacementRules::FPlacementFootprint& Footprint,
+	const FTransform& Transform,
+	const FVector& HostLocation,
+	const float BuildRadius,
+	const EPlacementCategory Category)
+{
+	FPlacementQueryResult Result;
+	FPlacementContext Context;
+	Context.World = &World;
+	Context.Footprint = &Footprint;
+	Context.Transform = Transform;
+	Context.HostLocation = HostLocation;
+	Context.BuildRadius = BuildRadius;
+	const PlacementPolicies::FPlacementValidatorFn Validator =
+		PlacementPolicies::GetValidator(Category, Footprint, false);
+	Result.bIsValid = Validator(Context);
+	Result.bIsSlopeValid = Context.bIsSlopeValid;
+	Result.SlopeAngle = Context.SlopeAngle;
+	return Result;
+}
+
+bool UPlacementValidationSubsystem::ResolveQuery(const FPlacementQuery& Query, FResolvedPlacementQuery& OutResolved)
+{
+	if (!Query.Mesh)
+	{
+		return false;
+	}
+	OutResolved.Footprint = GetFootprint(Query.Mesh);
+	OutResolved.Transform = Query.Transform;
+	OutResolved.HostLocation = Query.HostLocation;
+	OutResolved.BuildRadius = Query.BuildRadius;
+	OutResolved.Category = Query.Category;
+	return true;
+}
+
+void UPlacementValidationSubsystem::ValidateResolvedPlacements(
+	const FPlacementWorldGuard& WorldGuard,
+	const TConstArrayView<FResolvedPlacementQuery> Queries,
+	TArray<FPlacementQueryResult>& OutResults)
+{
+	OutResults.Init(FPlacementQueryResult(), Queries.Num());
+	for (int32 Index = 0; Index < Queries.Num(); ++Index)
+	{
+		const FResolvedPlacementQuery& Query = Queries[Index];
+		// One query per guarded call so a world cleanup waits for at most one validation.
+		const bool bWorldIsAlive = WorldGuard.WithWorld([&Query, &Result = OutResults[Index]](const UWorld& World)
+		{
+			Result = ValidateWithFootprint(World, Query.Footprint, Query.Transform, Query.HostLocation,
+			                               Query.BuildRadius, Query.Category);
+		});
+		if (!bWorldIsAlive)
+		{
+			return;
+		}
+	}
+}
+
+void UPlacementValidationSubsystem::ValidatePlacementsAsync(
+	const TConstArrayView<FPlacementQuery> Queries,
+	FOnPlacementsValidated OnValidated)
+{
+	// Resolved here so the worker never reads a mesh; queries without mesh stay invalid.
+	TArray<FResolvedPlacementQuery> ResolvedQueries;
+	TArray<int32> ResolvedQueryIndices;
+	ResolvedQueries.Reserve(Queries.Num());
+	ResolvedQueryIndices.Reserve(Queries.Num());
+	for (int32 Index = 0; Index < Queries.Num(); ++Index)
+	{
+		FResolvedPlacementQuery ResolvedQuery;
+		if (ResolveQuery(Queries[Index], ResolvedQuery))
+		{
+			ResolvedQueries.Add(MoveTemp(ResolvedQuery));
+			ResolvedQueryIndices.Add(Index);
+		}
+	}
+	Async(EAsyncExecution::TaskGraph,
+	      [WorldGuard = GetWorldGuard(), ResolvedQueries = MoveTemp(ResolvedQueries),
+		      ResolvedQueryIndices = MoveTemp(ResolvedQueryIndices), NumQueries = Queries.Num(),
+		      OnValidated = MoveTemp(OnValidated)]() mutable
+	      {
+		      TArray<FPlacementQueryResult> ResolvedResults;
+		      ValidateResolvedPlacements(*WorldGuard, ResolvedQueries, ResolvedResults);
+		      TArray<FPlacementQueryResult> Results;
+		      Results.SetNum(NumQueries);
+		      for (int32 Index = 0; Index < ResolvedQueryIndices.Num(); ++Index)
+		      {
+			      Results[ResolvedQueryIndices[Index]] = ResolvedResults[Index];
+		      }
+		      AsyncTask(ENamedThreads::GameThread,
+		                [WorldGuard = MoveTemp(WorldGuard), Results = MoveTemp(Results),
+			                OnValidated = MoveTemp(OnValidated)]()
+		                {
+			                // The owner of the delegate may be cleaned up with the world.
+			                if (!WorldGuard->IsRevoked())
+			                {
+				                OnValidated.ExecuteIfBound(Results);
+			                }
+		                });
+	      });
+}
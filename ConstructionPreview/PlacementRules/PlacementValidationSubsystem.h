@@ -0,0 +1,216 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PlacementPolicies.h"
+#include "Misc/ScopeRWLock.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/ObjectKey.h"
+
+#include "PlacementValidationSubsystem.generated.h"
+
+/** One location to validate with UPlacementValidationSubsystem::ValidatePlacementsAsync. */
+struct FPlacementQuery
+{
+	// The mesh of the building; needs to be kept alive by the caller while the query runs.
+	const UStaticMesh* Mesh = nullptr;
+
+	// Pivot and rotation of the building.
+	FTransform Transform;
+
+	// Location of the building that places the building.
+	FVector HostLocation = FVector::ZeroVector;
+
+	// How far the building can be placed from the host; zero or less means no limit.
+	float BuildRadius = 0.f;
+
+	EPlacementCategory Category = EPlacementCategory::PC_Expansion;
+};
+
+/**
+ * A query of which the footprint was resolved on the game thread with UPlacementValidationSubsystem::ResolveQuery;
+ * holds no UObjects so it can be validated on any thread.
+ */
+struct FResolvedPlacementQuery
+{
+	PlacementRules::FPlacementFootprint Footprint;
+
+	FTransform Transform;
+
+	FVector HostLocation = FVector::ZeroVector;
+
+	float BuildRadius = 0.f;
+
+	EPlacementCategory Category = EPlacementCategory::PC_Expansion;
+};
+
+struct FPlacementQueryResult
+{
+	bool bIsValid = false;
+
+	bool bIsSlopeValid = false;
+
+	// The slope that was compared against DegreesAllowedOnHill.
+	float SlopeAngle = 0.f;
+};
+
+DECLARE_DELEGATE_OneParam(FOnPlacementsValidated, const TArray<FPlacementQueryResult>& /*Results*/);
+
+/**
+ * @brief Gives worker threads access to the world of a UPlacementValidationSubsystem until the world is cleaned up.
+ * Worker jobs keep a shared reference and run their scene queries through WithWorld; the subsystem revokes the guard
+ * on the game thread when the world is cleaned up, which waits for the queries that are in flight.
+ */
+class RTS_SURVIVAL_API FPlacementWorldGuard
+{
+public:
+	explicit FPlacementWorldGuard(const UWorld* InWorld)
+		: M_World(InWorld)
+	{
+	}
+
+	/**
+	 * @brief Calls Func with the world if it was not cleaned up yet.
+	 * @param Func Performs the scene queries; blocks the cleanup of the world while it runs so keep it short.
+	 * @return false if the world was cleaned up, Func is not called then.
+	 * @note Thread safe; do not call WithWorld from within Func.
+	 */
+	template <typename FuncType>
+	bool WithWorld(FuncType&& Func) const
+	{
+		FReadScopeLock ReadLock(M_Lock);
+		if (!M_World)
+		{
+			return false;
+		}
+		Func(*M_World);
+		return true;
+	}
+
+	/** @return Whether the world was cleaned up. */
+	bool IsRevoked() const
+	{
+		FReadScopeLock ReadLock(M_Lock);
+		return M_World == nullptr;
+	}
+
+	/** @brief Called on the game thread before the world is cleaned up; waits for running WithWorld calls. */
+	void Revoke()
+	{
+		FWriteScopeLock WriteLock(M_Lock);
+		M_World = nullptr;
+	}
+
+private:
+	// Only dereferenced under M_Lock; null once revoked.
+	const UWorld* M_World;
+
+	mutable FRWLock M_Lock;
+};
+
+/**
+ * @brief Validates building placement without a construction preview actor.
+ * Footprints of meshes are extracted once on the game thread and cached; a validation only reads the footprint and
+ * performs scene queries so batches run on worker threads, e.g. for AI base planners or server side validation.
+ * @note Validation without a preview tests the box footprint of the mesh for overlaps instead of the preview's
+ * component overlaps.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UPlacementValidationSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	/**
+	 * @return The guard through which worker jobs perform scene queries in this world.
+	 * @note Call on the game thread when the job is started.
+	 */
+	TSharedRef<const FPlacementWorldGuard, ESPMode::ThreadSafe> GetWorldGuard() const
+	{
+		return M_WorldGuard.ToSharedRef();
+	}
+
+	/**
+	 * @brief Returns the cached footprint of the mesh, extracts and caches it on the first request.
+	 * @param Mesh The mesh to get the footprint of.
+	 * @return A copy of the footprint; a copy as the cache can grow while the caller uses it.
+	 * @note Call on the game thread; extracting a footprint reads the bounds and sockets of the mesh.
+	 */
+	PlacementRules::FPlacementFootprint GetFootprint(const UStaticMesh* Mesh);
+
+	/**
+	 * @brief Validates a single placement.
+	 * @param Mesh The mesh of the building.
+	 * @param Transform Pivot and rotation of the building.
+	 * @param HostLocation Location of the building that places the building.
+	 * @param BuildRadius How far the building can be placed from the host; zero or less means no limit.
+	 * @param Category Selects the placement rules.
+	 * @return The validation result, invalid if the mesh is null.
+	 * @note Call on the game thread, see GetFootprint.
+	 */
+	FPlacementQueryResult ValidatePlacement(
+		const UStaticMesh* Mesh,
+		const FTransform& Transform,
+		const FVector& HostLocation,
+		const float BuildRadius,
+		const EPlacementCategory Category = EPlacementCategory::PC_Expansion);
+
+	/**
+	 * @brief Resolves the footprint of the query so it can be validated on a worker thread.
+	 * @param Query The placement to resolve.
+	 * @param OutResolved The query with the footprint of its mesh.
+	 * @return false if the query has no mesh.
+	 * @note Call on the game thread, see GetFootprint.
+	 */
+	bool ResolveQuery(const FPlacementQuery& Query, FResolvedPlacementQuery& OutResolved);
+
+	/**
+	 * @brief Validates the queries one after another on the calling thread.
+	 * @param WorldGuard The guard of the world to validate in, see GetWorldGuard.
+	 * @param Queries The placements to validate, resolved with ResolveQuery.
+	 * @param OutResults One result per query, in the same order; all invalid if the world was cleaned up.
+	 * @note Thread safe, meant for worker jobs that batch placements.
+	 */
+	static void ValidateResolvedPlacements(
+		const FPlacementWorldGuard& WorldGuard,
+		TConstArrayView<FResolvedPlacementQuery> Queries,
+		TArray<FPlacementQueryResult>& OutResults);
+
+	/**
+	 * @brief Validates all queries on a worker thread without blocking the caller.
+	 * @param Queries The placements to validate; the footprints are resolved before this returns.
+	 * @param OnValidated Called on the game thread with one result per query, in the same order. Not called if the
+	 * world is cleaned up first.
+	 * @note Call on the game thread.
+	 */
+	void ValidatePlacementsAsync(TConstArrayView<FPlacementQuery> Queries, FOnPlacementsValidated OnValidated);
+
+private:
+	/**
+	 * @brief Validates a placement with an already extracted footprint.
+	 * @note Thread safe as long as the world is not cleaned up, only performs scene queries.
+	 */
+	static FPlacementQueryResult ValidateWithFootprint(
+		const UWorld& World,
+		const PlacementRules::FPlacementFootprint& Footprint,
+		const FTransform& Transform,
+		const FVector& HostLocation,
+		const float BuildRadius,
+		const EPlacementCategory Category);
+
+	// Footprints mapped by mesh; guarded by M_FootprintCacheLock.
+	TMap<TObjectKey<UStaticMesh>, PlacementRules::FPlacementFootprint> M_FootprintCache;
+
+	mutable FRWLock M_FootprintCacheLock;
+
+	// Created in Initialize, revoked once the world is cleaned up.
+	TSharedPtr<FPlacementWorldGuard, ESPMode::ThreadSafe> M_WorldGuard;
+
+	FDelegateHandle M_WorldCleanupHandle;
+
+	void OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources);
+};
@@ -3,7 +3,25 @@
 
 #include "AINomadicVehicle.h"
 
+#include "BehaviorTree/BehaviorTree.h"
+#include "BehaviorTree/BehaviorTreeComponent.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/BlackboardData.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Bool.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Class.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Enum.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Float.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Int.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Name.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Rotator.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_String.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
 #include "BuildingCreationTask/Task_CreateBuilding.h"
+#include "ConstructionMove/NomadicConstructionMoveSubsystem.h"
+#include "Navigation/PathFollowingComponent.h"
+#include "Perception/AIPerceptionComponent.h"
+#include "RTS_Survival/DeveloperSettings.h"
 #include "RTS_Survival/Utils/HFunctionLibary.h"
 
 
@@ -27,3 +45,223 @@ void AAINomadicVehicle::BeginPlay()
 	Super::BeginPlay();
 	
 }
+
+void AAINomadicVehicle::MoveToBuildingLocationBatched()
+{
+	if (UNomadicConstructionMoveSubsystem* MoveSubsystem = GetWorld()->GetSubsystem<UNomadicConstructionMoveSubsystem>())
+	{
+		MoveSubsystem->RequestConstructionMove(this);
+	}
+	else
+	{
+		MoveToLocation(M_BuildingLocation, ConstructionAcceptanceRad);
+	}
+}
+
+void AAINomadicVehicle::OnConstructionPathReady(FNavPathSharedPtr Path, const bool bSuccess)
+{
+	if (!bSuccess || !Path.IsValid())
+	{
+		if (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+		{
+			RTSFunctionLibrary::PrintString("Batched construction path failed, regular move request for: " + GetName());
+		}
+		MoveToLocation(M_BuildingLocation, ConstructionAcceptanceRad);
+		return;
+	}
+	FAIMoveRequest MoveRequest(M_BuildingLocation);
+	MoveRequest.SetAcceptanceRadius(ConstructionAcceptanceRad);
+	MoveRequest.SetUsePathfinding(true);
+	RequestMove(MoveRequest, Path);
+}
+
+void AAINomadicVehicle::EnterDormantAIMode()
+{
+	if (bM_IsAIDormant)
+	{
+		return;
+	}
+	if (const UBehaviorTreeComponent* BehaviorTreeComponent = Cast<UBehaviorTreeComponent>(BrainComponent))
+	{
+		M_DormantBehaviourTree = BehaviorTreeComponent->GetRootTree();
+	}
+	CacheBlackboardState();
+	StopBehaviourTree();
+	if (UNomadicConstructionMoveSubsystem* MoveSubsystem = GetWorld()->GetSubsystem<UNomadicConstructionMoveSubsystem>())
+	{
+		MoveSubsystem->CancelConstructionMove(this);
+	}
+	SetAIComponentsRegistered(false);
+	bM_IsAIDormant = true;
+	if (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+	{
+		RTSFunctionLibrary::PrintString("AI went dormant: " + GetName());
+	}
+}
+
+void AAINomadicVehicle::ExitDormantAIMode()
+{
+	if (!bM_IsAIDormant)
+	{
+		return;
+	}
+	bM_IsAIDormant = false;
+	SetAIComponentsRegistered(true);
+	// The tree has to start on the restored values, so the blackboard is set up and filled first; RunBehaviorTree
+	// keeps a blackboard that is already compatible with the tree.
+	UBlackboardComponent* BlackboardComponent = GetBlackboardComponent();
+	if (M_DormantBehaviourTree && M_DormantBehaviourTree->BlackboardAsset)
+	{
+		UseBlackboard(M_DormantBehaviourTree->BlackboardAsset, BlackboardComponent);
+	}
+	RestoreBlackboardState();
+	if (M_DormantBehaviourTree)
+	{
+		RunBehaviorTree(M_DormantBehaviourTree);
+	}
+	else if (BrainComponent)
+	{
+		BrainComponent->RestartLogic();
+	}
+	M_DormantBehaviourTree = nullptr;
+	M_DormantBlackboardState.Reset();
+	if (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+	{
+		RTSFunctionLibrary::PrintString("AI woke up from dormant mode: " + GetName());
+	}
+}
+
+void AAINomadicVehicle::CacheBlackboardState()
+{
+	M_DormantBlackboardState.Reset();
+	const UBlackboardComponent* BlackboardComponent = GetBlackboardComponent();
+	if (!BlackboardComponent || !BlackboardComponent->GetBlackboardAsset())
+	{
+		return;
+	}
+	for (const UBlackboardData* Data = BlackboardComponent->GetBlackboardAsset(); Data; Data = Data->Parent)
+	{
+		for (const FBlackboardEntry& Entry : Data->Keys)
+		{
+			const UBlackboardKeyType* KeyType = Entry.KeyType;
+			const FName& Key = Entry.EntryName;
+			if (KeyType->IsA<UBlackboardKeyType_Vector>())
+			{
+				M_DormantBlackboardState.VectorValues.Add(Key, BlackboardComponent->GetValueAsVector(Key));
+			}
+			else if (KeyType->IsA<UBlackboardKeyType_Rotator>())
+			{
+				M_DormantBlackboardState.RotatorValues.Add(Key, BlackboardComponent->GetValueAsRotator(Key));
+			}
+			else if (KeyType->IsA<UBlackboardKeyType_Object>())
+			{
+				M_DormantBlackboardState.ObjectValues.Add(Key, BlackboardComponent->GetValueAsObject(Key));
+			}
+			else if (KeyType->IsA<UBlackboardKeyType_Float>())
+			{
+				M_DormantBlackboardState.FloatValues.Add(Key, BlackboardComponent->GetValueAsFloat(Key));
+			}
+			else if (KeyType->IsA<UBlackboardKeyType_Int>())
+			{
+				M_DormantBlackboardState.IntValues.Add(Key, BlackboardComponent->GetValueAsInt(Key));
+			}
+			else if (KeyType->IsA<UBlackboardKeyType_Enum>())
+			{
+				M_DormantBlackboardState.EnumValues.Add(Key, BlackboardComponent->GetValueAsEnum(Key));
+			}
+			else if (KeyType->IsA<UBlackboardKeyType_Name>())
+			{
+				M_DormantBlackboardState.NameValues.Add(Key, BlackboardComponent->GetValueAsName(Key));
+			}
+			else if (KeyType->IsA<UBlackboardKeyType_Bool>())
+			{
+				M_DormantBlackboardState.BoolValues.Add(Key, BlackboardComponent->GetValueAsBool(Key));
+			}
+			else if (KeyType->IsA<UBlackboardKeyType_Class>())
+			{
+				M_DormantBlackboardState.ClassValues.Add(Key, BlackboardComponent->GetValueAsClass(Key));
+			}
+			else if (KeyType->IsA<UBlackboardKeyType_String>())
+			{
+				M_DormantBlackboardState.StringValues.Add(Key, BlackboardComponent->GetValueAsString(Key));
+			}
+		}
+	}
+}
+
+void AAINomadicVehicle::RestoreBlackboardState()
+{
+	UBlackboardComponent* BlackboardComponent = GetBlackboardComponent();
+	if (!BlackboardComponent)
+	{
+		return;
+	}
+	for (const TPair<FName, FVector>& Pair : M_DormantBlackboardState.VectorValues)
+	{
+		BlackboardComponent->SetValueAsVector(Pair.Key, Pair.Value);
+	}
+	for (const TPair<FName, FRotator>& Pair : M_DormantBlackboardState.RotatorValues)
+	{
+		BlackboardComponent->SetValueAsRotator(Pair.Key, Pair.Value);
+	}
+	for (const TPair<FName, TWeakObjectPtr<UObject>>& Pair : M_DormantBlackboardState.ObjectValues)
+	{
+		BlackboardComponent->SetValueAsObject(Pair.Key, Pair.Value.Get());
+	}
+	for (const TPair<FName, float>& Pair : M_DormantBlackboardState.FloatValues)
+	{
+		BlackboardComponent->SetValueAsFloat(Pair.Key, Pair.Value);
+	}
+	for (const TPair<FName, int32>& Pair : M_DormantBlackboardState.IntValues)
+	{
+		BlackboardComponent->SetValueAsInt(Pair.Key, Pair.Value);
+	}
+	for (const TPair<FName, uint8>& Pair : M_DormantBlackboardState.EnumValues)
+	{
+		BlackboardComponent->SetValueAsEnum(Pair.Key, Pair.Value);
+	}
+	for (const TPair<FName, FName>& Pair : M_DormantBlackboardState.NameValues)
+	{
+		BlackboardComponent->SetValueAsName(Pair.Key, Pair.Value);
+	}
+	for (const TPair<FName, bool>& Pair : M_DormantBlackboardState.BoolValues)
+	{
+		BlackboardComponent->SetValueAsBool(Pair.Key, Pair.Value);
+	}
+	for (const TPair<FName, TWeakObjectPtr<UClass>>& Pair : M_DormantBlackboardState.ClassValues)
+	{
+		BlackboardComponent->SetValueAsClass(Pair.Key, Pair.Value.Get());
+	}
+	for (const TPair<FName, FString>& Pair : M_DormantBlackboardState.StringValues)
+	{
+		BlackboardComponent->SetValueAsString(Pair.Key, Pair.Value);
+	}
+}
+
+void AAINomadicVehicle::SetAIComponentsRegistered(const bool bRegister)
+{
+	UActorComponent* AIComponents[] = {
+		BrainComponent.Get(),
+		GetBlackboardComponent(),
+		GetAIPerceptionComponent(),
+		GetPathFollowingComponent()
+	};
+	for (UActorComponent* Component : AIComponents)
+	{
+		if (!Component)
+		{
+			continue;
+		}
+		// Unregistering also removes the perception listener from the perception system.
+		if (bRegister && !Component->IsRegistered())
+		{
+			Component->RegisterComponent();
+			Component->SetComponentTickEnabled(true);
+		}
+		else if (!bRegister && Component->IsRegistered())
+		{
+			Component->SetComponentTickEnabled(false);
+			Component->UnregisterComponent();
+		}
+	}
+}
@@ -3,10 +3,42 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "NavigationData.h"
 #include "RTS_Survival/Units/Tanks/WheeledTank/AIChaosTank.h"
 
 #include "AINomadicVehicle.generated.h"
 
+class UBehaviorTree;
+
+/** Blackboard values of a dormant nomadic AI, restored when the AI wakes up. */
+struct FDormantBlackboardState
+{
+	TMap<FName, FVector> VectorValues;
+	TMap<FName, FRotator> RotatorValues;
+	TMap<FName, TWeakObjectPtr<UObject>> ObjectValues;
+	TMap<FName, float> FloatValues;
+	TMap<FName, int32> IntValues;
+	TMap<FName, uint8> EnumValues;
+	TMap<FName, FName> NameValues;
+	TMap<FName, bool> BoolValues;
+	TMap<FName, TWeakObjectPtr<UClass>> ClassValues;
+	TMap<FName, FString> StringValues;
+
+	void Reset()
+	{
+		VectorValues.Reset();
+		RotatorValues.Reset();
+		ObjectValues.Reset();
+		FloatValues.Reset();
+		IntValues.Reset();
+		EnumValues.Reset();
+		NameValues.Reset();
+		BoolValues.Reset();
+		ClassValues.Reset();
+		StringValues.Reset();
+	}
+};
+
 UCLASS()
 class RTS_SURVIVAL_API AAINomadicVehicle : public AAIChaosTank
 {
@@ -18,6 +50,23 @@ public:
 
 	void StopBehaviourTree();
 
+	/**
+	 * @brief Puts the AI in dormant mode for as long as the truck is a building.
+	 * Stops the behaviour tree and unregisters the behaviour tree, blackboard, perception and path following
+	 * components so none of them tick or are listed in the perception system.
+	 * @post The blackboard values and the running behaviour tree asset are cached to be restored on wake up.
+	 */
+	void EnterDormantAIMode();
+
+	/**
+	 * @brief Wakes the AI from dormant mode; re-registers the components, restores the cached blackboard values
+	 * and then restarts the behaviour tree that was running before, so the tree starts on the restored values.
+	 * @note Does nothing if the AI is not dormant.
+	 */
+	void ExitDormantAIMode();
+
+	inline bool GetIsAIDormant() const { return bM_IsAIDormant; }
+
 	UFUNCTION(BlueprintCallable, NotBlueprintable)
 	inline FVector GetBuildingLocation() const {return M_BuildingLocation;};
 
@@ -26,6 +75,20 @@ public:
 
 	inline float GetConstructionAcceptanceRad() const {return ConstructionAcceptanceRad;};
 
+	/**
+	 * @brief Requests a path to M_BuildingLocation from the construction move subsystem.
+	 * The path is batched with the paths of other trucks that deploy in the same frame.
+	 * @post OnConstructionPathReady is called once the path is found.
+	 */
+	void MoveToBuildingLocationBatched();
+
+	/**
+	 * @brief Called by the construction move subsystem when the path to the building location is known.
+	 * @param Path The path to follow, can be a corridor shared with other trucks.
+	 * @param bSuccess Whether a path was found, if not we fall back to a regular move request.
+	 */
+	void OnConstructionPathReady(FNavPathSharedPtr Path, const bool bSuccess);
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
@@ -38,5 +101,25 @@ private:
 	// Location to place the building; needed in behaviour tree.
 	UPROPERTY()
 	FVector M_BuildingLocation;
+
+	bool bM_IsAIDormant = false;
+
+	// The behaviour tree that was running when the AI went dormant.
+	UPROPERTY()
+	TObjectPtr<UBehaviorTree> M_DormantBehaviourTree;
+
+	FDormantBlackboardState M_DormantBlackboardState;
+
+	/** @brief Copies all blackboard values to M_DormantBlackboardState. */
+	void CacheBlackboardState();
+
+	/** @brief Writes the values of M_DormantBlackboardState back to the blackboard. */
+	void RestoreBlackboardState();
+
+	/**
+	 * @brief Registers or unregisters the AI components that tick or are listed in AI systems.
+	 * @param bRegister Whether to register the components.
+	 */
+	void SetAIComponentsRegistered(const bool bRegister);
 };
  
\ No newline at end of file
@@ -0,0 +1,285 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "NomadicBasePlannerSubsystem.h"
+
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/Player/ConstructionPreview/PlacementRules/PlacementValidationSubsystem.h"
+#include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/AINomadicVehicle.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+namespace NomadicBasePlanner
+{
+	/** @return Value scaled to [0, 1] between Min and Max; 1 if all values are equal. */
+	float Normalize(const float Value, const float Min, const float Max)
+	{
+		return Max - Min > KINDA_SMALL_NUMBER ? (Value - Min) / (Max - Min) : 1.f;
+	}
+}
+
+/** Everything the worker threads need, copied on the game thread. */
+struct UNomadicBasePlannerSubsystem::FBasePlanJob
+{
+	// The workers only perform scene queries through the guard, never while the world is cleaned up.
+	TSharedPtr<const FPlacementWorldGuard, ESPMode::ThreadSafe> WorldGuard;
+	FVector TruckLocation = FVector::ZeroVector;
+	FVector RegionCentre = FVector::ZeroVector;
+	float RegionRadius = 0.f;
+	FQuat BuildingRotation = FQuat::Identity;
+	PlacementRules::FPlacementFootprint BuildingFootprint;
+	PlacementPolicies::FPlacementValidatorFn BuildingValidator = nullptr;
+	TArray<PlacementRules::FPlacementFootprint> ExpansionFootprints;
+	TArray<PlacementPolicies::FPlacementValidatorFn> ExpansionValidators;
+	float ExpansionBuildRadius = 0.f;
+	TArray<FVector> ThreatLocations;
+};
+
+void UNomadicBasePlannerSubsystem::PlanBuildingSite(
+	AAINomadicVehicle* NomadicAI,
+	const FNomadicBasePlanRequest& Request,
+	FOnBasePlanFinished OnFinished)
+{
+	UWorld* World = GetWorld();
+	if (!IsValid(NomadicAI) || !Request.BuildingMesh || !World)
+	{
+		RTSFunctionLibrary::ReportError(
+			"Attempt to plan a building site without nomadic AI or building mesh!"
+			"\n At function PlanBuildingSite in NomadicBasePlannerSubsystem.cpp");
+		return;
+	}
+	UPlacementValidationSubsystem* PlacementValidation = World->GetSubsystem<UPlacementValidationSubsystem>();
+
+	FBasePlanJob Job;
+	Job.WorldGuard = PlacementValidation->GetWorldGuard();
+	Job.TruckLocation = NomadicAI->GetPawn() ? NomadicAI->GetPawn()->GetActorLocation() : Request.RegionCentre;
+	Job.RegionCentre = Request.RegionCentre;
+	Job.RegionRadius = Request.RegionRadius;
+	Job.BuildingRotation = Request.BuildingRotation.Quaternion();
+	Job.BuildingFootprint = PlacementValidation->GetFootprint(Request.BuildingMesh);
+	Job.BuildingValidator = PlacementPolicies::GetValidator(EPlacementCategory::PC_NomadicHQ,
+	                                                        Job.BuildingFootprint, false);
+	for (const UStaticMesh* ExpansionMesh : Request.DesiredExpansions)
+	{
+		if (ExpansionMesh)
+		{
+			const PlacementRules::FPlacementFootprint& Footprint =
+				Job.ExpansionFootprints.Add_GetRef(PlacementValidation->GetFootprint(ExpansionMesh));
+			Job.ExpansionValidators.Add(
+				PlacementPolicies::GetValidator(EPlacementCategory::PC_Expansion, Footprint, false));
+		}
+	}
+	Job.ExpansionBuildRadius = Request.ExpansionBuildRadius;
+	Job.ThreatLocations = Request.ThreatLocations;
+
+	const uint32 PlanId = M_NextPlanId++;
+	PruneDestroyedPlans();
+	M_LatestPlanIds.Add(NomadicAI, PlanId);
+
+	TWeakObjectPtr<UNomadicBasePlannerSubsystem> WeakThis(this);
+	TWeakObjectPtr<AAINomadicVehicle> WeakNomadicAI(NomadicAI);
+	Async(EAsyncExecution::TaskGraph,
+	      [Job = MoveTemp(Job), WeakThis, WeakNomadicAI, PlanId, OnFinished = MoveTemp(OnFinished)]()
+	      {
+		      FVector BestSite;
+		      const bool bFoundSite = EvaluateCandidates(Job, BestSite);
+		      // Write the result back on the game thread.
+		      AsyncTask(ENamedThreads::GameThread,
+		                [WeakThis, WeakNomadicAI, PlanId, bFoundSite, BestSite, OnFinished]()
+		                {
+			                if (UNomadicBasePlannerSubsystem* Planner = WeakThis.Get())
+			                {
+				                Planner->OnPlanFinished(WeakNomadicAI, PlanId, bFoundSite, BestSite, OnFinished);
+			                }
+		                });
+	      });
+}
+
+void UNomadicBasePlannerSubsystem::CancelPlan(const AAINomadicVehicle* NomadicAI)
+{
+	M_LatestPlanIds.Remove(NomadicAI);
+}
+
+void UNomadicBasePlannerSubsystem::PruneDestroyedPlans()
+{
+	for (auto It = M_LatestPlanIds.CreateIterator(); It; ++It)
+	{
+		if (!It.Key().IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+bool UNomadicBasePlannerSubsystem::EvaluateCandidates(const FBasePlanJob& Job, FVector& OutBestSite)
+{
+	// Vogel spiral: evenly spread candidates over the disc of the region.
+	TArray<FVector> Candidates;
+	Candidates.Reserve(NumCandidateSites);
+	constexpr float GoldenAngle = UE_PI * (3.f - 2.2360679775f);
+	for (int32 i = 0; i < NumCandidateSites; ++i)
+	{
+		const float Radius = Job.RegionRadius * FMath::Sqrt((i + 0.5f) / NumCandidateSites);
+		const float Angle = i * GoldenAngle;
+		Candidates.Add(Job.RegionCentre + FVector(Radius * FMath::Cos(Angle), Radius * FMath::Sin(Angle), 0.f));
+	}
+
+	TArray<FCandidateMetrics> Metrics;
+	Metrics.SetNum(Candidates.Num());
+	std::atomic<bool> bWorldCleanedUp = false;
+	ParallelFor(Candidates.Num(), [&Job, &Candidates, &Metrics, &bWorldCleanedUp](const int32 Index)
+	{
+		// One candidate per guarded call so a world cleanup waits for at most one measurement per worker.
+		const bool bWorldIsAlive = Job.WorldGuard->WithWorld(
+			[&Job, &Candidate = Candidates[Index], &Result = Metrics[Index]](const UWorld& World)
+			{
+				Result = MeasureCandidate(Job, World, Candidate);
+			});
+		if (!bWorldIsAlive)
+		{
+			bWorldCleanedUp = true;
+		}
+	});
+	if (bWorldCleanedUp)
+	{
+		// Nobody waits for the result anymore.
+		return false;
+	}
+
+	// Normalise the measurements over the valid candidates so the weights are independent of the region size.
+	float MinDistance = TNumericLimits<float>::Max(), MaxDistance = 0.f;
+	float MinHeight = TNumericLimits<float>::Max(), MaxHeight = TNumericLimits<float>::Lowest();
+	float MinThreatDistance = TNumericLimits<float>::Max(), MaxThreatDistance = 0.f;
+	bool bAnyValid = false;
+	for (const FCandidateMetrics& Candidate : Metrics)
+	{
+		if (!Candidate.bIsValid)
+		{
+			continue;
+		}
+		bAnyValid = true;
+		MinDistance = FMath::Min(MinDistance, Candidate.TravelDistance);
+		MaxDistance = FMath::Max(MaxDistance, Candidate.TravelDistance);
+		MinHeight = FMath::Min(MinHeight, static_cast<float>(Candidate.Site.Z));
+		MaxHeight = FMath::Max(MaxHeight, static_cast<float>(Candidate.Site.Z));
+		MinThreatDistance = FMath::Min(MinThreatDistance, Candidate.ThreatDistance);
+		MaxThreatDistance = FMath::Max(MaxThreatDistance, Candidate.ThreatDistance);
+	}
+	if (!bAnyValid)
+	{
+		return false;
+	}
+
+	float BestScore = TNumericLimits<float>::Lowest();
+	for (const FCandidateMetrics& Candidate : Metrics)
+	{
+		if (!Candidate.bIsValid)
+		{
+			continue;
+		}
+		using namespace NomadicBasePlanner;
+		float Score = SlopeWeight * (1.f - Candidate.SlopeAngle /
+				DeveloperSettings::GamePlay::Construction::DegreesAllowedOnHill)
+			+ ExpansionRoomWeight * Candidate.ExpansionRoom
+			- DistanceWeight * Normalize(Candidate.TravelDistance, MinDistance, MaxDistance)
+			+ ElevationWeight * Normalize(static_cast<float>(Candidate.Site.Z), MinHeight, MaxHeight);
+		if (!Job.ThreatLocations.IsEmpty())
+		{
+			Score += ThreatDistanceWeight * Normalize(Candidate.ThreatDistance, MinThreatDistance, MaxThreatDistance);
+		}
+		if (Score > BestScore)
+		{
+			BestScore = Score;
+			OutBestSite = Candidate.Site;
+		}
+	}
+	return true;
+}
+
+UNomadicBasePlannerSubsystem::FCandidateMetrics UNomadicBasePlannerSubsystem::MeasureCandidate(
+	const FBasePlanJob& Job,
+	const UWorld& World,
+	const FVector& Candidate)
+{
+	FCandidateMetrics Metrics;
+	if (!PlacementRules::ProjectSiteToGround(&World, Candidate, Metrics.Site))
+	{
+		return Metrics;
+	}
+
+	FPlacementContext Context;
+	Context.World = &World;
+	Context.Footprint = &Job.BuildingFootprint;
+	Context.Transform = FTransform(Job.BuildingRotation, Metrics.Site);
+	Metrics.bIsValid = Job.BuildingValidator(Context);
+	if (!Metrics.bIsValid)
+	{
+		return Metrics;
+	}
+	Metrics.SlopeAngle = Context.SlopeAngle;
+	Metrics.TravelDistance = FVector::Dist2D(Job.TruckLocation, Metrics.Site);
+	Metrics.ThreatDistance = TNumericLimits<float>::Max();
+	for (const FVector& ThreatLocation : Job.ThreatLocations)
+	{
+		Metrics.ThreatDistance = FMath::Min(Metrics.ThreatDistance, FVector::Dist2D(ThreatLocation, Metrics.Site));
+	}
+
+	// Probe each desired expansion just outside the building footprint.
+	int32 NumValidProbes = 0;
+	const int32 NumProbes = Job.ExpansionFootprints.Num() * ExpansionProbesPerExpansion;
+	for (int32 ExpansionIndex = 0; ExpansionIndex < Job.ExpansionFootprints.Num(); ++ExpansionIndex)
+	{
+		const PlacementRules::FPlacementFootprint& ExpansionFootprint = Job.ExpansionFootprints[ExpansionIndex];
+		const float ProbeDistance = Job.BuildingFootprint.Radius + ExpansionFootprint.Radius +
+			DeveloperSettings::GamePlay::Construction::GridSnapSize;
+		FPlacementContext ProbeContext;
+		ProbeContext.World = &World;
+		ProbeContext.Footprint = &ExpansionFootprint;
+		ProbeContext.HostLocation = Metrics.Site;
+		ProbeContext.BuildRadius = Job.ExpansionBuildRadius;
+		for (int32 Probe = 0; Probe < ExpansionProbesPerExpansion; ++Probe)
+		{
+			// Offset every expansion by half a step so different expansions probe different directions.
+			const float Angle = (Probe + 0.5f * (ExpansionIndex % 2)) * UE_TWO_PI / ExpansionProbesPerExpansion;
+			ProbeContext.Transform = FTransform(
+				Metrics.Site + ProbeDistance * FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.f));
+			if (Job.ExpansionValidators[ExpansionIndex](ProbeContext))
+			{
+				++NumValidProbes;
+			}
+		}
+	}
+	Metrics.ExpansionRoom = NumProbes > 0 ? static_cast<float>(NumValidProbes) / NumProbes : 1.f;
+	return Metrics;
+}
+
+void UNomadicBasePlannerSubsystem::OnPlanFinished(
+	TWeakObjectPtr<AAINomadicVehicle> NomadicAI,
+	const uint32 PlanId,
+	const bool bFoundSite,
+	const FVector& BuildingLocation,
+	const FOnBasePlanFinished& OnFinished)
+{
+	const uint32* LatestPlanId = M_LatestPlanIds.Find(NomadicAI);
+	if (!LatestPlanId || *LatestPlanId != PlanId)
+	{
+		// Cancelled or replaced by a newer plan.
+		return;
+	}
+	M_LatestPlanIds.Remove(NomadicAI);
+	if (!NomadicAI.IsValid())
+	{
+		return;
+	}
+	if (bFoundSite)
+	{
+		NomadicAI->SetBuildingLocation(BuildingLocation);
+	}
+	else if constexpr (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+	{
+		RTSFunctionLibrary::PrintString("No valid building site found in the planned region", FColor::Red);
+	}
+	OnFinished.ExecuteIfBound(bFoundSite, BuildingLocation);
+}
@@ -0,0 +1,118 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+
+#include "NomadicBasePlannerSubsystem.generated.h"
+
+class AAINomadicVehicle;
+class UStaticMesh;
+
+/** What the AI wants to build and where it wants to build it. */
+struct FNomadicBasePlanRequest
+{
+	// The mesh of the building the truck converts into.
+	UStaticMesh* BuildingMesh = nullptr;
+
+	// The expansions the AI wants to place around the building, used to score the room around a site.
+	TArray<UStaticMesh*> DesiredExpansions;
+
+	// Build radius of the building; the desired expansions need to fit within it.
+	float ExpansionBuildRadius = 0.f;
+
+	// Centre of the region in which sites are sampled.
+	FVector RegionCentre = FVector::ZeroVector;
+
+	float RegionRadius = 0.f;
+
+	FRotator BuildingRotation = FRotator::ZeroRotator;
+
+	// Locations the base should be defended against, e.g. known enemy bases; sites further away score higher.
+	TArray<FVector> ThreatLocations;
+};
+
+DECLARE_DELEGATE_TwoParams(FOnBasePlanFinished, const bool /*bFoundSite*/, const FVector& /*BuildingLocation*/);
+
+/**
+ * @brief Chooses the building site of AI nomadic trucks.
+ * Candidate sites are sampled in the requested region and scored on worker threads on:
+ * - Validity: slope and overlap with the placement rules of the construction preview (hard requirement).
+ * - Slope: flatter terrain scores higher.
+ * - Expansion room: how many of the desired expansions fit around the site.
+ * - Distance: the travel distance of the truck.
+ * - Defensive value: elevation relative to the other candidates and distance to the threats.
+ * The best site is written to the truck with AAINomadicVehicle::SetBuildingLocation on the game thread.
+ * @note All mesh data is copied on the game thread; the workers only perform scene queries through the
+ * FPlacementWorldGuard of the world.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UNomadicBasePlannerSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Starts planning the building site of the truck; replaces a plan that is still running for it.
+	 * @param NomadicAI The AI of the truck to plan for.
+	 * @param Request What to build and where.
+	 * @param OnFinished Optional, called on the game thread after the building location was set.
+	 */
+	void PlanBuildingSite(
+		AAINomadicVehicle* NomadicAI,
+		const FNomadicBasePlanRequest& Request,
+		FOnBasePlanFinished OnFinished = FOnBasePlanFinished());
+
+	/** @brief Discards the result of a running plan of the truck. */
+	void CancelPlan(const AAINomadicVehicle* NomadicAI);
+
+private:
+	// Number of candidate sites sampled in the region.
+	static constexpr int32 NumCandidateSites = 128;
+
+	// Number of directions around a site in which each desired expansion is probed.
+	static constexpr int32 ExpansionProbesPerExpansion = 8;
+
+	static constexpr float SlopeWeight = 1.f;
+	static constexpr float ExpansionRoomWeight = 2.f;
+	static constexpr float DistanceWeight = 1.f;
+	static constexpr float ElevationWeight = 0.5f;
+	static constexpr float ThreatDistanceWeight = 1.f;
+
+	/** The raw measurements of a candidate, normalised into a score once all candidates are known. */
+	struct FCandidateMetrics
+	{
+		FVector Site = FVector::ZeroVector;
+		bool bIsValid = false;
+		float SlopeAngle = 0.f;
+		// Fraction of the expansion probes that were valid.
+		float ExpansionRoom = 0.f;
+		float TravelDistance = 0.f;
+		// Distance to the closest threat.
+		float ThreatDistance = 0.f;
+	};
+
+	struct FBasePlanJob;
+
+	// Id of the latest plan per truck; results of older plans are discarded.
+	TMap<TWeakObjectPtr<AAINomadicVehicle>, uint32> M_LatestPlanIds;
+
+	uint32 M_NextPlanId = 1;
+
+	/** @brief Forgets the plans of trucks that were destroyed before their plan finished. */
+	void PruneDestroyedPlans();
+
+	/**
+	 * @brief Runs on a worker thread; measures every candidate in parallel and returns the best valid site.
+	 * @return false if no candidate is valid or the world was cleaned up while measuring.
+	 */
+	static bool EvaluateCandidates(const FBasePlanJob& Job, FVector& OutBestSite);
+
+	/** @brief Measures one candidate site. */
+	static FCandidateMetrics MeasureCandidate(const FBasePlanJob& Job, const UWorld& World, const FVector& Candidate);
+
+	/** @brief Called on the game thread with the result of a plan. */
+	void OnPlanFinished(TWeakObjectPtr<AAINomadicVehicle> NomadicAI, const uint32 PlanId, const bool bFoundSite,
+	                    const FVector& BuildingLocation, const FOnBasePlanFinished& OnFinished);
+};
@@ -0,0 +1,397 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "NomadicBaseProxySubsystem.h"
+
+#include "Camera/PlayerCameraManager.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "GameFramework/PlayerController.h"
+#include "RTS_Survival/Benchmark/RTSBenchmark.h"
+#include "RTS_Survival/Buildings/BuildingExpansion/BuildingExpansion.h"
+#include "RTS_Survival/Buildings/BuildingExpansion/Interface/BuildingExpansionOwner.h"
+#include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/ConversionScheduler/NomadicConversionScheduler.h"
+
+namespace NomadicBaseProxyHelpers
+{
+	/** @brief Collects the expansions that the truck owns. */
+	void GetExpansionsOfTruck(const AActor* Truck, TArray<ABuildingExpansion*>& OutExpansions)
+	{
+		const IBuildingExpansionOwner* BxpOwner = Cast<IBuildingExpansionOwner>(Truck);
+		if (!BxpOwner)
+		{
+			return;
+		}
+		for (ABuildingExpansion* Expansion : BxpOwner->GetBuildingExpansions())
+		{
+			if (IsValid(Expansion))
+			{
+				OutExpansions.Add(Expansion);
+			}
+		}
+	}
+
+	/**
+	 * @brief Adds the world transforms of the visible static meshes of the actor, grouped by mesh.
+	 * @param Actor The actor to merge the meshes of.
+	 * @param OutInstances The transforms per mesh.
+	 * @param OutComponents The components whose meshes were added.
+	 */
+	void CollectMeshInstances(const AActor* Actor, TMap<UStaticMesh*, TArray<FTransform>>& OutInstances,
+	                          TArray<TWeakObjectPtr<UStaticMeshComponent>>& OutComponents)
+	{
+		Actor->ForEachComponent<UStaticMeshComponent>(false, [&OutInstances, &OutComponents](
+		                                              UStaticMeshComponent* Component)
+		{
+			UStaticMesh* Mesh = Component->GetStaticMesh();
+			if (!Mesh || !Component->IsRegistered() || !Component->IsVisible() || Component->bHiddenInGame)
+			{
+				return;
+			}
+			OutComponents.Add(Component);
+			TArray<FTransform>& Transforms = OutInstances.FindOrAdd(Mesh);
+			if (const UInstancedStaticMeshComponent* Instanced = Cast<UInstancedStaticMeshComponent>(Component))
+			{
+				for (int32 Index = 0; Index < Instanced->GetInstanceCount(); ++Index)
+				{
+					FTransform InstanceTransform;
+					if (Instanced->GetInstanceTransform(Index, InstanceTransform, true))
+					{
+						Transforms.Add(InstanceTransform);
+					}
+				}
+				return;
+			}
+			Transforms.Add(Component->GetComponentTransform());
+		});
+	}
+}
+
+void UNomadicBaseProxySubsystem::RegisterBase(AActor* Truck)
+{
+	if (!IsValid(Truck) || !HasLocalPlayer())
+	{
+		return;
+	}
+	if (FindBase(Truck))
+	{
+		OnBaseChanged(Truck);
+		return;
+	}
+	FNomadicBase& Base = M_Bases.AddDefaulted_GetRef();
+	Base.Truck = Truck;
+	Base.IdleTime = GetWorld()->GetTimeSeconds() + IdleSeconds;
+	Truck->OnEndPlay.AddUniqueDynamic(this, &UNomadicBaseProxySubsystem::OnMemberEndPlay);
+}
+
+void UNomadicBaseProxySubsystem::UnregisterBase(AActor* Truck)
+{
+	const int32 Index = M_Bases.IndexOfByPredicate([Truck](const FNomadicBase& Base)
+	{
+		return Base.Truck.Get() == Truck;
+	});
+	if (Index == INDEX_NONE)
+	{
+		return;
+	}
+	ReleaseProxy(M_Bases[Index]);
+	if (IsValid(Truck))
+	{
+		Truck->OnEndPlay.RemoveDynamic(this, &UNomadicBaseProxySubsystem::OnMemberEndPlay);
+	}
+	M_Bases.RemoveAtSwap(Index);
+}
+
+void UNomadicBaseProxySubsystem::OnBaseChanged(AActor* Truck)
+{
+	FNomadicBase* Base = FindBase(Truck);
+	if (!Base)
+	{
+		return;
+	}
+	ReleaseProxy(*Base);
+	Base->IdleTime = GetWorld()->GetTimeSeconds() + IdleSeconds;
+}
+
+void UNomadicBaseProxySubsystem::Deinitialize()
+{
+	// The proxies and the base actors go away with the world.
+	M_Bases.Empty();
+	Super::Deinitialize();
+}
+
+void UNomadicBaseProxySubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	M_TimeSinceDistanceCheck += DeltaTime;
+	if (M_TimeSinceDistanceCheck < DistanceCheckInterval)
+	{
+		return;
+	}
+	M_TimeSinceDistanceCheck = 0.f;
+	if (!HasLocalPlayer())
+	{
+		return;
+	}
+	RTS_BENCHMARK_SCOPE("BaseProxy.Tick");
+
+	FVector CameraLocation;
+	// The camera manager may not exist yet, e.g. right after the local player joined.
+	const bool bHasCamera = GetCameraLocation(CameraLocation);
+	const double Now = GetWorld()->GetTimeSeconds();
+	for (int32 Index = M_Bases.Num() - 1; Index >= 0; --Index)
+	{
+		FNomadicBase& Base = M_Bases[Index];
+		const AActor* Truck = Base.Truck.Get();
+		if (!IsValid(Truck))
+		{
+			ReleaseProxy(Base);
+			M_Bases.RemoveAtSwap(Index);
+			continue;
+		}
+		if (!bHasCamera)
+		{
+			continue;
+		}
+		if (!Base.ProxyActor.IsValid())
+		{
+			if (Now < Base.IdleTime || !IsBaseSettled(Truck))
+			{
+				continue;
+			}
+			BuildProxy(Base);
+		}
+		const double DistanceSquared = FVector::DistSquared(CameraLocation, Truck->GetActorLocation());
+		if (!Base.bIsShowingProxy && DistanceSquared > FMath::Square(ProxyDistance))
+		{
+			SetShowProxy(Base, true);
+		}
+		else if (Base.bIsShowingProxy && DistanceSquared < FMath::Square(RestoreDistance))
+		{
+			SetShowProxy(Base, false);
+		}
+	}
+}
+
+TStatId UNomadicBaseProxySubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UNomadicBaseProxySubsystem, STATGROUP_Tickables);
+}
+
+UNomadicBaseProxySubsystem::FNomadicBase* UNomadicBaseProxySubsystem::FindBase(const AActor* Truck)
+{
+	return M_Bases.FindByPredicate([Truck](const FNomadicBase& Base)
+	{
+		return Base.Truck.Get() == Truck;
+	});
+}
+
+UNomadicBaseProxySubsystem::FNomadicBase* UNomadicBaseProxySubsystem::FindBaseOfActor(const AActor* Actor)
+{
+	return M_Bases.FindByPredicate([Actor](const FNomadicBase& Base)
+	{
+		return Base.Truck.Get() == Actor || Base.Members.Contains(Actor);
+	});
+}
+
+bool UNomadicBaseProxySubsystem::IsBaseSettled(const AActor* Truck) const
+{
+	const UNomadicConversionScheduler* ConversionScheduler = GetWorld()->GetSubsystem<UNomadicConversionScheduler>();
+	if (ConversionScheduler && ConversionScheduler->IsConversionQueued(Truck))
+	{
+		return false;
+	}
+	TArray<ABuildingExpansion*> Expansions;
+	NomadicBaseProxyHelpers::GetExpansionsOfTruck(Truck, Expansions);
+	for (const ABuildingExpansion* Expansion : Expansions)
+	{
+		if (Expansion->GetBuildingExpansionStatus() != EBuildingExpansionStatus::BXS_Built)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void UNomadicBaseProxySubsystem::BuildProxy(FNomadicBase& Base)
+{
+	RTS_BENCHMARK_SCOPE("BaseProxy.Build");
+	AActor* Truck = Base.Truck.Get();
+	TArray<ABuildingExpansion*> Expansions;
+	NomadicBaseProxyHelpers::GetExpansionsOfTruck(Truck, Expansions);
+
+	TArray<AActor*> Members;
+	Members.Add(Truck);
+	Members.Append(Expansions);
+	TMap<UStaticMesh*, TArray<FTransform>> MeshInstances;
+	Base.Members.Reset(Members.Num());
+	Base.MergedMemberComponents.Reset();
+	for (AActor* Member : Members)
+	{
+		// Actors that are hidden by other systems are neither merged nor shown again on restore.
+		if (!IsValid(Member) || Member->IsHidden())
+		{
+			continue;
+		}
+		Base.Members.Add(Member);
+		NomadicBaseProxyHelpers::CollectMeshInstances(Member, MeshInstances, Base.MergedMemberComponents);
+		Member->OnTakeAnyDamage.AddUniqueDynamic(this, &UNomadicBaseProxySubsystem::OnMemberTakeAnyDamage);
+		Member->OnEndPlay.AddUniqueDynamic(this, &UNomadicBaseProxySubsystem::OnMemberEndPlay);
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParams.ObjectFlags |= RF_Transient;
+	AActor* ProxyActor = GetWorld()->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+	if (!ProxyActor)
+	{
+		return;
+	}
+	USceneComponent* ProxyRoot = NewObject<USceneComponent>(ProxyActor, TEXT("BaseProxyRoot"));
+	ProxyActor->SetRootComponent(ProxyRoot);
+	ProxyRoot->RegisterComponent();
+	for (TPair<UStaticMesh*, TArray<FTransform>>& Pair : MeshInstances)
+	{
+		if (Pair.Value.IsEmpty())
+		{
+			continue;
+		}
+		// Only the default materials of the mesh; the dynamic and override materials of the base are not merged.
+		UInstancedStaticMeshComponent* Instances = NewObject<UInstancedStaticMeshComponent>(ProxyActor);
+		Instances->SetStaticMesh(Pair.Key);
+		Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		Instances->SetCanEverAffectNavigation(false);
+		Instances->bOverrideMinLOD = true;
+		Instances->MinLOD = FMath::Clamp(ProxyMinLOD, 0, Pair.Key->GetNumLODs() - 1);
+		Instances->SetupAttachment(ProxyRoot);
+		Instances->RegisterComponent();
+		Instances->AddInstances(Pair.Value, false, true);
+		ProxyActor->AddInstanceComponent(Instances);
+	}
+	// Hidden until the camera is far, so the proxy adds nothing to the scene before that.
+	ProxyRoot->SetHiddenInGame(true, true);
+	Base.ProxyActor = ProxyActor;
+	Base.bIsShowingProxy = false;
+}
+
+void UNomadicBaseProxySubsystem::ReleaseProxy(FNomadicBase& Base)
+{
+	if (Base.bIsShowingProxy)
+	{
+		SetShowProxy(Base, false);
+	}
+	const AActor* Truck = Base.Truck.Get();
+	for (const TWeakObjectPtr<AActor>& WeakMember : Base.Members)
+	{
+		AActor* Member = WeakMember.Get();
+		if (!Member)
+		{
+			continue;
+		}
+		Member->OnTakeAnyDamage.RemoveDynamic(this, &UNomadicBaseProxySubsystem::OnMemberTakeAnyDamage);
+		// The truck stays bound for as long as the base is registered.
+		if (Member != Truck)
+		{
+			Member->OnEndPlay.RemoveDynamic(this, &UNomadicBaseProxySubsystem::OnMemberEndPlay);
+		}
+	}
+	Base.Members.Reset();
+	Base.MergedMemberComponents.Reset();
+	if (AActor* ProxyActor = Base.ProxyActor.Get())
+	{
+		ProxyActor->Destroy();
+	}
+	Base.ProxyActor.Reset();
+}
+
+void UNomadicBaseProxySubsystem::SetShowProxy(FNomadicBase& Base, const bool bShowProxy)
+{
+	// Only the primitives of this client are hidden; unlike the actor's bHidden, bHiddenInGame is never replicated.
+	const AActor* ProxyActor = Base.ProxyActor.Get();
+	if (ProxyActor && ProxyActor->GetRootComponent())
+	{
+		ProxyActor->GetRootComponent()->SetHiddenInGame(!bShowProxy, true);
+	}
+	if (!bShowProxy)
+	{
+		for (const TWeakObjectPtr<UStaticMeshComponent>& WeakComponent : Base.HiddenMemberComponents)
+		{
+			if (UStaticMeshComponent* Component = WeakComponent.Get())
+			{
+				Component->SetHiddenInGame(false);
+			}
+		}
+		Base.HiddenMemberComponents.Reset();
+		Base.bIsShowingProxy = false;
+		return;
+	}
+	// Only what the proxy draws instead is hidden; effects, widgets and other primitives of the base stay visible.
+	// Hidden components keep ticking and colliding but are removed from the scene. Components that were hidden
+	// since the proxy was built are not remembered, so they stay hidden on restore.
+	for (const TWeakObjectPtr<UStaticMeshComponent>& WeakComponent : Base.MergedMemberComponents)
+	{
+		UStaticMeshComponent* Component = WeakComponent.Get();
+		if (Component && !Component->bHiddenInGame)
+		{
+			Component->SetHiddenInGame(true);
+			Base.HiddenMemberComponents.Add(Component);
+		}
+	}
+	Base.bIsShowingProxy = true;
+}
+
+bool UNomadicBaseProxySubsystem::HasLocalPlayer() const
+{
+	const UWorld* World = GetWorld();
+	return World->GetNetMode() != NM_DedicatedServer && GEngine && GEngine->GetFirstLocalPlayerController(World);
+}
+
+bool UNomadicBaseProxySubsystem::GetCameraLocation(FVector& OutLocation) const
+{
+	if (GetWorld()->GetNetMode() == NM_DedicatedServer)
+	{
+		return false;
+	}
+	// On a server the first player controller can belong to a remote client.
+	const APlayerController* PlayerController = GEngine
+		                                            ? GEngine->GetFirstLocalPlayerController(GetWorld())
+		                                            : nullptr;
+	const APlayerCameraManager* CameraManager = PlayerController ? PlayerController->PlayerCameraManager : nullptr;
+	if (!CameraManager)
+	{
+		return false;
+	}
+	OutLocation = CameraManager->GetCameraLocation();
+	return true;
+}
+
+void UNomadicBaseProxySubsystem::OnMemberTakeAnyDamage(AActor* DamagedActor, float Damage,
+                                                       const UDamageType* DamageType, AController* InstigatedBy,
+                                                       AActor* DamageCauser)
+{
+	// A base under attack is shown in full and stays so until it is idle again.
+	if (const FNomadicBase* Base = FindBaseOfActor(DamagedActor))
+	{
+		OnBaseChanged(Base->Truck.Get());
+	}
+}
+
+void UNomadicBaseProxySubsystem::OnMemberEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason)
+{
+	if (GetWorld()->bIsTearingDown)
+	{
+		return;
+	}
+	const FNomadicBase* Base = FindBaseOfActor(Actor);
+	if (!Base)
+	{
+		return;
+	}
+	if (Base->Truck.Get() == Actor)
+	{
+		UnregisterBase(Actor);
+		return;
+	}
+	OnBaseChanged(Base->Truck.Get());
+}
@@ -0,0 +1,123 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+
+#include "NomadicBaseProxySubsystem.generated.h"
+
+class UStaticMeshComponent;
+
+/**
+ * @brief Draws settled nomadic bases that are far from the camera as one merged proxy.
+ * A base is a converted truck with the expansions it owns. Once none of them changed for IdleSeconds, the truck
+ * has no queued conversion and every expansion is built, the static meshes of the base are merged into a proxy
+ * actor with one instanced component per mesh, using the default materials of the mesh and a lower LOD.
+ * While the camera is further than ProxyDistance the proxy is shown and the merged static meshes of the base actors
+ * are hidden for the local player only, which removes them from the scene; gameplay, collision, ticking and the
+ * replicated hidden state of the base actors are untouched.
+ * The actors are shown again when the camera comes closer than RestoreDistance, when any of them takes damage or
+ * when the base changes; a changed or damaged base needs to be idle again before the proxy is rebuilt.
+ * @note Dedicated servers and worlds without a local player draw nothing, so no bases are tracked there.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UNomadicBaseProxySubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Starts tracking the base of the truck, the proxy is built once the base is idle.
+	 * @param Truck The truck that converted into its building.
+	 */
+	void RegisterBase(AActor* Truck);
+
+	/**
+	 * @brief Restores the base actors and destroys the proxy, e.g. when the truck converts back into a vehicle.
+	 * @param Truck The truck of the base.
+	 */
+	void UnregisterBase(AActor* Truck);
+
+	/**
+	 * @brief Restores the base actors, destroys the outdated proxy and restarts the idle time.
+	 * @param Truck The truck of the base that gains, loses or changes an expansion; ignored if not registered.
+	 */
+	void OnBaseChanged(AActor* Truck);
+
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual bool IsTickable() const override { return !M_Bases.IsEmpty(); }
+
+private:
+	// How long a base may not change before its proxy is built.
+	static constexpr float IdleSeconds = 10.f;
+
+	// How often the bases are checked against the camera.
+	static constexpr float DistanceCheckInterval = 0.25f;
+
+	// The proxy is shown when the camera is further from the truck than this.
+	static constexpr float ProxyDistance = 12000.f;
+
+	// The actors are restored when the camera is closer than this; smaller than ProxyDistance to avoid flickering.
+	static constexpr float RestoreDistance = 10000.f;
+
+	// LOD the merged meshes are drawn with at least, clamped to the LODs of each mesh.
+	static constexpr int32 ProxyMinLOD = 1;
+
+	struct FNomadicBase
+	{
+		TWeakObjectPtr<AActor> Truck;
+
+		// The truck and its expansions at the time the proxy was built.
+		TArray<TWeakObjectPtr<AActor>> Members;
+
+		// Static meshes of the members that were merged into the proxy.
+		TArray<TWeakObjectPtr<UStaticMeshComponent>> MergedMemberComponents;
+
+		// Merged static meshes that were hidden to show the proxy.
+		TArray<TWeakObjectPtr<UStaticMeshComponent>> HiddenMemberComponents;
+
+		TWeakObjectPtr<AActor> ProxyActor;
+
+		// Game time after which the base is idle.
+		double IdleTime = 0.0;
+
+		bool bIsShowingProxy = false;
+	};
+
+	TArray<FNomadicBase> M_Bases;
+
+	float M_TimeSinceDistanceCheck = DistanceCheckInterval;
+
+	FNomadicBase* FindBase(const AActor* Truck);
+
+	/** @return The base that has the actor as truck or member, null if there is none. */
+	FNomadicBase* FindBaseOfActor(const AActor* Actor);
+
+	/** @return Whether the truck has no queued conversion and every expansion it owns is built. */
+	bool IsBaseSettled(const AActor* Truck) const;
+
+	/** @brief Collects the members of the base and merges their static meshes into a hidden proxy actor. */
+	void BuildProxy(FNomadicBase& Base);
+
+	/** @brief Shows the base actors, destroys the proxy and unbinds from the members. */
+	void ReleaseProxy(FNomadicBase& Base);
+
+	/** @brief Swaps between the proxy and the merged static meshes of the base actors, for the local player only. */
+	static void SetShowProxy(FNomadicBase& Base, const bool bShowProxy);
+
+	/** @return Whether this world has a local player that draws the bases. */
+	bool HasLocalPlayer() const;
+
+	bool GetCameraLocation(FVector& OutLocation) const;
+
+	UFUNCTION()
+	void OnMemberTakeAnyDamage(AActor* DamagedActor, float Damage, const UDamageType* DamageType,
+	                           AController* InstigatedBy, AActor* DamageCauser);
+
+	UFUNCTION()
+	void OnMemberEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason);
+};
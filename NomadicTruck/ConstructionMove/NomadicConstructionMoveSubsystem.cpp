@@ -0,0 +1,272 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "NomadicConstructionMoveSubsystem.h"
+
+#include "NavigationSystem.h"
+#include "NavFilters/NavigationQueryFilter.h"
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/AINomadicVehicle.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+
+void UNomadicConstructionMoveSubsystem::RequestConstructionMove(AAINomadicVehicle* NomadicAI)
+{
+	if (!IsValid(NomadicAI) || !NomadicAI->GetPawn())
+	{
+		RTSFunctionLibrary::ReportError(
+			"Attempt to request a construction move for an invalid nomadic AI or an AI without pawn!"
+			"\n At function RequestConstructionMove in NomadicConstructionMoveSubsystem.cpp");
+		return;
+	}
+	CancelConstructionMove(NomadicAI);
+	M_PendingRequests.Add(NomadicAI);
+}
+
+void UNomadicConstructionMoveSubsystem::CancelConstructionMove(const AAINomadicVehicle* NomadicAI)
+{
+	M_PendingRequests.RemoveAll([NomadicAI](const TWeakObjectPtr<AAINomadicVehicle>& Request)
+	{
+		return Request.Get() == NomadicAI;
+	});
+	for (TPair<uint32, FConstructionMoveGroup>& RunningQuery : M_RunningQueries)
+	{
+		FConstructionMoveGroup& Group = RunningQuery.Value;
+		if (Group.Leader.Get() == NomadicAI)
+		{
+			// The query keeps running for the followers; the result is not delivered to the leader.
+			Group.Leader.Reset();
+		}
+		Group.Followers.RemoveAll([NomadicAI](const TWeakObjectPtr<AAINomadicVehicle>& Follower)
+		{
+			return Follower.Get() == NomadicAI;
+		});
+	}
+}
+
+void UNomadicConstructionMoveSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	TArray<FConstructionMoveGroup> Groups;
+	BuildGroups(Groups);
+	M_PendingRequests.Reset();
+
+	int32 QueriesStarted = 0;
+	for (FConstructionMoveGroup& Group : Groups)
+	{
+		if (QueriesStarted >= MaxPathQueriesPerFrame)
+		{
+			// Keep the remaining trucks for the next frame.
+			M_PendingRequests.Add(Group.Leader);
+			M_PendingRequests.Append(Group.Followers);
+			continue;
+		}
+		if (StartGroupQuery(Group))
+		{
+			++QueriesStarted;
+			continue;
+		}
+		// Without a query every truck of the group falls back to its own move request.
+		NotifyGroupFailed(Group);
+	}
+
+	if (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols && QueriesStarted > 0)
+	{
+		RTSFunctionLibrary::PrintString(
+			"Construction move groups: " + FString::FromInt(Groups.Num()) +
+			" path queries started: " + FString::FromInt(QueriesStarted));
+	}
+}
+
+TStatId UNomadicConstructionMoveSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UNomadicConstructionMoveSubsystem, STATGROUP_Tickables);
+}
+
+void UNomadicConstructionMoveSubsystem::BuildGroups(TArray<FConstructionMoveGroup>& OutGroups) const
+{
+	// Destination of the leader of each group, same order as OutGroups.
+	TArray<FVector> GroupDestinations;
+	for (const TWeakObjectPtr<AAINomadicVehicle>& Request : M_PendingRequests)
+	{
+		const AAINomadicVehicle* NomadicAI = Request.Get();
+		if (!NomadicAI || !NomadicAI->GetPawn())
+		{
+			continue;
+		}
+		const FVector Destination = NomadicAI->GetBuildingLocation();
+		int32 GroupIndex = INDEX_NONE;
+		for (int32 i = 0; i < GroupDestinations.Num(); ++i)
+		{
+			if (FVector::DistSquared2D(GroupDestinations[i], Destination) <= FMath::Square(CorridorShareRadius))
+			{
+				GroupIndex = i;
+				break;
+			}
+		}
+		if (GroupIndex == INDEX_NONE)
+		{
+			FConstructionMoveGroup& NewGroup = OutGroups.AddDefaulted_GetRef();
+			NewGroup.Leader = Request;
+			GroupDestinations.Add(Destination);
+		}
+		else
+		{
+			OutGroups[GroupIndex].Followers.Add(Request);
+		}
+	}
+}
+
+bool UNomadicConstructionMoveSubsystem::StartGroupQuery(FConstructionMoveGroup& Group)
+{
+	AAINomadicVehicle* Leader = Group.Leader.Get();
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (!Leader || !NavSys)
+	{
+		return false;
+	}
+	const FNavAgentProperties& AgentProperties = Leader->GetNavAgentPropertiesRef();
+	const FVector Start = Leader->GetPawn()->GetActorLocation();
+	const ANavigationData* NavData = NavSys->GetNavDataForProps(AgentProperties, Start);
+	if (!NavData)
+	{
+		RTSFunctionLibrary::ReportError(
+			"No navigation data found for the nomadic truck!"
+			"\n At function StartGroupQuery in NomadicConstructionMoveSubsystem.cpp"
+			"\n Truck: " + Leader->GetPawn()->GetName());
+		return false;
+	}
+
+	FPathFindingQuery Query(Leader, *NavData, Start, Leader->GetBuildingLocation(),
+	                        UNavigationQueryFilter::GetQueryFilter(*NavData, Leader, nullptr));
+	const uint32 QueryID = NavSys->FindPathAsync(
+		AgentProperties, Query,
+		FNavPathQueryDelegate::CreateUObject(this, &UNomadicConstructionMoveSubsystem::OnGroupPathFound));
+	if (QueryID == INVALID_NAVQUERYID)
+	{
+		return false;
+	}
+	M_RunningQueries.Add(QueryID, MoveTemp(Group));
+	return true;
+}
+
+void UNomadicConstructionMoveSubsystem::OnGroupPathFound(
+	uint32 QueryID,
+	ENavigationQueryResult::Type Result,
+	FNavPathSharedPtr Path)
+{
+	FConstructionMoveGroup Group;
+	if (!M_RunningQueries.RemoveAndCopyValue(QueryID, Group))
+	{
+		return;
+	}
+	const bool bSuccess = Result == ENavigationQueryResult::Success && Path.IsValid() && Path->IsValid();
+	if (AAINomadicVehicle* Leader = Group.Leader.Get())
+	{
+		Leader->OnConstructionPathReady(Path, bSuccess);
+	}
+	for (const TWeakObjectPtr<AAINomadicVehicle>& FollowerPtr : Group.Followers)
+	{
+		AAINomadicVehicle* Follower = FollowerPtr.Get();
+		if (!Follower || !Follower->GetPawn())
+		{
+			continue;
+		}
+		FNavPathSharedPtr CorridorPath = bSuccess ? CreateCorridorPath(Follower, Path) : nullptr;
+		if (CorridorPath.IsValid())
+		{
+			Follower->OnConstructionPathReady(CorridorPath, true);
+		}
+		else
+		{
+			// Too far from the corridor or the leader's query failed; the follower gets its own query.
+			M_PendingRequests.Add(FollowerPtr);
+		}
+	}
+}
+
+void UNomadicConstructionMoveSubsystem::NotifyGroupFailed(const FConstructionMoveGroup& Group)
+{
+	if (AAINomadicVehicle* Leader = Group.Leader.Get())
+	{
+		Leader->OnConstructionPathReady(nullptr, false);
+	}
+	for (const TWeakObjectPtr<AAINomadicVehicle>& FollowerPtr : Group.Followers)
+	{
+		if (AAINomadicVehicle* Follower = FollowerPtr.Get())
+		{
+			Follower->OnConstructionPathReady(nullptr, false);
+		}
+	}
+}
+
+bool UNomadicConstructionMoveSubsystem::IsSegmentNavigable(
+	const ANavigationData& NavData,
+	const AAINomadicVehicle* Follower,
+	const FVector& SegmentStart,
+	const FVector& SegmentEnd)
+{
+	const FVector ProjectExtent(CorridorProjectExtent, CorridorProjectExtent, CorridorProjectExtent);
+	FNavLocation ProjectedStart, ProjectedEnd;
+	if (!NavData.ProjectPoint(SegmentStart, ProjectedStart, ProjectExtent) ||
+		!NavData.ProjectPoint(SegmentEnd, ProjectedEnd, ProjectExtent))
+	{
+		return false;
+	}
+	FVector HitLocation;
+	// Raycast returns true if the segment leaves the navmesh before it reaches the end.
+	return !NavData.Raycast(ProjectedStart.Location, ProjectedEnd.Location, HitLocation,
+	                        UNavigationQueryFilter::GetQueryFilter(NavData, Follower, nullptr), Follower);
+}
+
+FNavPathSharedPtr UNomadicConstructionMoveSubsystem::CreateCorridorPath(
+	const AAINomadicVehicle* Follower,
+	const FNavPathSharedPtr& LeaderPath) const
+{
+	const TArray<FNavPathPoint>& LeaderPoints = LeaderPath->GetPathPoints();
+	const FVector Start = Follower->GetPawn()->GetActorLocation();
+
+	// Join the corridor at the closest point of the leader's path.
+	int32 JoinIndex = INDEX_NONE;
+	float ClosestDistSquared = FMath::Square(CorridorJoinDistance);
+	for (int32 i = 0; i < LeaderPoints.Num(); ++i)
+	{
+		const float DistSquared = FVector::DistSquared(LeaderPoints[i].Location, Start);
+		if (DistSquared <= ClosestDistSquared)
+		{
+			ClosestDistSquared = DistSquared;
+			JoinIndex = i;
+		}
+	}
+	if (JoinIndex == INDEX_NONE)
+	{
+		return nullptr;
+	}
+
+	TArray<FVector> Points;
+	Points.Reserve(LeaderPoints.Num() - JoinIndex + 1);
+	Points.Add(Start);
+	// Skip the last point of the leader as it is the leader's destination.
+	for (int32 i = JoinIndex + 1; i < LeaderPoints.Num() - 1; ++i)
+	{
+		Points.Add(LeaderPoints[i].Location);
+	}
+	Points.Add(Follower->GetBuildingLocation());
+
+	// Only the stitched segments are straight lines that no query checked: from the follower onto the corridor
+	// and from the corridor to the follower's own building location.
+	const ANavigationData* NavData = LeaderPath->GetNavigationDataUsed();
+	if (!NavData || !IsSegmentNavigable(*NavData, Follower, Points[0], Points[1]))
+	{
+		return nullptr;
+	}
+	if (Points.Num() > 2 && !IsSegmentNavigable(*NavData, Follower, Points[Points.Num() - 2], Points.Last()))
+	{
+		return nullptr;
+	}
+
+	FNavPathSharedPtr CorridorPath = MakeShared<FNavigationPath, ESPMode::ThreadSafe>(Points, Follower->GetPawn());
+	CorridorPath->SetNavigationDataUsed(LeaderPath->GetNavigationDataUsed());
+	return CorridorPath;
+}
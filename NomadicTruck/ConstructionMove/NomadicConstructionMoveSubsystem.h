@@ -0,0 +1,98 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NavigationData.h"
+#include "Subsystems/WorldSubsystem.h"
+
+#include "NomadicConstructionMoveSubsystem.generated.h"
+
+class AAINomadicVehicle;
+
+/**
+ * @brief Batches the path requests of nomadic trucks that move to their building location.
+ * Requests made in the same frame are grouped by destination; each group issues one asynchronous path query for
+ * its leader and the other trucks in the group reuse the leader's path as a shared corridor.
+ * At most MaxPathQueriesPerFrame queries are started per frame, remaining groups wait for the next frame.
+ * @note Results are delivered to the trucks with AAINomadicVehicle::OnConstructionPathReady.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UNomadicConstructionMoveSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Queues a path request from the truck to its building location.
+	 * @param NomadicAI The AI of the truck that moves to AAINomadicVehicle::GetBuildingLocation.
+	 * @note A truck can have one request at the time, a new request replaces the previous one.
+	 */
+	void RequestConstructionMove(AAINomadicVehicle* NomadicAI);
+
+	/** @brief Removes the truck from any queued or running path request. */
+	void CancelConstructionMove(const AAINomadicVehicle* NomadicAI);
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual bool IsTickable() const override { return !M_PendingRequests.IsEmpty(); }
+
+private:
+	// Trucks with destinations within this distance of each other share one path query.
+	static constexpr float CorridorShareRadius = 2500.f;
+
+	// A follower only joins the corridor of the leader if it starts within this distance of the leader's path.
+	static constexpr float CorridorJoinDistance = 3000.f;
+
+	// Extent used to project the stitched corridor segments onto the navmesh.
+	static constexpr float CorridorProjectExtent = 200.f;
+
+	// Limits the number of path queries that are started in a single frame.
+	static constexpr int32 MaxPathQueriesPerFrame = 4;
+
+	struct FConstructionMoveGroup
+	{
+		// The truck for which the path is calculated.
+		TWeakObjectPtr<AAINomadicVehicle> Leader;
+
+		// Trucks that reuse the path of the leader.
+		TArray<TWeakObjectPtr<AAINomadicVehicle>> Followers;
+	};
+
+	// Trucks that requested a path and for which no query has been started.
+	TArray<TWeakObjectPtr<AAINomadicVehicle>> M_PendingRequests;
+
+	// Groups of which the path query is running, mapped by query id.
+	TMap<uint32, FConstructionMoveGroup> M_RunningQueries;
+
+	/**
+	 * @brief Groups the pending requests by destination.
+	 * @param OutGroups The groups, every valid pending truck is in exactly one group.
+	 */
+	void BuildGroups(TArray<FConstructionMoveGroup>& OutGroups) const;
+
+	/**
+	 * @brief Starts the asynchronous path query for the leader of the group.
+	 * @return Whether the query was started.
+	 */
+	bool StartGroupQuery(FConstructionMoveGroup& Group);
+
+	/** @brief Lets every truck of the group fall back to a regular move request. */
+	static void NotifyGroupFailed(const FConstructionMoveGroup& Group);
+
+	/** @brief Called on the game thread when the navigation system finished the path query of a group. */
+	void OnGroupPathFound(uint32 QueryID, ENavigationQueryResult::Type Result, FNavPathSharedPtr Path);
+
+	/**
+	 * @brief Creates the path of the follower from the corridor of the leader.
+	 * @param Follower The truck that reuses the corridor.
+	 * @param LeaderPath The path of the leader of the group.
+	 * @return The follower's path, or an invalid pointer if the follower is too far from the corridor or a stitched
+	 * segment is not navigable.
+	 */
+	FNavPathSharedPtr CreateCorridorPath(const AAINomadicVehicle* Follower, const FNavPathSharedPtr& LeaderPath) const;
+
+	/** @return Whether the straight segment stays on the navmesh for the follower. */
+	static bool IsSegmentNavigable(const ANavigationData& NavData, const AAINomadicVehicle* Follower,
+	                               const FVector& SegmentStart, const FVector& SegmentEnd);
+};
@@ -0,0 +1,143 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "NomadicConversionScheduler.h"
+
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+
+bool UNomadicConversionScheduler::QueueConversion(UObject* ConvertingActor)
+{
+	INomadicConversionStaged* StagedConversion = Cast<INomadicConversionStaged>(ConvertingActor);
+	if (!StagedConversion)
+	{
+		RTSFunctionLibrary::ReportError(
+			"Attempt to queue a conversion for an object that does not implement INomadicConversionStaged!"
+			"\n At function QueueConversion in NomadicConversionScheduler.cpp"
+			"\n Object: " + (ConvertingActor ? ConvertingActor->GetName() : FString("nullptr")));
+		return false;
+	}
+	if (IsConversionQueued(ConvertingActor))
+	{
+		RTSFunctionLibrary::ReportError(
+			"Attempt to queue a conversion for an object that is already converting!"
+			"\n At function QueueConversion in NomadicConversionScheduler.cpp"
+			"\n Object: " + ConvertingActor->GetName());
+		return false;
+	}
+
+	FNomadicConversionJob& Job = M_ConversionQueue.AddDefaulted_GetRef();
+	Job.ConvertingObject = ConvertingActor;
+	Job.StagedConversion = StagedConversion;
+	return true;
+}
+
+bool UNomadicConversionScheduler::CancelConversion(const UObject* ConvertingActor)
+{
+	return M_ConversionQueue.RemoveAll([ConvertingActor](const FNomadicConversionJob& Job)
+	{
+		return Job.ConvertingObject.Get() == ConvertingActor;
+	}) > 0;
+}
+
+bool UNomadicConversionScheduler::IsConversionQueued(const UObject* ConvertingActor) const
+{
+	return M_ConversionQueue.ContainsByPredicate([ConvertingActor](const FNomadicConversionJob& Job)
+	{
+		return Job.ConvertingObject.Get() == ConvertingActor;
+	});
+}
+
+void UNomadicConversionScheduler::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	const double StartTime = FPlatformTime::Seconds();
+	constexpr double BudgetSeconds = ConversionBudgetMs / 1000.0;
+	int32 StepsExecuted = 0;
+
+	while (!M_ConversionQueue.IsEmpty())
+	{
+		// Always execute at least one step so that conversions make progress when a single step exceeds the budget.
+		if (StepsExecuted > 0 && FPlatformTime::Seconds() - StartTime >= BudgetSeconds)
+		{
+			break;
+		}
+
+		FNomadicConversionJob& Job = M_ConversionQueue[0];
+		if (!Job.ConvertingObject.IsValid())
+		{
+			// Truck destroyed while converting.
+			M_ConversionQueue.RemoveAt(0);
+			continue;
+		}
+
+		bool bExecutedStep = false;
+		const bool bCompleted = ExecuteNextStep(Job, bExecutedStep);
+		// Skipping empty stages does no work, so only executed steps count against the budget.
+		if (bExecutedStep)
+		{
+			++StepsExecuted;
+		}
+		if (bCompleted)
+		{
+			// Copy before removal as completing may queue a new conversion.
+			INomadicConversionStaged* CompletedConversion = Job.StagedConversion;
+			M_ConversionQueue.RemoveAt(0);
+			CompletedConversion->OnStagedConversionComplete();
+		}
+	}
+
+	if (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+	{
+		RTSFunctionLibrary::PrintString(
+			"Conversion steps this frame: " + FString::FromInt(StepsExecuted) +
+			" in " + FString::SanitizeFloat((FPlatformTime::Seconds() - StartTime) * 1000.0) + " ms"
+			"\n queued conversions: " + FString::FromInt(M_ConversionQueue.Num()));
+	}
+}
+
+TStatId UNomadicConversionScheduler::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UNomadicConversionScheduler, STATGROUP_Tickables);
+}
+
+bool UNomadicConversionScheduler::ExecuteNextStep(FNomadicConversionJob& Job, bool& bOutExecutedStep) const
+{
+	bOutExecutedStep = false;
+	// Skip stages without steps.
+	while (Job.Stage != ENomadicConversionStage::NCS_Complete)
+	{
+		if (Job.StepCount == INDEX_NONE)
+		{
+			Job.StepCount = Job.StagedConversion->GetConversionStepCount(Job.Stage);
+			Job.StepIndex = 0;
+		}
+		if (Job.StepIndex < Job.StepCount)
+		{
+			break;
+		}
+		Job.Stage = static_cast<ENomadicConversionStage>(static_cast<uint8>(Job.Stage) + 1);
+		Job.StepCount = INDEX_NONE;
+	}
+	if (Job.Stage == ENomadicConversionStage::NCS_Complete)
+	{
+		return true;
+	}
+
+	// Advance before executing; a step may cancel or queue a conversion, which reallocates the queue and
+	// invalidates Job.
+	const ENomadicConversionStage Stage = Job.Stage;
+	const int32 StepIndex = Job.StepIndex++;
+	INomadicConversionStaged* StagedConversion = Job.StagedConversion;
+	if (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+	{
+		RTSFunctionLibrary::PrintString(
+			"Executing conversion step " + FString::FromInt(StepIndex + 1) + "/" + FString::FromInt(Job.StepCount) +
+			" of " + NomadicConversionStageToString(Stage) + " on " + Job.ConvertingObject->GetName());
+	}
+	StagedConversion->ExecuteConversionStep(Stage, StepIndex);
+	bOutExecutedStep = true;
+	return false;
+}
@@ -0,0 +1,137 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "UObject/Interface.h"
+
+#include "NomadicConversionScheduler.generated.h"
+
+/** The stages of a truck to building conversion, in the order they are executed. */
+UENUM()
+enum class ENomadicConversionStage : uint8
+{
+	// Swap the vehicle mesh for the (nanite) building mesh.
+	NCS_MeshSwap,
+	// Create the animated dynamic materials for each material slot of the building mesh.
+	NCS_SlotMaterialSetup,
+	// Re-attach the building expansions that belong to this truck.
+	NCS_ExpansionReattach,
+	NCS_Complete
+};
+
+static FString NomadicConversionStageToString(const ENomadicConversionStage Stage)
+{
+	switch (Stage)
+	{
+	case ENomadicConversionStage::NCS_MeshSwap:
+		return "NCS_MeshSwap";
+	case ENomadicConversionStage::NCS_SlotMaterialSetup:
+		return "NCS_SlotMaterialSetup";
+	case ENomadicConversionStage::NCS_ExpansionReattach:
+		return "NCS_ExpansionReattach";
+	case ENomadicConversionStage::NCS_Complete:
+		return "NCS_Complete";
+	default:
+		return "Unknown";
+	}
+}
+
+UINTERFACE(MinimalAPI, NotBlueprintable)
+class UNomadicConversionStaged : public UInterface
+{
+	GENERATED_BODY()
+};
+
+/**
+ * @brief Implemented by actors whose building conversion is split into budgeted steps.
+ * Each stage is split into a number of steps, one step is the smallest unit of work the scheduler executes.
+ */
+class RTS_SURVIVAL_API INomadicConversionStaged
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @param Stage The stage to get the number of steps for.
+	 * @return The number of steps the stage is split into, zero skips the stage.
+	 * @note Called once when the stage starts.
+	 */
+	virtual int32 GetConversionStepCount(const ENomadicConversionStage Stage) const = 0;
+
+	/**
+	 * @brief Executes one step of the provided stage.
+	 * @param Stage The stage the step belongs to.
+	 * @param StepIndex Index of the step in [0, GetConversionStepCount(Stage)).
+	 */
+	virtual void ExecuteConversionStep(const ENomadicConversionStage Stage, const int32 StepIndex) = 0;
+
+	/** @brief Called after the last step of the last stage was executed. */
+	virtual void OnStagedConversionComplete() = 0;
+};
+
+/**
+ * @brief Executes the truck to building conversions of all trucks in the world under a per-frame budget.
+ * Conversions are executed in the order they were queued, a truck that is queued later waits for the trucks
+ * before it so that one conversion finishes as fast as possible.
+ * @note At least one step is executed each frame so that a conversion always finishes, even if a single step
+ * exceeds the budget.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UNomadicConversionScheduler : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Queues the staged conversion of the provided actor.
+	 * @param ConvertingActor The actor to convert, needs to implement INomadicConversionStaged.
+	 * @return Whether the conversion was queued.
+	 */
+	bool QueueConversion(UObject* ConvertingActor);
+
+	/**
+	 * @brief Removes the conversion of the actor from the queue, the steps already executed are not reverted.
+	 * @param ConvertingActor The actor of which the conversion is cancelled.
+	 * @return Whether there was a queued conversion for this actor.
+	 */
+	bool CancelConversion(const UObject* ConvertingActor);
+
+	/** @return Whether the actor has a queued conversion that is not yet completed. */
+	bool IsConversionQueued(const UObject* ConvertingActor) const;
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual bool IsTickable() const override { return !M_ConversionQueue.IsEmpty(); }
+
+private:
+	// How many milliseconds per frame may be spent on conversion steps of all trucks combined.
+	static constexpr double ConversionBudgetMs = 2.0;
+
+	struct FNomadicConversionJob
+	{
+		TWeakObjectPtr<UObject> ConvertingObject;
+
+		// Valid as long as ConvertingObject is valid.
+		INomadicConversionStaged* StagedConversion = nullptr;
+
+		ENomadicConversionStage Stage = ENomadicConversionStage::NCS_MeshSwap;
+
+		int32 StepIndex = 0;
+
+		// Number of steps of the current stage; INDEX_NONE if the stage has not started yet.
+		int32 StepCount = INDEX_NONE;
+	};
+
+	// FIFO of conversions shared by all converting trucks.
+	TArray<FNomadicConversionJob> M_ConversionQueue;
+
+	/**
+	 * @brief Executes the next step of the job.
+	 * @param Job The conversion to advance; may be invalid after the call if the step changed the queue.
+	 * @param bOutExecutedStep Whether a step was executed; false if only empty stages were skipped.
+	 * @return True if the job completed all of its stages.
+	 */
+	bool ExecuteNextStep(FNomadicConversionJob& Job, bool& bOutExecutedStep) const;
+};
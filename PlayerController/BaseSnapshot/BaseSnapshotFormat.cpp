@@ -0,0 +1,119 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "BaseSnapshotFormat.h"
+
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/FileHelper.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+namespace BaseSnapshotFormat
+{
+	template <typename TRecord>
+	uint32 AppendSection(TArray<uint8>& Buffer, TConstArrayView<TRecord> Records)
+	{
+		Buffer.SetNumZeroed(Align(Buffer.Num(), SectionAlignment));
+		const uint32 Offset = Buffer.Num();
+		Buffer.Append(reinterpret_cast<const uint8*>(Records.GetData()), Records.Num() * sizeof(TRecord));
+		return Offset;
+	}
+
+	template <typename TRecord>
+	bool GetSection(TConstArrayView<uint8> Data, const uint32 Offset, const uint32 Num,
+	                TConstArrayView<TRecord>& OutSection)
+	{
+		const uint64 End = static_cast<uint64>(Offset) + static_cast<uint64>(Num) * sizeof(TRecord);
+		if (Offset % SectionAlignment != 0 || End > static_cast<uint64>(Data.Num()))
+		{
+			return false;
+		}
+		OutSection = MakeArrayView(reinterpret_cast<const TRecord*>(Data.GetData() + Offset), Num);
+		return true;
+	}
+}
+
+bool BaseSnapshotFormat::Write(
+	const FString& FilePath,
+	const TConstArrayView<uint8> ExpansionTypes,
+	const TConstArrayView<FTruckRecord> Trucks,
+	const TConstArrayView<FExpansionRecord> Expansions)
+{
+	TArray<uint8> Buffer;
+	Buffer.Reserve(sizeof(FHeader) + ExpansionTypes.Num() + Trucks.Num() * sizeof(FTruckRecord) +
+		Expansions.Num() * sizeof(FExpansionRecord) + 3 * SectionAlignment);
+	Buffer.SetNumZeroed(sizeof(FHeader));
+
+	FHeader Header;
+	Header.NumExpansionTypes = ExpansionTypes.Num();
+	Header.NumTrucks = Trucks.Num();
+	Header.NumExpansions = Expansions.Num();
+	Header.ExpansionTypesOffset = AppendSection(Buffer, ExpansionTypes);
+	Header.TrucksOffset = AppendSection(Buffer, Trucks);
+	Header.ExpansionsOffset = AppendSection(Buffer, Expansions);
+	FMemory::Memcpy(Buffer.GetData(), &Header, sizeof(FHeader));
+
+	if (!FFileHelper::SaveArrayToFile(Buffer, *FilePath))
+	{
+		RTSFunctionLibrary::ReportError("Failed to write base snapshot!"
+			"\n At function Write in BaseSnapshotFormat.cpp"
+			"\n Path: " + FilePath);
+		return false;
+	}
+	return true;
+}
+
+BaseSnapshotFormat::FMappedSnapshot::FMappedSnapshot() = default;
+
+BaseSnapshotFormat::FMappedSnapshot::~FMappedSnapshot()
+{
+	// The region needs to be unmapped before the file handle closes.
+	M_MappedRegion.Reset();
+	M_MappedFile.Reset();
+}
+
+bool BaseSnapshotFormat::FMappedSnapshot::Open(const FString& FilePath)
+{
+	TConstArrayView<uint8> Data;
+	M_MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*FilePath));
+	if (M_MappedFile && M_MappedFile->GetFileSize() > 0)
+	{
+		M_MappedRegion.Reset(M_MappedFile->MapRegion(0, M_MappedFile->GetFileSize()));
+	}
+	if (M_MappedRegion)
+	{
+		Data = MakeArrayView(M_MappedRegion->GetMappedPtr(), M_MappedRegion->GetMappedSize());
+	}
+	else if (FFileHelper::LoadFileToArray(M_FallbackData, *FilePath))
+	{
+		Data = M_FallbackData;
+	}
+	else
+	{
+		RTSFunctionLibrary::ReportError("Failed to open base snapshot!"
+			"\n At function Open in BaseSnapshotFormat.cpp"
+			"\n Path: " + FilePath);
+		return false;
+	}
+
+	FHeader Header;
+	if (Data.Num() < static_cast<int32>(sizeof(FHeader)))
+	{
+		RTSFunctionLibrary::ReportError("Base snapshot is too small to contain a header!"
+			"\n At function Open in BaseSnapshotFormat.cpp"
+			"\n Path: " + FilePath);
+		return false;
+	}
+	FMemory::Memcpy(&Header, Data.GetData(), sizeof(FHeader));
+	if (Header.Magic != Magic || Header.Version != Version
+		|| !GetSection(Data, Header.ExpansionTypesOffset, Header.NumExpansionTypes, M_ExpansionTypes)
+		|| !GetSection(Data, Header.TrucksOffset, Header.NumTrucks, M_Trucks)
+		|| !GetSection(Data, Header.ExpansionsOffset, Header.NumExpansions, M_Expansions))
+	{
+		RTSFunctionLibrary::ReportError("Base snapshot has an invalid header or version!"
+			"\n At function Open in BaseSnapshotFormat.cpp"
+			"\n Path: " + FilePath + "\n Version: " + FString::FromInt(Header.Version));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,112 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * @brief Binary layout of a nomadic base snapshot.
+ * The file is a header followed by three flat arrays of plain records:
+ * - The expansion type list: every expansion type that appears in the snapshot, once.
+ * - Trucks: transform and building state, with the range of their expansions.
+ * - Expansions: per slot, grouped by truck.
+ * All records are trivially copyable and 8 byte aligned in the file so the arrays are used in place from a
+ * memory mapped file without parsing.
+ */
+namespace BaseSnapshotFormat
+{
+	constexpr uint32 Magic = 0x42535452; // "RTSB"
+	constexpr uint32 Version = 1;
+	constexpr uint32 SectionAlignment = 8;
+
+	struct FHeader
+	{
+		uint32 Magic = BaseSnapshotFormat::Magic;
+		uint32 Version = BaseSnapshotFormat::Version;
+		uint32 NumExpansionTypes = 0;
+		uint32 NumTrucks = 0;
+		uint32 NumExpansions = 0;
+		uint32 ExpansionTypesOffset = 0;
+		uint32 TrucksOffset = 0;
+		uint32 ExpansionsOffset = 0;
+	};
+
+	struct FTruckRecord
+	{
+		float Location[3];
+		float Yaw;
+		// Index of the first expansion of this truck in the expansion array.
+		uint32 FirstExpansion;
+		uint16 NumExpansions;
+		// Whether the truck is converted into its building.
+		uint8 bIsBuilding;
+		uint8 Padding;
+	};
+
+	struct FExpansionRecord
+	{
+		// Placement quantized as in FQuantizedBxpTransform.
+		int32 GridX;
+		int32 GridY;
+		int32 Height;
+		// Index in the expansion type list.
+		uint16 TypeIndex;
+		uint8 SlotIndex;
+		uint8 YawStep;
+		uint8 Status;
+		uint8 Padding[3];
+	};
+
+	static_assert(TIsTriviallyCopyable<FHeader>::Value && sizeof(FHeader) % SectionAlignment == 0);
+	static_assert(TIsTriviallyCopyable<FTruckRecord>::Value && sizeof(FTruckRecord) % 4 == 0);
+	static_assert(TIsTriviallyCopyable<FExpansionRecord>::Value && sizeof(FExpansionRecord) % 4 == 0);
+
+	/**
+	 * @brief Writes the snapshot to the file.
+	 * @param FilePath Where to write the snapshot.
+	 * @param ExpansionTypes The expansion type list, as the underlying values of EBuildingExpansionType.
+	 * @param Trucks The truck records.
+	 * @param Expansions The expansion records, grouped by truck.
+	 * @return Whether the file was written.
+	 */
+	bool Write(
+		const FString& FilePath,
+		TConstArrayView<uint8> ExpansionTypes,
+		TConstArrayView<FTruckRecord> Trucks,
+		TConstArrayView<FExpansionRecord> Expansions);
+
+	/**
+	 * @brief A snapshot file mapped into memory; the record arrays point into the mapping.
+	 * Falls back to reading the file into memory on platforms without memory mapped files.
+	 */
+	class FMappedSnapshot
+	{
+	public:
+		FMappedSnapshot();
+		~FMappedSnapshot();
+
+		/**
+		 * @brief Maps the file and validates the header and the section bounds.
+		 * @return Whether the snapshot can be used.
+		 */
+		bool Open(const FString& FilePath);
+
+		TConstArrayView<uint8> GetExpansionTypes() const { return M_ExpansionTypes; }
+		TConstArrayView<FTruckRecord> GetTrucks() const { return M_Trucks; }
+		TConstArrayView<FExpansionRecord> GetExpansions() const { return M_Expansions; }
+
+	private:
+		TUniquePtr<IMappedFileHandle> M_MappedFile;
+		TUniquePtr<IMappedFileRegion> M_MappedRegion;
+
+		// Only used if the file could not be mapped.
+		TArray<uint8> M_FallbackData;
+
+		TConstArrayView<uint8> M_ExpansionTypes;
+		TConstArrayView<FTruckRecord> M_Trucks;
+		TConstArrayView<FExpansionRecord> M_Expansions;
+	};
+}
@@ -0,0 +1,254 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "NomadicBaseSnapshotSubsystem.h"
+
+#include "EngineUtils.h"
+#include "RTS_Survival/Benchmark/RTSBenchmark.h"
+#include "RTS_Survival/Buildings/BuildingExpansion/BuildingExpansion.h"
+#include "RTS_Survival/Buildings/BuildingExpansion/Interface/BuildingExpansionOwner.h"
+#include "RTS_Survival/Player/BuildingGCClusters/BuildingGCClusterSubsystem.h"
+#include "RTS_Survival/Player/AsyncRTSAssetsSpawner/RTSAsyncSpawner.h"
+#include "RTS_Survival/Player/AsyncRTSAssetsSpawner/BxpReplication/BxpReplicationComponent.h"
+#include "RTS_Survival/Player/AsyncRTSAssetsSpawner/PackedBxp/PackedBxpSubsystem.h"
+#include "RTS_Survival/Player/ConstructionPreview/CPPConstructionPreview.h"
+#include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/NomadicVehicle.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+bool UNomadicBaseSnapshotSubsystem::SaveSnapshot(const FString& FilePath) const
+{
+	using namespace BaseSnapshotFormat;
+	TArray<uint8> ExpansionTypes;
+	TArray<FTruckRecord> Trucks;
+	TArray<FExpansionRecord> Expansions;
+	for (TActorIterator<ANomadicVehicle> It(GetWorld()); It; ++It)
+	{
+		const ANomadicVehicle* Truck = *It;
+		const FVector Location = Truck->GetActorLocation();
+
+		FTruckRecord& TruckRecord = Trucks.AddZeroed_GetRef();
+		TruckRecord.Location[0] = Location.X;
+		TruckRecord.Location[1] = Location.Y;
+		TruckRecord.Location[2] = Location.Z;
+		TruckRecord.Yaw = Truck->GetActorRotation().Yaw;
+		// Trucks that are still converting are saved as trucks.
+		TruckRecord.bIsBuilding = Truck->GetNomadicStatus() == ENomadicStatus::Building;
+		TruckRecord.FirstExpansion = Expansions.Num();
+
+		const UBxpReplicationComponent* BxpReplication = Truck->FindComponentByClass<UBxpReplicationComponent>();
+		const IBuildingExpansionOwner* BxpOwner = Cast<IBuildingExpansionOwner>(Truck);
+		if (!TruckRecord.bIsBuilding || !BxpReplication || !BxpOwner)
+		{
+			continue;
+		}
+		// The expansions are the authority on their status; the slots only provide the quantized placement.
+		TMap<int32, EBuildingExpansionStatus> PlacedStatuses;
+		for (const ABuildingExpansion* Expansion : BxpOwner->GetBuildingExpansions())
+		{
+			if (!IsValid(Expansion))
+			{
+				continue;
+			}
+			const int32 SlotIndex = BxpReplication->FindPlacedSlotIndex(Expansion->GetActorLocation());
+			if (SlotIndex != INDEX_NONE)
+			{
+				PlacedStatuses.Add(SlotIndex, Expansion->GetBuildingExpansionStatus());
+			}
+		}
+		for (const FReplicatedBxpSlot& Slot : BxpReplication->GetSlots())
+		{
+			const EBuildingExpansionStatus* PlacedStatus = PlacedStatuses.Find(Slot.SlotIndex);
+			// Packed expansions have no actor.
+			const bool bIsPacked = !PlacedStatus && Slot.Status == EBuildingExpansionStatus::BXS_PackedUp;
+			if (!PlacedStatus && !bIsPacked)
+			{
+				continue;
+			}
+			FExpansionRecord& ExpansionRecord = Expansions.AddZeroed_GetRef();
+			ExpansionRecord.GridX = Slot.Transform.GridX;
+			ExpansionRecord.GridY = Slot.Transform.GridY;
+			ExpansionRecord.Height = Slot.Transform.Height;
+			ExpansionRecord.YawStep = Slot.Transform.YawStep;
+			ExpansionRecord.TypeIndex = ExpansionTypes.AddUnique(static_cast<uint8>(Slot.ExpansionType));
+			ExpansionRecord.SlotIndex = Slot.SlotIndex;
+			ExpansionRecord.Status = static_cast<uint8>(PlacedStatus ? *PlacedStatus : Slot.Status);
+			++TruckRecord.NumExpansions;
+		}
+	}
+	return Write(FilePath, ExpansionTypes, Trucks, Expansions);
+}
+
+bool UNomadicBaseSnapshotSubsystem::LoadSnapshot(
+	const FString& FilePath,
+	const TSubclassOf<ANomadicVehicle> TruckClass,
+	ARTSAsyncSpawner* AsyncSpawner)
+{
+	if (!TruckClass || !IsValid(AsyncSpawner))
+	{
+		RTSFunctionLibrary::ReportError("Attempt to load base snapshot without truck class or async spawner!"
+			"\n At function LoadSnapshot in NomadicBaseSnapshotSubsystem.cpp");
+		return false;
+	}
+	TUniquePtr<BaseSnapshotFormat::FMappedSnapshot> Snapshot = MakeUnique<BaseSnapshotFormat::FMappedSnapshot>();
+	if (!Snapshot->Open(FilePath))
+	{
+		return false;
+	}
+	M_LoadingSnapshot = MoveTemp(Snapshot);
+	M_TruckClass = TruckClass;
+	M_AsyncSpawner = AsyncSpawner;
+	M_TrucksAwaitingExpansions.Reset();
+
+	// Load every expansion class before the first actor spawns.
+	TArray<EBuildingExpansionType> ExpansionTypes;
+	for (const uint8 ExpansionType : M_LoadingSnapshot->GetExpansionTypes())
+	{
+		ExpansionTypes.Add(static_cast<EBuildingExpansionType>(ExpansionType));
+	}
+	AsyncSpawner->PreloadBuildingExpansionClasses(
+		ExpansionTypes,
+		FStreamableDelegate::CreateUObject(this, &UNomadicBaseSnapshotSubsystem::OnExpansionClassesPreloaded));
+	return true;
+}
+
+void UNomadicBaseSnapshotSubsystem::OnExpansionClassesPreloaded()
+{
+	if (!M_LoadingSnapshot)
+	{
+		return;
+	}
+	RTS_BENCHMARK_SCOPE("BaseSnapshot.SpawnTrucks");
+	const TConstArrayView<BaseSnapshotFormat::FTruckRecord> Trucks = M_LoadingSnapshot->GetTrucks();
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+	for (int32 TruckIndex = 0; TruckIndex < Trucks.Num(); ++TruckIndex)
+	{
+		const BaseSnapshotFormat::FTruckRecord& TruckRecord = Trucks[TruckIndex];
+		const FVector Location(TruckRecord.Location[0], TruckRecord.Location[1], TruckRecord.Location[2]);
+		const FRotator Rotation(0.f, TruckRecord.Yaw, 0.f);
+		ANomadicVehicle* Truck = GetWorld()->SpawnActor<ANomadicVehicle>(M_TruckClass, Location, Rotation,
+		                                                                 SpawnParams);
+		if (!Truck)
+		{
+			RTSFunctionLibrary::ReportError("Failed to spawn nomadic truck from base snapshot!"
+				"\n At function OnExpansionClassesPreloaded in NomadicBaseSnapshotSubsystem.cpp"
+				"\n Truck index: " + FString::FromInt(TruckIndex));
+			continue;
+		}
+		if (TruckRecord.bIsBuilding)
+		{
+			M_TrucksAwaitingExpansions.Add(Truck, TruckIndex);
+			// The truck is already at its building location and converts in place; its expansions are spawned once it
+			// reports the conversion in OnTruckConvertedToBuilding.
+			Truck->CreateBuildingAtLocation(Location, Rotation);
+		}
+	}
+	FinishLoadingIfDone();
+}
+
+void UNomadicBaseSnapshotSubsystem::OnTruckConvertedToBuilding(ANomadicVehicle* ConvertedTruck)
+{
+	int32 TruckIndex = INDEX_NONE;
+	if (!M_LoadingSnapshot || !M_TrucksAwaitingExpansions.RemoveAndCopyValue(ConvertedTruck, TruckIndex))
+	{
+		return;
+	}
+	SpawnExpansions(ConvertedTruck, M_LoadingSnapshot->GetTrucks()[TruckIndex]);
+	FinishLoadingIfDone();
+}
+
+void UNomadicBaseSnapshotSubsystem::SpawnExpansions(
+	ANomadicVehicle* Owner,
+	const BaseSnapshotFormat::FTruckRecord& TruckRecord) const
+{
+	RTS_BENCHMARK_SCOPE("BaseSnapshot.SpawnExpansions");
+	IBuildingExpansionOwner* BxpOwner = Cast<IBuildingExpansionOwner>(Owner);
+	const ARTSAsyncSpawner* AsyncSpawner = M_AsyncSpawner.Get();
+	const TConstArrayView<uint8> ExpansionTypes = M_LoadingSnapshot->GetExpansionTypes();
+	const TConstArrayView<BaseSnapshotFormat::FExpansionRecord> Expansions = M_LoadingSnapshot->GetExpansions();
+	const uint64 EndExpansion = static_cast<uint64>(TruckRecord.FirstExpansion) + TruckRecord.NumExpansions;
+	if (!BxpOwner || !AsyncSpawner || EndExpansion > static_cast<uint64>(Expansions.Num()))
+	{
+		RTSFunctionLibrary::ReportError("Cannot restore the expansions of a truck from the base snapshot!"
+			"\n At function SpawnExpansions in NomadicBaseSnapshotSubsystem.cpp"
+			"\n Truck: " + Owner->GetName());
+		return;
+	}
+	UBxpReplicationComponent* BxpReplication = Owner->FindComponentByClass<UBxpReplicationComponent>();
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	for (const BaseSnapshotFormat::FExpansionRecord& Record :
+	     Expansions.Slice(TruckRecord.FirstExpansion, TruckRecord.NumExpansions))
+	{
+		if (!ExpansionTypes.IsValidIndex(Record.TypeIndex))
+		{
+			continue;
+		}
+		const auto ExpansionType = static_cast<EBuildingExpansionType>(ExpansionTypes[Record.TypeIndex]);
+		const auto Status = static_cast<EBuildingExpansionStatus>(Record.Status);
+		if (Status == EBuildingExpansionStatus::BXS_PackedUp)
+		{
+			// Packed expansions only exist as records until they are unpacked; the snapshot has no health or
+			// upgrades, so they are restored as new.
+			GetWorld()->GetSubsystem<UPackedBxpSubsystem>()->PackExpansion(BxpOwner, nullptr, ExpansionType,
+			                                                               Record.SlotIndex, nullptr, 1.f, 0);
+			if (BxpReplication && Owner->HasAuthority())
+			{
+				BxpReplication->SetSlotState(Record.SlotIndex, ExpansionType, Status);
+			}
+			continue;
+		}
+		// Resident since the preload, so the expansion spawns without waiting for a load.
+		UClass* ExpansionClass = AsyncSpawner->GetLoadedBuildingExpansionClass(ExpansionType);
+		FQuantizedBxpTransform Transform;
+		Transform.GridX = Record.GridX;
+		Transform.GridY = Record.GridY;
+		Transform.Height = Record.Height;
+		Transform.YawStep = Record.YawStep;
+		const FVector Location = Transform.GetLocation();
+		const FRotator Rotation = Transform.GetRotation(ACPPConstructionPreview::RotationStepDegrees);
+		ABuildingExpansion* BuildingExpansion = ExpansionClass
+			                                        ? GetWorld()->SpawnActor<ABuildingExpansion>(
+				                                        ExpansionClass, Location, Rotation, SpawnParams)
+			                                        : nullptr;
+		if (!BuildingExpansion)
+		{
+			RTSFunctionLibrary::ReportError("Failed to spawn building expansion from base snapshot!"
+				"\n At function SpawnExpansions in NomadicBaseSnapshotSubsystem.cpp"
+				"\n Type: " + FString::FromInt(static_cast<int32>(ExpansionType)));
+			continue;
+		}
+		BxpOwner->OnBuildingExpansionCreated(BuildingExpansion, Record.SlotIndex, ExpansionType, false);
+		BuildingExpansion->StartExpansionConstructionAtLocation(Location, Rotation);
+		if (Status == EBuildingExpansionStatus::BXS_Built)
+		{
+			// Was done before the save; only expansions that were under construction build again.
+			BuildingExpansion->FinishExpansionConstruction();
+		}
+		GetWorld()->GetSubsystem<UBuildingGCClusterSubsystem>()->RegisterBuilding(BuildingExpansion);
+		if (BxpReplication && Owner->HasAuthority())
+		{
+			BxpReplication->SetSlotState(Record.SlotIndex, ExpansionType,
+			                             BuildingExpansion->GetBuildingExpansionStatus());
+			BxpReplication->SetSlotTransform(Record.SlotIndex, Location, Rotation);
+			BxpReplication->TrackConstruction(Record.SlotIndex, BuildingExpansion);
+		}
+	}
+}
+
+void UNomadicBaseSnapshotSubsystem::FinishLoadingIfDone()
+{
+	if (M_TrucksAwaitingExpansions.IsEmpty())
+	{
+		// Unmaps the snapshot file.
+		M_LoadingSnapshot.Reset();
+	}
+}
+
+void UNomadicBaseSnapshotSubsystem::Deinitialize()
+{
+	M_LoadingSnapshot.Reset();
+	M_TrucksAwaitingExpansions.Reset();
+	Super::Deinitialize();
+}
@@ -0,0 +1,72 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BaseSnapshotFormat.h"
+#include "Subsystems/WorldSubsystem.h"
+
+#include "NomadicBaseSnapshotSubsystem.generated.h"
+
+class ANomadicVehicle;
+class ARTSAsyncSpawner;
+
+/**
+ * @brief Saves and restores nomadic bases with a flat binary snapshot, see BaseSnapshotFormat.
+ * Saving reads the trucks and the expansion slots of their UBxpReplicationComponent.
+ * Loading maps the snapshot, preloads the classes of every expansion type in the snapshot in one request, and
+ * only then spawns all trucks in one pass. The expansions of a truck are spawned in bulk as soon as the truck
+ * is converted into its building; their classes are resident so no expansion waits for a load.
+ * Built expansions are restored as built, packed expansions as records of the UPackedBxpSubsystem and expansions
+ * that were under construction start their construction again.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UNomadicBaseSnapshotSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Writes all nomadic trucks in the world with their expansions to the file.
+	 * @return Whether the snapshot was written.
+	 */
+	bool SaveSnapshot(const FString& FilePath) const;
+
+	/**
+	 * @brief Starts restoring the snapshot.
+	 * @param FilePath The snapshot to load.
+	 * @param TruckClass The class of the trucks to spawn.
+	 * @param AsyncSpawner Loads the expansion classes.
+	 * @return Whether the snapshot could be opened; the trucks spawn once the expansion classes are loaded.
+	 */
+	bool LoadSnapshot(const FString& FilePath, TSubclassOf<ANomadicVehicle> TruckClass,
+	                  ARTSAsyncSpawner* AsyncSpawner);
+
+	/**
+	 * @brief Spawns the expansions of a restored truck once it is converted into its building.
+	 * @param ConvertedTruck The truck that converted.
+	 * @note Called by ACPPController::TruckConverted.
+	 */
+	void OnTruckConvertedToBuilding(ANomadicVehicle* ConvertedTruck);
+
+	virtual void Deinitialize() override;
+
+private:
+	// The snapshot that is being restored; kept mapped until all trucks have their expansions.
+	TUniquePtr<BaseSnapshotFormat::FMappedSnapshot> M_LoadingSnapshot;
+
+	TSubclassOf<ANomadicVehicle> M_TruckClass;
+
+	TWeakObjectPtr<ARTSAsyncSpawner> M_AsyncSpawner;
+
+	// Restored trucks that wait for their conversion, mapped to the index of their record.
+	TMap<TWeakObjectPtr<ANomadicVehicle>, int32> M_TrucksAwaitingExpansions;
+
+	/** @brief Spawns all trucks of the loading snapshot. */
+	void OnExpansionClassesPreloaded();
+
+	/** @brief Spawns the expansions of the truck record for the owner. */
+	void SpawnExpansions(ANomadicVehicle* Owner, const BaseSnapshotFormat::FTruckRecord& TruckRecord) const;
+
+	void FinishLoadingIfDone();
+};
@@ -0,0 +1,223 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "BuildingGCClusterSubsystem.h"
+
+#include "HAL/IConsoleManager.h"
+#include "UObject/UObjectArray.h"
+#include "UObject/UObjectHash.h"
+#include "RTS_Survival/Benchmark/RTSBenchmark.h"
+#include "RTS_Survival/Buildings/BuildingExpansion/BuildingExpansion.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Clustered expansions"), STAT_RTSClusteredExpansions, STATGROUP_RTSBuildingGC);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Unclustered buildings"), STAT_RTSUnclusteredBuildings, STATGROUP_RTSBuildingGC);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Objects in expansion clusters"), STAT_RTSClusteredBuildingObjects,
+                               STATGROUP_RTSBuildingGC);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Building objects traversed one by one"), STAT_RTSTraversedBuildingObjects,
+                               STATGROUP_RTSBuildingGC);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Last GC (ms)"), STAT_RTSLastGCMs, STATGROUP_RTSBuildingGC);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("GC time share of building objects (ms)"), STAT_RTSBuildingObjectShareMs,
+                               STATGROUP_RTSBuildingGC);
+
+void UBuildingGCClusterSubsystem::RegisterBuilding(AActor* Building)
+{
+	if (!IsValid(Building) || M_Buildings.ContainsByPredicate([Building](const FTrackedBuilding& Entry)
+	{
+		return Entry.Building.Get() == Building;
+	}))
+	{
+		return;
+	}
+	FTrackedBuilding& Entry = M_Buildings.AddDefaulted_GetRef();
+	Entry.Building = Building;
+	Entry.bIsWaitingForBuilt = Building->IsA<ABuildingExpansion>();
+	if (Entry.bIsWaitingForBuilt)
+	{
+		++M_NumWaitingExpansions;
+	}
+	Building->OnEndPlay.AddUniqueDynamic(this, &UBuildingGCClusterSubsystem::OnBuildingEndPlay);
+}
+
+void UBuildingGCClusterSubsystem::UnregisterBuilding(AActor* Building)
+{
+	const int32 Index = M_Buildings.IndexOfByPredicate([Building](const FTrackedBuilding& Entry)
+	{
+		return Entry.Building.Get() == Building;
+	});
+	if (Index == INDEX_NONE)
+	{
+		return;
+	}
+	if (M_Buildings[Index].bIsClustered)
+	{
+		DissolveCluster(Building);
+	}
+	if (M_Buildings[Index].bIsWaitingForBuilt)
+	{
+		--M_NumWaitingExpansions;
+	}
+	if (IsValid(Building))
+	{
+		Building->OnEndPlay.RemoveDynamic(this, &UBuildingGCClusterSubsystem::OnBuildingEndPlay);
+	}
+	M_Buildings.RemoveAtSwap(Index);
+}
+
+void UBuildingGCClusterSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	M_PreGCHandle = FCoreUObjectDelegates::GetPreGarbageCollectDelegate().AddUObject(
+		this, &UBuildingGCClusterSubsystem::OnPreGarbageCollect);
+	M_PostGCHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddUObject(
+		this, &UBuildingGCClusterSubsystem::OnPostGarbageCollect);
+}
+
+void UBuildingGCClusterSubsystem::Deinitialize()
+{
+	FCoreUObjectDelegates::GetPreGarbageCollectDelegate().Remove(M_PreGCHandle);
+	FCoreUObjectDelegates::GetPostGarbageCollect().Remove(M_PostGCHandle);
+	for (const FTrackedBuilding& Entry : M_Buildings)
+	{
+		if (Entry.bIsClustered && Entry.Building.IsValid())
+		{
+			DissolveCluster(Entry.Building.Get());
+		}
+	}
+	M_Buildings.Empty();
+	M_NumWaitingExpansions = 0;
+	Super::Deinitialize();
+}
+
+void UBuildingGCClusterSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	M_TimeSinceBuiltCheck += DeltaTime;
+	if (M_TimeSinceBuiltCheck < BuiltCheckInterval)
+	{
+		return;
+	}
+	M_TimeSinceBuiltCheck = 0.f;
+	// Construction completion has no callback, so expansions under construction are polled.
+	for (int32 i = M_Buildings.Num() - 1; i >= 0; --i)
+	{
+		FTrackedBuilding& Entry = M_Buildings[i];
+		if (!Entry.bIsWaitingForBuilt)
+		{
+			continue;
+		}
+		const ABuildingExpansion* Expansion = Cast<ABuildingExpansion>(Entry.Building.Get());
+		if (!IsValid(Expansion))
+		{
+			--M_NumWaitingExpansions;
+			M_Buildings.RemoveAtSwap(i);
+			continue;
+		}
+		if (Expansion->GetBuildingExpansionStatus() != EBuildingExpansionStatus::BXS_Built)
+		{
+			continue;
+		}
+		Entry.bIsWaitingForBuilt = false;
+		--M_NumWaitingExpansions;
+		Entry.bIsClustered = CreateExpansionCluster(Entry.Building.Get());
+	}
+}
+
+TStatId UBuildingGCClusterSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UBuildingGCClusterSubsystem, STATGROUP_Tickables);
+}
+
+bool UBuildingGCClusterSubsystem::CreateExpansionCluster(AActor* Expansion)
+{
+	static const IConsoleVariable* CreateClustersVar =
+		IConsoleManager::Get().FindConsoleVariable(TEXT("gc.CreateGCClusters"));
+	if (CreateClustersVar && !CreateClustersVar->GetBool())
+	{
+		return false;
+	}
+	Expansion->CreateCluster();
+	const FUObjectItem* RootItem = GUObjectArray.ObjectToObjectItem(Expansion);
+	// No cluster is made if the expansion is already part of another cluster or nothing could be added to it.
+	return RootItem && RootItem->HasAnyFlags(EInternalObjectFlags::ClusterRoot);
+}
+
+void UBuildingGCClusterSubsystem::DissolveCluster(AActor* Building)
+{
+	const FUObjectItem* RootItem = GUObjectArray.ObjectToObjectItem(Building);
+	if (RootItem && RootItem->HasAnyFlags(EInternalObjectFlags::ClusterRoot))
+	{
+		GUObjectClusters.DissolveCluster(Building);
+	}
+}
+
+void UBuildingGCClusterSubsystem::OnBuildingEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason)
+{
+	// Dissolve before the actor and its components are marked as garbage.
+	UnregisterBuilding(Actor);
+}
+
+bool UBuildingGCClusterSubsystem::IsMeasuring()
+{
+#if STATS
+	if (FThreadStats::IsCollectingData())
+	{
+		return true;
+	}
+#endif
+	return FRTSBenchmark::Get().IsRecording();
+}
+
+void UBuildingGCClusterSubsystem::OnPreGarbageCollect()
+{
+	M_GCStartSeconds = FPlatformTime::Seconds();
+}
+
+void UBuildingGCClusterSubsystem::OnPostGarbageCollect()
+{
+	// Walking the outers of every building is as expensive as what it measures; only do it when someone looks.
+	if (!IsMeasuring())
+	{
+		return;
+	}
+	const double GCMs = (FPlatformTime::Seconds() - M_GCStartSeconds) * 1000.0;
+	uint32 NumClustered = 0;
+	uint32 NumClusteredObjects = 0;
+	uint32 NumTraversedObjects = 0;
+	TArray<UObject*> InnerObjects;
+	for (const FTrackedBuilding& Entry : M_Buildings)
+	{
+		AActor* Building = Entry.Building.Get();
+		if (!Building)
+		{
+			continue;
+		}
+		const FUObjectItem* RootItem = GUObjectArray.ObjectToObjectItem(Building);
+		if (Entry.bIsClustered && RootItem && RootItem->HasAnyFlags(EInternalObjectFlags::ClusterRoot))
+		{
+			++NumClustered;
+			NumClusteredObjects += GUObjectClusters[RootItem->GetClusterIndex()].Objects.Num();
+			// The collector only visits the root of a cluster.
+			++NumTraversedObjects;
+			continue;
+		}
+		InnerObjects.Reset();
+		GetObjectsWithOuter(Building, InnerObjects, true);
+		NumTraversedObjects += 1 + InnerObjects.Num();
+	}
+	// Not a measurement of reachability time: the GC time is scaled by the share of live objects that are building
+	// objects visited one by one.
+	const int32 NumLiveObjects = FMath::Max(1, GUObjectArray.GetObjectArrayNumMinusAvailable());
+	const double BuildingShareMs = GCMs * NumTraversedObjects / NumLiveObjects;
+
+	SET_DWORD_STAT(STAT_RTSClusteredExpansions, NumClustered);
+	SET_DWORD_STAT(STAT_RTSUnclusteredBuildings, M_Buildings.Num() - NumClustered);
+	SET_DWORD_STAT(STAT_RTSClusteredBuildingObjects, NumClusteredObjects);
+	SET_DWORD_STAT(STAT_RTSTraversedBuildingObjects, NumTraversedObjects);
+	SET_FLOAT_STAT(STAT_RTSLastGCMs, GCMs);
+	SET_FLOAT_STAT(STAT_RTSBuildingObjectShareMs, BuildingShareMs);
+
+	static const FName GCMetric("GC.Total");
+	static const FName BuildingMetric("GC.BuildingObjectShare");
+	FRTSBenchmark::Get().AddSample(GCMetric, GCMs);
+	FRTSBenchmark::Get().AddSample(BuildingMetric, BuildingShareMs);
+}
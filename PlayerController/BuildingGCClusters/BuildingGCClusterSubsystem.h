@@ -0,0 +1,93 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+
+#include "BuildingGCClusterSubsystem.generated.h"
+
+DECLARE_STATS_GROUP(TEXT("RTS Building GC"), STATGROUP_RTSBuildingGC, STATCAT_Advanced);
+
+/**
+ * @brief Groups built expansions and their components into garbage collection clusters, so reachability analysis
+ * visits each expansion as one object instead of walking the actor, its components and their materials one by one.
+ * An expansion is clustered once its construction completes (BXS_Built); the cluster is dissolved when the
+ * expansion ends play, which covers both destroying and packing it.
+ * Converted trucks are tracked for the stats only; they keep creating expansions and are not clustered.
+ * Use `stat RTSBuildingGC` for the numbers; benchmark recordings get them as GC.* metrics. Nothing is counted
+ * while neither is active.
+ * @note The building share is the GC time scaled by the share of live objects that are building objects the
+ * collector still visits one by one; it is an estimate, not a measurement of reachability time.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UBuildingGCClusterSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Counts the objects of the building from the next garbage collection on; expansions are clustered once
+	 * they are built.
+	 * @param Building The converted truck or placed expansion.
+	 */
+	void RegisterBuilding(AActor* Building);
+
+	/**
+	 * @brief Dissolves the cluster of the building and stops counting its objects, e.g. when a truck converts back
+	 * into a vehicle.
+	 * @param Building The building to unregister.
+	 */
+	void UnregisterBuilding(AActor* Building);
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual bool IsTickable() const override { return M_NumWaitingExpansions > 0; }
+
+private:
+	// How often expansions under construction are checked for completion.
+	static constexpr float BuiltCheckInterval = 0.5f;
+
+	struct FTrackedBuilding
+	{
+		TWeakObjectPtr<AActor> Building;
+
+		// Whether the building is an expansion that is not built yet.
+		bool bIsWaitingForBuilt = false;
+
+		bool bIsClustered = false;
+	};
+
+	TArray<FTrackedBuilding> M_Buildings;
+
+	int32 M_NumWaitingExpansions = 0;
+
+	float M_TimeSinceBuiltCheck = 0.f;
+
+	double M_GCStartSeconds = 0.0;
+
+	FDelegateHandle M_PreGCHandle;
+	FDelegateHandle M_PostGCHandle;
+
+	/**
+	 * @brief Creates the cluster with the expansion actor as root; its components and their subobjects join it.
+	 * @return Whether a cluster exists for the expansion afterwards.
+	 */
+	static bool CreateExpansionCluster(AActor* Expansion);
+
+	static void DissolveCluster(AActor* Building);
+
+	UFUNCTION()
+	void OnBuildingEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason);
+
+	/** @return Whether the stats are shown or a benchmark is recording. */
+	static bool IsMeasuring();
+
+	void OnPreGarbageCollect();
+
+	/** @brief Publishes the GC duration, the cluster counts and the GC time share of building objects. */
+	void OnPostGarbageCollect();
+};
@@ -3,8 +3,13 @@
 #include "CPPController.h"
 
 #include "Abilities.h"
+#include "EngineUtils.h"
 #include "PlacementEffects.h"
 #include "AsyncRTSAssetsSpawner/RTSAsyncSpawner.h"
+#include "AsyncRTSAssetsSpawner/BxpReplication/BxpReplicationComponent.h"
+#include "AsyncRTSAssetsSpawner/PackedBxp/PackedBxpSubsystem.h"
+#include "BaseSnapshot/NomadicBaseSnapshotSubsystem.h"
+#include "BuildingGCClusters/BuildingGCClusterSubsystem.h"
 #include "Camera/CameraPawn.h"
 #include "Camera/RTSCamera.h"
 #include "HUD/CPPHUD.h"
@@ -23,14 +28,63 @@
 #include "RTS_Survival/Units/CPP_UnitMaster.h"
 #include "RTS_Survival/Units/SquadController.h"
 #include "RTS_Survival/Units/Enums/Enum_UnitType.h"
+#include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/AINomadicVehicle.h"
+#include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/BaseProxy/NomadicBaseProxySubsystem.h"
 #include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/NomadicVehicle.h"
+#include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/ConversionScheduler/NomadicConversionScheduler.h"
 #include "RTS_Survival/Utils/HFunctionLibary.h"
 #include "RTS_Survival/Utils/Navigator/RTSNavigator.h"
 
 //...
 
+namespace
+{
+	/** @return The replication component of the expansion owner if we are the server for it, null otherwise. */
+	UBxpReplicationComponent* GetAuthorityBxpReplication(IBuildingExpansionOwner* BxpOwner)
+	{
+		const AActor* OwnerActor = Cast<AActor>(BxpOwner);
+		if (!OwnerActor || !OwnerActor->HasAuthority())
+		{
+			return nullptr;
+		}
+		return OwnerActor->FindComponentByClass<UBxpReplicationComponent>();
+	}
+
+	/**
+	 * @brief Replicates that the expansion of the slot is packed up or gone.
+	 * @param BxpOwner The owner of the expansion.
+	 * @param SlotIndex The slot of the expansion, ignored if INDEX_NONE.
+	 * @param bIsPacked Whether the expansion is kept as packed expansion; otherwise the slot is freed.
+	 */
+	void ReplicateBxpSlotRemoved(IBuildingExpansionOwner* BxpOwner, const int32 SlotIndex, const bool bIsPacked)
+	{
+		UBxpReplicationComponent* BxpReplication = GetAuthorityBxpReplication(BxpOwner);
+		if (!BxpReplication || SlotIndex == INDEX_NONE)
+		{
+			return;
+		}
+		if (!bIsPacked)
+		{
+			BxpReplication->RemoveSlot(SlotIndex);
+			return;
+		}
+		if (const FReplicatedBxpSlot* Slot = BxpReplication->GetSlot(SlotIndex))
+		{
+			BxpReplication->SetSlotState(SlotIndex, Slot->ExpansionType, EBuildingExpansionStatus::BXS_PackedUp);
+		}
+	}
+
+	/** @brief Lets the distance proxy of the owner's base know that the base is about to change. */
+	void NotifyBaseChanged(const UWorld* World, IBuildingExpansionOwner* BxpOwner)
+	{
+		AActor* OwnerActor = Cast<AActor>(BxpOwner);
+		World->GetSubsystem<UNomadicBaseProxySubsystem>()->OnBaseChanged(OwnerActor);
+	}
+}
+
 void ACPPController::ConstructBuilding(AActor* RequestingActor)
 {
+	FBuildingReplayRecorder::Get().RecordActorInput(EBuildingReplayEvent::BRE_ConstructBuilding, RequestingActor);
 	if (RequestingActor && RequestingActor->IsA(ANomadicVehicle::StaticClass()))
 	{
 		if (ANomadicVehicle* NomadicVehicle = Cast<ANomadicVehicle>(RequestingActor))
@@ -41,7 +95,8 @@ void ACPPController::ConstructBuilding(AActor* RequestingActor)
 				RTSFunctionLibrary::PrintString("ConstructBuilding: " + NomadicVehicle->GetName());
 			}
 			
-			CPPConstructionPreviewRef->StartBuildingPreview(NomadicVehicle->GetPreviewMesh());
+			CPPConstructionPreviewRef->StartBuildingPreview(NomadicVehicle->GetPreviewMesh(), FVector::ZeroVector, 0,
+			                                                EPlacementCategory::PC_NomadicHQ);
 			m_IsBuildingPreviewModeActive = EBuildingPreviewMode::NomadicPreviewMode;
 			m_ActiveAbility = EAbilityID::IdCreateBuilding;
 			// Note that we do not call the MainGameUI to show the cancel button as this is already
@@ -52,10 +107,13 @@ void ACPPController::ConstructBuilding(AActor* RequestingActor)
 
 void ACPPController::ConvertBackToVehicle(AActor* RequestingActor)
 {
+	FBuildingReplayRecorder::Get().RecordActorInput(EBuildingReplayEvent::BRE_ConvertBackToVehicle, RequestingActor);
 	if (RequestingActor)
 	{
 		if (ANomadicVehicle* NomadicVehicle = Cast<ANomadicVehicle>(RequestingActor))
 		{
+			CancelQueuedBuildingConversion(NomadicVehicle);
+			// The AI wakes up in TruckConverted once the truck is a vehicle again.
 			NomadicVehicle->ConvertToVehicle(true);
 		}
 	}
@@ -63,22 +121,232 @@ void ACPPController::ConvertBackToVehicle(AActor* RequestingActor)
 
 void ACPPController::CancelVehicleConversion(AActor* RequestingActor)
 {
+	FBuildingReplayRecorder::Get().RecordActorInput(EBuildingReplayEvent::BRE_CancelVehicleConversion,
+	                                                RequestingActor);
 	if (RequestingActor)
 	{
 		if (ANomadicVehicle* NomadicVehicle = Cast<ANomadicVehicle>(RequestingActor))
 		{
+			CancelQueuedBuildingConversion(NomadicVehicle);
 			NomadicVehicle->SetUnitToIdle();
 		}
 	}
 }
 
+bool ACPPController::NomadicFormationConvertToBuilding(const FVector& ClickedLocation)
+{
+	TArray<ANomadicVehicle*> NomadicVehicles;
+	GetSelectedNomadicVehicles(NomadicVehicles);
+	return StartFormationPlacement(NomadicVehicles, ClickedLocation);
+}
+
+bool ACPPController::StartFormationPlacement(
+	const TArray<ANomadicVehicle*>& NomadicVehicles,
+	const FVector& ClickedLocation)
+{
+	if (NomadicVehicles.Num() <= 1)
+	{
+		return false;
+	}
+	const FRotator BuildingRotation = CPPConstructionPreviewRef->GetPreviewRotation();
+	// The trucks are recorded so the replay deploys the same trucks regardless of its selection.
+	for (const ANomadicVehicle* NomadicVehicle : NomadicVehicles)
+	{
+		FBuildingReplayRecorder::Get().RecordActorInput(EBuildingReplayEvent::BRE_FormationTruck, NomadicVehicle);
+	}
+	FBuildingReplayRecorder::Get().RecordPlacement(GetWorld(), ClickedLocation, BuildingRotation.Yaw,
+	                                               EBuildingReplayEvent::BRE_PlaceFormation);
+	// The rotation travels with the delegate so a later order does not change the rotation of this one.
+	NomadicFormationPlacement::SolveAsync(
+		GetWorld(),
+		NomadicVehicles,
+		CPPConstructionPreviewRef->GetPreviewMesh(),
+		ClickedLocation,
+		BuildingRotation,
+		FOnFormationPlacementSolved::CreateUObject(this, &ACPPController::OnFormationPlacementSolved,
+		                                           BuildingRotation));
+	// The command is propagated to the trucks once the sites are known.
+	StopPreviewAndBuildingMode();
+	return true;
+}
+
+void ACPPController::OnFormationPlacementSolved(
+	const TArray<FNomadicSiteAssignment>& Assignments,
+	const FRotator BuildingRotation)
+{
+	const UNomadicConversionScheduler* ConversionScheduler = GetWorld()->GetSubsystem<UNomadicConversionScheduler>();
+	for (const FNomadicSiteAssignment& Assignment : Assignments)
+	{
+		ANomadicVehicle* NomadicVehicle = Assignment.NomadicVehicle.Get();
+		// The truck may have started converting through another order while the sites were solved.
+		if (NomadicVehicle && IsNomadicVehicleDeployable(NomadicVehicle, ConversionScheduler))
+		{
+			NomadicVehicle->CreateBuildingAtLocation(Assignment.BuildingLocation, BuildingRotation);
+		}
+	}
+	if (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+	{
+		RTSFunctionLibrary::PrintString("Formation placement assigned sites: " + FString::FromInt(Assignments.Num()));
+	}
+}
+
+void ACPPController::GetSelectedNomadicVehicles(TArray<ANomadicVehicle*>& OutNomadicVehicles) const
+{
+	const UNomadicConversionScheduler* ConversionScheduler = GetWorld()->GetSubsystem<UNomadicConversionScheduler>();
+	for (ACPP_UnitMaster* SelectedUnit : SelectedUnits)
+	{
+		ANomadicVehicle* NomadicVehicle = Cast<ANomadicVehicle>(SelectedUnit);
+		if (NomadicVehicle && IsNomadicVehicleDeployable(NomadicVehicle, ConversionScheduler))
+		{
+			OutNomadicVehicles.Add(NomadicVehicle);
+		}
+	}
+}
+
+bool ACPPController::IsNomadicVehicleDeployable(
+	const ANomadicVehicle* NomadicVehicle,
+	const UNomadicConversionScheduler* ConversionScheduler)
+{
+	// Buildings and trucks that are already moving to or converting at a site do not get a second site.
+	return NomadicVehicle->GetNomadicStatus() == ENomadicStatus::Truck
+		&& (!ConversionScheduler || !ConversionScheduler->IsConversionQueued(NomadicVehicle));
+}
+
+void ACPPController::CancelQueuedBuildingConversion(const ANomadicVehicle* NomadicVehicle) const
+{
+	if (UNomadicConversionScheduler* ConversionScheduler = GetWorld()->GetSubsystem<UNomadicConversionScheduler>())
+	{
+		if (ConversionScheduler->CancelConversion(NomadicVehicle)
+			&& DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+		{
+			RTSFunctionLibrary::PrintString("Cancelled queued building conversion of: " + NomadicVehicle->GetName());
+		}
+	}
+}
+
 void ACPPController::TruckConverted(
 	ANomadicVehicle* ConvertedTruck,
 	const bool bConvertedToBuilding) const
 {
 	M_MainGameUI->OnTruckConverted(ConvertedTruck, bConvertedToBuilding);
+	if (bConvertedToBuilding)
+	{
+		// Restores the expansions if the truck was spawned from a base snapshot.
+		GetWorld()->GetSubsystem<UNomadicBaseSnapshotSubsystem>()->OnTruckConvertedToBuilding(ConvertedTruck);
+		GetWorld()->GetSubsystem<UBuildingGCClusterSubsystem>()->RegisterBuilding(ConvertedTruck);
+		GetWorld()->GetSubsystem<UNomadicBaseProxySubsystem>()->RegisterBase(ConvertedTruck);
+	}
+	else
+	{
+		GetWorld()->GetSubsystem<UBuildingGCClusterSubsystem>()->UnregisterBuilding(ConvertedTruck);
+		GetWorld()->GetSubsystem<UNomadicBaseProxySubsystem>()->UnregisterBase(ConvertedTruck);
+	}
+	if (AAINomadicVehicle* NomadicAI = Cast<AAINomadicVehicle>(ConvertedTruck->GetController()))
+	{
+		// A parked building does not need its behaviour tree, blackboard or perception.
+		if (bConvertedToBuilding)
+		{
+			NomadicAI->EnterDormantAIMode();
+		}
+		else
+		{
+			NomadicAI->ExitDormantAIMode();
+		}
+	}
+}
+
+
+void ACPPController::RequestPlacementValidation(
+	const FVector& Location,
+	const FRotator& Rotation,
+	AActor* Host,
+	const EBuildingExpansionType ExpansionType,
+	const EPlacementCategory Category,
+	FOnPlacementValidated OnValidated)
+{
+	if (GetNetMode() != NM_Client)
+	{
+		// We are the authority; the preview already validated the placement.
+		OnValidated.ExecuteIfBound(true);
+		return;
+	}
+	FPlacementRequestMessage Request;
+	Request.RequestId = M_NextPlacementRequestId;
+	M_NextPlacementRequestId = (M_NextPlacementRequestId + 1) & FPlacementReplyMessage::RequestIdMask;
+	Request.Location = Location;
+	Request.CompressedYaw = FRotator::CompressAxisToByte(Rotation.Yaw);
+	Request.Category = Category;
+	Request.ExpansionType = ExpansionType;
+	Request.Host = Host;
+	M_PendingPlacementValidations.Add(
+		Request.RequestId, {MoveTemp(OnValidated), FPlatformTime::Seconds() + PlacementReplyTimeoutSeconds});
+	if (!GetWorldTimerManager().IsTimerActive(M_PlacementTimeoutHandle))
+	{
+		GetWorldTimerManager().SetTimer(M_PlacementTimeoutHandle, this, &ACPPController::ExpirePlacementValidations,
+		                                1.f, true);
+	}
+	ServerRequestPlacement(Request);
+}
+
+void ACPPController::ExpirePlacementValidations()
+{
+	const double Now = FPlatformTime::Seconds();
+	TArray<FOnPlacementValidated, TInlineAllocator<4>> TimedOut;
+	for (auto It = M_PendingPlacementValidations.CreateIterator(); It; ++It)
+	{
+		if (It.Value().TimeoutTime <= Now)
+		{
+			TimedOut.Add(MoveTemp(It.Value().OnValidated));
+			It.RemoveCurrent();
+		}
+	}
+	if (M_PendingPlacementValidations.IsEmpty())
+	{
+		GetWorldTimerManager().ClearTimer(M_PlacementTimeoutHandle);
+	}
+	// Called after the map is updated as a callback may request a new placement.
+	for (const FOnPlacementValidated& OnValidated : TimedOut)
+	{
+		if constexpr (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+		{
+			RTSFunctionLibrary::PrintString("Placement request timed out without reply of the server", FColor::Red);
+		}
+		OnValidated.ExecuteIfBound(false);
+	}
 }
 
+void ACPPController::ServerRequestPlacement_Implementation(const FPlacementRequestMessage& Request)
+{
+	if (UServerPlacementValidationSubsystem* ServerPlacementValidation =
+		GetWorld()->GetSubsystem<UServerPlacementValidationSubsystem>())
+	{
+		ServerPlacementValidation->QueueRequest(this, Request);
+	}
+}
+
+void ACPPController::ClientReceivePlacementReplies_Implementation(const TArray<FPlacementReplyMessage>& Replies)
+{
+	for (const FPlacementReplyMessage& Reply : Replies)
+	{
+		FPendingPlacementValidation Pending;
+		if (!M_PendingPlacementValidations.RemoveAndCopyValue(Reply.GetRequestId(), Pending))
+		{
+			// The request timed out before the reply arrived.
+			if constexpr (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+			{
+				RTSFunctionLibrary::PrintString("Received placement reply for expired request: "
+					+ FString::FromInt(Reply.GetRequestId()), FColor::Red);
+			}
+			continue;
+		}
+		if (!Reply.GetIsAccepted() && DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+		{
+			RTSFunctionLibrary::PrintString("Server rejected placement request: "
+				+ FString::FromInt(Reply.GetRequestId()), FColor::Red);
+		}
+		Pending.OnValidated.ExecuteIfBound(Reply.GetIsAccepted());
+	}
+}
 
 void ACPPController::ExpandBuildingWithType(
 	const EBuildingExpansionType BuildingExpansionType,
@@ -86,13 +354,29 @@ void ACPPController::ExpandBuildingWithType(
 	const int ExpansionSlotIndex,
 	const bool bIsUnpackedExpansion)
 {
-
+	FBuildingReplayRecorder::Get().RecordExpansionInput(EBuildingReplayEvent::BRE_ExpandBuilding,
+	                                                    Cast<AActor>(BuildingExpansionOwner),
+	                                                    static_cast<uint8>(BuildingExpansionType),
+	                                                    ExpansionSlotIndex, bIsUnpackedExpansion);
 	// Callback to OnBxpSpawnedAsync when the loading is complete.
-	M_RTSAsyncSpawner->AsyncSpawnBuildingExpansion(BuildingExpansionType, BuildingExpansionOwner, ExpansionSlotIndex,
-	                                               bIsUnpackedExpansion);
+	// A packed expansion is only a record until it is unpacked, the subsystem spawns it from that record.
+	// Kept until the expansion is placed or cancelled, which need to know the slot.
+	M_AsyncBxpRequestState.InitSuccessfulRequest(EAsyncBxpStatus::Async_SpawnedPreview_WaitForBuildingMesh,
+	                                             ExpansionSlotIndex, BuildingExpansionOwner, bIsUnpackedExpansion);
+	const bool bIsUnpackedFromRecord = bIsUnpackedExpansion && GetWorld()->GetSubsystem<UPackedBxpSubsystem>()->
+		UnpackExpansion(BuildingExpansionOwner, ExpansionSlotIndex, M_RTSAsyncSpawner);
+	if (!bIsUnpackedFromRecord)
+	{
+		M_RTSAsyncSpawner->AsyncSpawnBuildingExpansion(BuildingExpansionType, BuildingExpansionOwner,
+		                                               ExpansionSlotIndex, bIsUnpackedExpansion);
+	}
 	if(UStaticMesh* PreviewMesh = M_RTSAsyncSpawner->SyncGetBuildingExpansionPreviewMesh(BuildingExpansionType))
 	{
-		CPPConstructionPreviewRef->StartBuildingPreview(PreviewMesh);
+		// The expansion needs to be placed within the build radius around its owner.
+		const AActor* OwnerActor = Cast<AActor>(BuildingExpansionOwner);
+		CPPConstructionPreviewRef->StartBuildingPreview(
+			PreviewMesh, OwnerActor ? OwnerActor->GetActorLocation() : FVector::ZeroVector,
+			BuildingExpansionOwner->GetBxpBuildRadius(), EPlacementCategory::PC_Expansion);
 		m_IsBuildingPreviewModeActive = EBuildingPreviewMode::ExpansionPreviewMode;
 	}
 	else
@@ -110,7 +394,17 @@ void ACPPController::OnBxpSpawnedAsync(
 	const bool bIsUnpackedExpansion)
 {
 	M_BuildingExpansionForPreview = SpawnedBxp;
+	M_BuildingExpansionTypeForPreview = BuildingExpansionType;
+	M_AsyncBxpRequestState.SpawnedBuildingExpansion = SpawnedBxp;
+	M_AsyncBxpRequestState.Status = EAsyncBxpStatus::Async_BxpIsSpawned;
+	// The base gains an expansion, so its distance proxy is outdated.
+	NotifyBaseChanged(GetWorld(), BxpOwner);
 	BxpOwner->OnBuildingExpansionCreated(SpawnedBxp, ExpansionSlotIndex, BuildingExpansionType, bIsUnpackedExpansion);
+	if (UBxpReplicationComponent* BxpReplication = GetAuthorityBxpReplication(BxpOwner))
+	{
+		BxpReplication->SetSlotState(ExpansionSlotIndex, BuildingExpansionType,
+		                             SpawnedBxp->GetBuildingExpansionStatus());
+	}
 }
 
 PlaceExpansionBuilding(
@@ -118,9 +412,135 @@ PlaceExpansionBuilding(
 	ABuildingExpansion* BuildingExpansion) const
 {
 	const FRotator BuildingRotation = CPPConstructionPreviewRef->GetPreviewRotation();
+	FBuildingReplayRecorder::Get().RecordPlacement(GetWorld(), BuildingLocation, BuildingRotation.Yaw);
 	// Notifies owner of all state changes and owner updates MainGameUI if needed.
 	// Note that this function is also used to unpack a building expansion.
 	BuildingExpansion->StartExpansionConstructionAtLocation(BuildingLocation, BuildingRotation);
+	// Moved while it had no collision, so overlaps and navigation only update once at the placement.
+	ARTSAsyncSpawner::WakeInertBxp(BuildingExpansion);
+	NotifyBaseChanged(GetWorld(), BuildingExpansion->GetBuildingExpansionOwner());
+	GetWorld()->GetSubsystem<UBuildingGCClusterSubsystem>()->RegisterBuilding(BuildingExpansion);
+	if (M_AsyncBxpRequestState.bIsPackedExpansion)
+	{
+		GetWorld()->GetSubsystem<UPackedBxpSubsystem>()->OnUnpackedExpansionPlaced(
+			BuildingExpansion->GetBuildingExpansionOwner(), BuildingExpansion,
+			M_AsyncBxpRequestState.ExpansionSlotIndex);
+	}
+	if (UBxpReplicationComponent* BxpReplication =
+		GetAuthorityBxpReplication(BuildingExpansion->GetBuildingExpansionOwner()))
+	{
+		const int32 SlotIndex = M_AsyncBxpRequestState.ExpansionSlotIndex;
+		if (const FReplicatedBxpSlot* Slot = BxpReplication->GetSlot(SlotIndex))
+		{
+			BxpReplication->SetSlotState(SlotIndex, Slot->ExpansionType,
+			                             BuildingExpansion->GetBuildingExpansionStatus());
+			BxpReplication->SetSlotTransform(SlotIndex, BuildingLocation, BuildingRotation);
+			BxpReplication->TrackConstruction(SlotIndex, BuildingExpansion);
+		}
+	}
+}
+
+AActor* ACPPController::ResolveReplayActor(const FBuildingReplayEvent& Event)
+{
+	if (const TWeakObjectPtr<AActor>* ResolvedActor = M_ReplayActors.Find(Event.ActorId);
+		ResolvedActor && ResolvedActor->IsValid())
+	{
+		return ResolvedActor->Get();
+	}
+	const UClass* ActorClass = FindObject<UClass>(nullptr, *Event.ActorClass.ToString());
+	if (!ActorClass)
+	{
+		return nullptr;
+	}
+	// Only the first input of an actor searches; the actors of its class are kept in a hash by the engine.
+	AActor* ClosestActor = nullptr;
+	float ClosestDistanceSquared = FMath::Square(ReplayActorResolveTolerance);
+	for (TActorIterator<AActor> It(GetWorld(), const_cast<UClass*>(ActorClass)); It; ++It)
+	{
+		const float DistanceSquared = FVector::DistSquared(It->GetActorLocation(), Event.ActorLocation);
+		if (DistanceSquared <= ClosestDistanceSquared)
+		{
+			ClosestDistanceSquared = DistanceSquared;
+			ClosestActor = *It;
+		}
+	}
+	if (ClosestActor)
+	{
+		M_ReplayActors.Add(Event.ActorId, ClosestActor);
+	}
+	return ClosestActor;
+}
+
+void ACPPController::ReplayBuildingInput(const FBuildingReplayEvent& Event)
+{
+	AActor* Actor = Event.ActorId != 0 ? ResolveReplayActor(Event) : nullptr;
+	if (!Actor && Event.ActorId != 0)
+	{
+		RTSFunctionLibrary::ReportError("Could not resolve the actor of a replayed building input!"
+			"\n At function ReplayBuildingInput in CPPController.cpp"
+			"\n Actor class: " + Event.ActorClass.ToString() + "\n Input: "
+			+ BuildingReplayEventToString(Event.Type));
+		return;
+	}
+	switch (Event.Type)
+	{
+	case EBuildingReplayEvent::BRE_ConstructBuilding:
+		ConstructBuilding(Actor);
+		break;
+	case EBuildingReplayEvent::BRE_CancelBuilding:
+		CancelBuilding(Actor);
+		break;
+	case EBuildingReplayEvent::BRE_ConvertBackToVehicle:
+		ConvertBackToVehicle(Actor);
+		break;
+	case EBuildingReplayEvent::BRE_CancelVehicleConversion:
+		CancelVehicleConversion(Actor);
+		break;
+	case EBuildingReplayEvent::BRE_ExpandBuilding:
+		if (IBuildingExpansionOwner* BxpOwner = Cast<IBuildingExpansionOwner>(Actor))
+		{
+			ExpandBuildingWithType(static_cast<EBuildingExpansionType>(Event.ExpansionType), BxpOwner,
+			                       Event.ExpansionSlotIndex, Event.bFlag);
+		}
+		break;
+	case EBuildingReplayEvent::BRE_PlaceBuilding:
+		// Validate the preview at the recorded location as the cursor would have.
+		CPPConstructionPreviewRef->SetPreviewYaw(Event.Yaw);
+		CPPConstructionPreviewRef->UpdatePreviewAtLocation(Event.Location, true);
+		TryPlaceBuilding(Event.Location);
+		break;
+	case EBuildingReplayEvent::BRE_FormationTruck:
+		if (ANomadicVehicle* NomadicVehicle = Cast<ANomadicVehicle>(Actor))
+		{
+			M_ReplayFormationTrucks.Add(NomadicVehicle);
+		}
+		break;
+	case EBuildingReplayEvent::BRE_PlaceFormation:
+		{
+			// Deploys the recorded trucks, independent of the selection at this point of the replay.
+			const UNomadicConversionScheduler* ConversionScheduler =
+				GetWorld()->GetSubsystem<UNomadicConversionScheduler>();
+			TArray<ANomadicVehicle*> NomadicVehicles;
+			for (const TWeakObjectPtr<ANomadicVehicle>& FormationTruck : M_ReplayFormationTrucks)
+			{
+				ANomadicVehicle* NomadicVehicle = FormationTruck.Get();
+				if (NomadicVehicle && IsNomadicVehicleDeployable(NomadicVehicle, ConversionScheduler))
+				{
+					NomadicVehicles.Add(NomadicVehicle);
+				}
+			}
+			M_ReplayFormationTrucks.Reset();
+			CPPConstructionPreviewRef->SetPreviewYaw(Event.Yaw);
+			StartFormationPlacement(NomadicVehicles, Event.Location);
+		}
+		break;
+	case EBuildingReplayEvent::BRE_StopBxpPlacement:
+		CancelBuildingExpansionPlacement(Cast<IBuildingExpansionOwner>(Actor), Event.bFlag);
+		break;
+	case EBuildingReplayEvent::BRE_BxpSpawned:
+		// Completions are not inputs; the spawner produces them again during the replay.
+		break;
+	}
 }
 
 void ACPPController::StopBuildingPreviewMode()
@@ -157,11 +577,26 @@ void ACPPController::StopBuildingPreviewMode()
 void ACPPController::CancelBuildingExpansionPlacement(IBuildingExpansionOwner* BxpOwner,
                                                       const bool bIsCancelledPackedExpansion)
 {
+	// Both StopBxpPreviewPlacement and leaving the preview mode end here.
+	FBuildingReplayRecorder::Get().RecordActorInput(EBuildingReplayEvent::BRE_StopBxpPlacement,
+	                                                Cast<AActor>(BxpOwner), bIsCancelledPackedExpansion);
 	if (IsValid(M_BuildingExpansionForPreview) && BxpOwner)
 	{
-		// Was this bxp packed? If so we save the type and set the status to IsPackedUp on the data component of the owner.
-		// This makes sure we can unpack it later at a different location.
-		BxpOwner->DestroyBuildingExpansion(M_BuildingExpansionForPreview, bIsCancelledPackedExpansion);
+		NotifyBaseChanged(GetWorld(), BxpOwner);
+		ReplicateBxpSlotRemoved(BxpOwner, M_AsyncBxpRequestState.ExpansionSlotIndex, bIsCancelledPackedExpansion);
+		if (bIsCancelledPackedExpansion)
+		{
+			// Goes back to being a record; the owner saves the type and sets the status to IsPackedUp on its data
+			// component so we can unpack it later at a different location.
+			GetWorld()->GetSubsystem<UPackedBxpSubsystem>()->PackExpansion(
+				BxpOwner, M_BuildingExpansionForPreview, M_BuildingExpansionTypeForPreview,
+				M_AsyncBxpRequestState.ExpansionSlotIndex, M_RTSAsyncSpawner,
+				M_BuildingExpansionForPreview->GetHealthFraction(), M_BuildingExpansionForPreview->GetUpgradeMask());
+		}
+		else
+		{
+			BxpOwner->DestroyBuildingExpansion(M_BuildingExpansionForPreview, false);
+		}
 	}
 	FinishedBuildingMode();
 }
@@ -172,7 +607,27 @@ void ACPPController::CancelBuildingExpansionConstruction(IBuildingExpansionOwner
 {
 	if (IsValid(BuildingExpansion) && BxpOwner)
 	{
-		BxpOwner->DestroyBuildingExpansion(BuildingExpansion, bIsCancelledPackedBxp);
+		NotifyBaseChanged(GetWorld(), BxpOwner);
+		const UBxpReplicationComponent* BxpReplication = GetAuthorityBxpReplication(BxpOwner);
+		const int32 SlotIndex = BxpReplication
+			                        ? BxpReplication->FindPlacedSlotIndex(BuildingExpansion->GetActorLocation())
+			                        : INDEX_NONE;
+		const FReplicatedBxpSlot* Slot = BxpReplication ? BxpReplication->GetSlot(SlotIndex) : nullptr;
+		if (bIsCancelledPackedBxp && Slot)
+		{
+			// Packing a placed expansion keeps it as a record with the health and upgrades it has now.
+			GetWorld()->GetSubsystem<UPackedBxpSubsystem>()->PackExpansion(
+				BxpOwner, BuildingExpansion, Slot->ExpansionType, SlotIndex, M_RTSAsyncSpawner,
+				BuildingExpansion->GetHealthFraction(), BuildingExpansion->GetUpgradeMask());
+		}
+		else
+		{
+			BxpOwner->DestroyBuildingExpansion(BuildingExpansion, bIsCancelledPackedBxp);
+		}
+		if (SlotIndex != INDEX_NONE)
+		{
+			ReplicateBxpSlotRemoved(BxpOwner, SlotIndex, bIsCancelledPackedBxp);
+		}
 	}
 }
 
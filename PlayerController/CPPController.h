@@ -17,6 +17,11 @@
 #include "RTS_Survival/Units/Enums/Enum_UnitType.h"
 #include "RTS_Survival/Player/Abilities.h"
 #include "RTS_Survival/Player/PlacementEffects.h"
+#include "RTS_Survival/Player/FormationPlacement/NomadicFormationPlacement.h"
+#include "RTS_Survival/Player/ServerPlacement/ServerPlacementValidationSubsystem.h"
+#include "RTS_Survival/Benchmark/RTSBuildingReplay.h"
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/Player/CursorTrace/CursorTraceCache.h"
 
 #include "CPPController.generated.h"
 
@@ -30,6 +35,7 @@ class IBuildingExpansionOwner;
 enum class EBuildingExpansionType : uint8;
 class UMainGameUI;
 class ANomadicVehicle;
+class UNomadicConversionScheduler;
 class RTS_SURVIVAL_API ACPP_UnitMaster;
 class RTS_SURVIVAL_API ASquadController;
 class RTS_SURVIVAL_API ACPPBuildingMaster;
@@ -41,6 +47,8 @@ class RTS_SURVIVAL_API ASelectableActorObjectsMaster;
 
 // ...
 
+DECLARE_DELEGATE_OneParam(FOnPlacementValidated, const bool /*bIsAccepted*/);
+
 UCLASS()
 class RTS_SURVIVAL_API ACPPController : public APlayerController
 {
@@ -146,6 +154,29 @@ public:
 											 ABuildingExpansion *BuildingExpansion,
 											 const bool bIsCancelledPackedBxp) const;
 
+	/**
+	 * @brief Sends the results of the placement requests of this client that the server validated in one batch.
+	 * @param Replies Accept or reject per request id.
+	 */
+	UFUNCTION(Client, Reliable)
+	void ClientReceivePlacementReplies(const TArray<FPlacementReplyMessage> &Replies);
+
+	/**
+	 * @brief Executes a building input recorded by FBuildingReplayRecorder as if the player made it.
+	 * @param Event The recorded input; actors are resolved by their recorded class and location.
+	 * @note Used by the replay mode of ARTSBenchmarkRunner.
+	 */
+	void ReplayBuildingInput(const FBuildingReplayEvent &Event);
+
+	/**
+	 * @brief The world under the mouse cursor this frame, traced at most once per frame.
+	 * @return The cached cursor trace with the hit location, normal, actor and grid cell.
+	 * @note Use this instead of tracing the cursor yourself, the preview, HUD and selection all share the result.
+	 */
+	inline const FCursorTraceResult &GetCursorTrace() { return M_CursorTraceCache.GetCursorTrace(); }
+
+	inline ARTSAsyncSpawner *GetRTSAsyncSpawner() const { return M_RTSAsyncSpawner; }
+
 private:
 	//...
 
@@ -168,15 +199,74 @@ private:
 	 * Tries to place the building at the clicked location.
 	 * @param ClickedLocation The location to place the building at.
 	 * @return True if the building was placed, false otherwise.
+	 * @note In multiplayer the placement is executed once the server accepts it, see RequestPlacementValidation.
 	 */
 	bool TryPlaceBuilding(const FVector &ClickedLocation);
 
+	/**
+	 * @brief Has the placement revalidated by the server before it is executed.
+	 * On a network client the request is sent to the server, which validates the requests of all clients in one
+	 * batch per net tick; with authority the local preview validation is final and OnValidated is called directly.
+	 * @param Location The grid snapped location of the building.
+	 * @param Rotation The rotation of the building, only the yaw is used.
+	 * @param Host The truck that converts, or the owner that places the expansion.
+	 * @param ExpansionType The type of the placed expansion, only used for PC_Expansion.
+	 * @param Category The placement rules to validate with.
+	 * @param OnValidated Called with whether the server accepted the placement; rejected if the server does not
+	 * reply within PlacementReplyTimeoutSeconds.
+	 */
+	void RequestPlacementValidation(
+		const FVector &Location,
+		const FRotator &Rotation,
+		AActor *Host,
+		const EBuildingExpansionType ExpansionType,
+		const EPlacementCategory Category,
+		FOnPlacementValidated OnValidated);
+
+	UFUNCTION(Server, Reliable)
+	void ServerRequestPlacement(const FPlacementRequestMessage &Request);
+
+	// How far a replayed actor may be from its recorded location to be resolved.
+	static constexpr float ReplayActorResolveTolerance = 500.f;
+
+	// Actors of the replayed inputs by their recorded id, resolved on their first input.
+	TMap<uint32, TWeakObjectPtr<AActor>> M_ReplayActors;
+
+	/** @return The actor of the replayed input, null if no actor of its class is near its recorded location. */
+	AActor *ResolveReplayActor(const FBuildingReplayEvent &Event);
+
+	// The trucks of the next replayed BRE_PlaceFormation, see BRE_FormationTruck.
+	TArray<TWeakObjectPtr<ANomadicVehicle>> M_ReplayFormationTrucks;
+
+	// How long a placement request waits for the reply of the server before it is rejected.
+	static constexpr float PlacementReplyTimeoutSeconds = 5.f;
+
+	struct FPendingPlacementValidation
+	{
+		FOnPlacementValidated OnValidated;
+
+		// Real time at which the request is rejected if the server did not reply.
+		double TimeoutTime = 0.0;
+	};
+
+	// Placement requests that wait for the reply of the server, mapped by request id.
+	TMap<uint16, FPendingPlacementValidation> M_PendingPlacementValidations;
+
+	uint16 M_NextPlacementRequestId = 0;
+
+	// Runs while placement requests are pending, see ExpirePlacementValidations.
+	FTimerHandle M_PlacementTimeoutHandle;
+
+	/** @brief Rejects the pending placement requests of which the reply timed out. */
+	void ExpirePlacementValidations();
+
 	/**
 	 * Attempts to place the bpx if it was loaded asynchroneously.
 	 * @param ClickedLocation Where the player clicked to place the building.
 	 * @return True if succesfully placed the building, false otherwise.
 	 * @post If true, the M_AsyncBxpRequestState is reset.
 	 * @post If false, the async state is not changed.
+	 * @note In multiplayer the placement is executed once the server accepts it, see RequestPlacementValidation.
 	 */
 	bool TryPlaceBxp(const FVector &ClickedLocation);
 
@@ -191,6 +281,48 @@ private:
 	 */
 	bool NomadicConvertToBuilding(const FVector &BuildingLocation);
 
+	/**
+	 * @brief Deploys all selected nomadic trucks around the clicked location with one batched computation.
+	 * Finds a non-overlapping, slope-valid building site for each truck in a background job and assigns the trucks
+	 * to the sites with the minimal total travel distance, see NomadicFormationPlacement.
+	 * @param ClickedLocation The centre of the formation.
+	 * @return Whether more than one nomadic truck was selected and the formation placement was started.
+	 * If false, the caller should fall back to NomadicConvertToBuilding.
+	 * @pre The building preview is active in nomadic preview mode; its mesh and rotation are used for all sites.
+	 * @post If true, the preview is stopped and the trucks receive their sites in OnFormationPlacementSolved.
+	 */
+	bool NomadicFormationConvertToBuilding(const FVector &ClickedLocation);
+
+	/**
+	 * @brief Starts the formation placement of the provided trucks, see NomadicFormationConvertToBuilding.
+	 * @param NomadicVehicles The trucks to deploy; all need to be deployable.
+	 * @param ClickedLocation The centre of the formation.
+	 * @return Whether more than one truck was provided and the formation placement was started.
+	 */
+	bool StartFormationPlacement(const TArray<ANomadicVehicle *> &NomadicVehicles, const FVector &ClickedLocation);
+
+	/**
+	 * @brief Sends each assigned truck that can still deploy to its building site.
+	 * @param Assignments The truck and site pairs computed by the formation placement.
+	 * @param BuildingRotation The rotation of the preview when this formation placement was started.
+	 */
+	void OnFormationPlacementSolved(const TArray<FNomadicSiteAssignment> &Assignments,
+	                                const FRotator BuildingRotation);
+
+	/** @param OutNomadicVehicles The selected units that are nomadic trucks and can deploy. */
+	void GetSelectedNomadicVehicles(TArray<ANomadicVehicle *> &OutNomadicVehicles) const;
+
+	/** @return Whether the truck is in vehicle form and has no queued building conversion. */
+	static bool IsNomadicVehicleDeployable(const ANomadicVehicle *NomadicVehicle,
+	                                       const UNomadicConversionScheduler *ConversionScheduler);
+
+	/**
+	 * @brief Removes the staged building conversion of the truck from the conversion scheduler if it is queued.
+	 * @param NomadicVehicle The truck that stops converting to a building.
+	 * @note Steps that were already executed are not reverted, see UNomadicConversionScheduler::CancelConversion.
+	 */
+	void CancelQueuedBuildingConversion(const ANomadicVehicle *NomadicVehicle) const;
+
 	//-------------------------------------- BUILDING EXPANSION RELATED --------------------------------------//
 
 	/**
@@ -228,5 +360,10 @@ private:
 	// Keeps track of the asynchronous building expansion request.
 	FAsyncBxpRequestState M_AsyncBxpRequestState;
 
+	// The type of the spawned bxp that is being placed, recorded when a cancelled unpack is packed again.
+	EBuildingExpansionType M_BuildingExpansionTypeForPreview = static_cast<EBuildingExpansionType>(0);
+
+	FCursorTraceCache M_CursorTraceCache{this, DeveloperSettings::UIUX::SightDistanceMouse};
+
 	//...
 };
@@ -0,0 +1,65 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "CursorTraceCache.h"
+
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "RTS_Survival/Player/ConstructionPreview/PlacementRules/PlacementRules.h"
+
+FVector FCursorTraceResult::GetGridSnappedLocation() const
+{
+	return PlacementRules::SnapToGrid(Location);
+}
+
+FCursorTraceCache::FCursorTraceCache(APlayerController* Owner, const float SightDistance)
+	: M_Owner(Owner),
+	  M_SightDistance(SightDistance)
+{
+}
+
+const FCursorTraceResult& FCursorTraceCache::GetCursorTrace()
+{
+	if (M_Result.FrameNumber != GFrameCounter)
+	{
+		TraceNow();
+	}
+	return M_Result;
+}
+
+void FCursorTraceCache::TraceNow()
+{
+	APlayerController* Owner = M_Owner.Get();
+	FVector Start, End;
+	FHitResult Hit;
+	const bool bHit = Owner && GetTraceSegment(Start, End)
+		&& Owner->GetWorld()->LineTraceSingleByChannel(Hit, Start, End, ECC_Visibility);
+	StoreHit(bHit ? &Hit : nullptr);
+}
+
+bool FCursorTraceCache::GetTraceSegment(FVector& OutStart, FVector& OutEnd) const
+{
+	FVector Direction;
+	if (!M_Owner->DeprojectMousePositionToWorld(OutStart, Direction))
+	{
+		return false;
+	}
+	OutEnd = OutStart + Direction * M_SightDistance;
+	return true;
+}
+
+void FCursorTraceCache::StoreHit(const FHitResult* Hit)
+{
+	M_Result.FrameNumber = GFrameCounter;
+	M_Result.bIsValid = Hit && Hit->bBlockingHit;
+	if (!M_Result.bIsValid)
+	{
+		// Keep the last location so consumers that ignore validity do not jump to the origin.
+		M_Result.Actor.Reset();
+		return;
+	}
+	M_Result.Location = Hit->Location;
+	M_Result.Normal = Hit->ImpactNormal;
+	M_Result.Actor = Hit->GetActor();
+	M_Result.GridCell = PlacementRules::GetGridCell(Hit->Location);
+}
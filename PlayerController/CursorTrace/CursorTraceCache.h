@@ -0,0 +1,64 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+
+class APlayerController;
+
+/** The result of the cursor trace of one frame. */
+struct FCursorTraceResult
+{
+	// Whether the cursor is above something within the sight distance.
+	bool bIsValid = false;
+
+	FVector Location = FVector::ZeroVector;
+
+	// Surface normal at the hit location.
+	FVector Normal = FVector::UpVector;
+
+	TWeakObjectPtr<AActor> Actor;
+
+	// The construction grid cell of the hit location, see GridSnapSize.
+	FIntPoint GridCell = FIntPoint::ZeroValue;
+
+	// The frame (GFrameCounter) in which the result was produced.
+	uint64 FrameNumber = MAX_uint64;
+
+	/** @return The grid snapped location of the cell with the height of the hit. */
+	FVector GetGridSnappedLocation() const;
+};
+
+/**
+ * @brief Traces the world under the mouse cursor at most once per frame and serves every consumer from the result.
+ * The first query of a frame traces synchronously, so the result always matches the cursor and camera of the frame.
+ * @note Owned by ACPPController, query it with ACPPController::GetCursorTrace.
+ */
+class RTS_SURVIVAL_API FCursorTraceCache
+{
+public:
+	/**
+	 * @param Owner The controller of which the mouse position is traced.
+	 * @param SightDistance How far the cursor can trace into the world.
+	 */
+	FCursorTraceCache(APlayerController* Owner, const float SightDistance);
+
+	/** @return The cursor trace of this frame. */
+	const FCursorTraceResult& GetCursorTrace();
+
+private:
+	/** @brief Traces synchronously and stores the result for this frame. */
+	void TraceNow();
+
+	/** @return Whether the mouse position could be deprojected, the trace segment otherwise. */
+	bool GetTraceSegment(FVector& OutStart, FVector& OutEnd) const;
+
+	void StoreHit(const FHitResult* Hit);
+
+	TWeakObjectPtr<APlayerController> M_Owner;
+
+	float M_SightDistance = 0.f;
+
+	FCursorTraceResult M_Result;
+};
@@ -0,0 +1,280 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "NomadicFormationPlacement.h"
+
+#include "Async/Async.h"
+#include "Engine/World.h"
+#include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/Player/ConstructionPreview/PlacementRules/PlacementValidationSubsystem.h"
+#include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/NomadicVehicle.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+namespace NomadicFormationPlacement
+{
+	// How many hexagonal rings around the click are searched for valid sites.
+	constexpr int32 MaxSearchRings = 6;
+
+	/** Everything the worker thread needs, copied on the game thread. */
+	struct FFormationPlacementJob
+	{
+		// The worker only performs scene queries through the guard, never while the world is cleaned up.
+		TSharedPtr<const FPlacementWorldGuard, ESPMode::ThreadSafe> WorldGuard;
+		TArray<TWeakObjectPtr<ANomadicVehicle>> NomadicVehicles;
+		TArray<FVector> VehicleLocations;
+		PlacementRules::FPlacementFootprint Footprint;
+		// Validates a site without a preview component.
+		PlacementPolicies::FPlacementValidatorFn Validator = nullptr;
+		FVector ClickedLocation = FVector::ZeroVector;
+		FQuat BuildingRotation = FQuat::Identity;
+		// Distance between the pivots of two neighbouring sites.
+		float SiteSpacing = 0.f;
+	};
+
+	/** @brief Adds the pivots of the hexagonal ring with the provided index around the centre. */
+	void AddHexRing(const FVector& Centre, const float Spacing, const int32 RingIndex, TArray<FVector>& OutPoints)
+	{
+		if (RingIndex == 0)
+		{
+			OutPoints.Add(Centre);
+			return;
+		}
+		// Axial hex directions.
+		static constexpr int32 Directions[6][2] = {{1, 0}, {1, -1}, {0, -1}, {-1, 0}, {-1, 1}, {0, 1}};
+		int32 Q = -RingIndex;
+		int32 R = RingIndex;
+		for (int32 Side = 0; Side < 6; ++Side)
+		{
+			for (int32 Step = 0; Step < RingIndex; ++Step)
+			{
+				const float X = Spacing * (Q + R * 0.5f);
+				const float Y = Spacing * (R * UE_HALF_SQRT_3);
+				OutPoints.Add(Centre + FVector(X, Y, 0.f));
+				Q += Directions[Side][0];
+				R += Directions[Side][1];
+			}
+		}
+	}
+
+	/**
+	 * @brief Projects the candidate on the landscape and validates slope and overlap.
+	 * @param OutSite The projected site.
+	 * @return Whether the site is valid.
+	 */
+	bool ValidateCandidate(const FFormationPlacementJob& Job, const UWorld& World, const FVector& Candidate,
+	                       FVector& OutSite)
+	{
+		if (!PlacementRules::ProjectSiteToGround(&World, Candidate, OutSite))
+		{
+			return false;
+		}
+
+		FPlacementContext Context;
+		Context.World = &World;
+		Context.Footprint = &Job.Footprint;
+		Context.Transform = FTransform(Job.BuildingRotation, OutSite);
+		return Job.Validator(Context);
+	}
+
+	/** @brief Runs on a worker thread; finds the sites and assigns the trucks. */
+	TArray<FNomadicSiteAssignment> Solve(const FFormationPlacementJob& Job)
+	{
+		TArray<FNomadicSiteAssignment> Assignments;
+		const int32 NumVehicles = Job.NomadicVehicles.Num();
+		if (NumVehicles == 0)
+		{
+			return Assignments;
+		}
+
+		// Sites are found ring by ring so the formation stays as close to the click as possible.
+		// The spacing guarantees the sites do not overlap with each other.
+		TArray<FVector> Sites;
+		TArray<FVector> RingCandidates;
+		for (int32 RingIndex = 0; RingIndex <= MaxSearchRings && Sites.Num() < NumVehicles; ++RingIndex)
+		{
+			RingCandidates.Reset();
+			AddHexRing(Job.ClickedLocation, Job.SiteSpacing, RingIndex, RingCandidates);
+			// One candidate per guarded call so a world cleanup waits for at most one validation.
+			for (const FVector& Candidate : RingCandidates)
+			{
+				FVector Site;
+				bool bIsValidSite = false;
+				const bool bWorldIsAlive = Job.WorldGuard->WithWorld([&Job, &Candidate, &Site, &bIsValidSite](
+					const UWorld& World)
+					{
+						bIsValidSite = ValidateCandidate(Job, World, Candidate, Site);
+					});
+				if (!bWorldIsAlive)
+				{
+					// The world is cleaned up; nobody waits for the result anymore.
+					return Assignments;
+				}
+				if (bIsValidSite)
+				{
+					Sites.Add(Site);
+				}
+			}
+		}
+		if (Sites.IsEmpty())
+		{
+			return Assignments;
+		}
+
+		// The assignment needs at most as many rows as columns; transpose if there are more trucks than sites.
+		const bool bVehiclesAreRows = NumVehicles <= Sites.Num();
+		const int32 NumRows = bVehiclesAreRows ? NumVehicles : Sites.Num();
+		const int32 NumColumns = bVehiclesAreRows ? Sites.Num() : NumVehicles;
+		TArray<float> CostMatrix;
+		CostMatrix.SetNumUninitialized(NumRows * NumColumns);
+		for (int32 Row = 0; Row < NumRows; ++Row)
+		{
+			for (int32 Column = 0; Column < NumColumns; ++Column)
+			{
+				const int32 VehicleIndex = bVehiclesAreRows ? Row : Column;
+				const int32 SiteIndex = bVehiclesAreRows ? Column : Row;
+				CostMatrix[Row * NumColumns + Column] = FVector::Dist2D(Job.VehicleLocations[VehicleIndex],
+				                                                        Sites[SiteIndex]);
+			}
+		}
+
+		const TArray<int32> RowToColumn = SolveMinimalCostAssignment(CostMatrix, NumRows, NumColumns);
+		for (int32 Row = 0; Row < NumRows; ++Row)
+		{
+			const int32 VehicleIndex = bVehiclesAreRows ? Row : RowToColumn[Row];
+			const int32 SiteIndex = bVehiclesAreRows ? RowToColumn[Row] : Row;
+			Assignments.Add({Job.NomadicVehicles[VehicleIndex], Sites[SiteIndex]});
+		}
+		return Assignments;
+	}
+}
+
+void NomadicFormationPlacement::SolveAsync(
+	UWorld* World,
+	const TArray<ANomadicVehicle*>& NomadicVehicles,
+	UStaticMesh* BuildingMesh,
+	const FVector& ClickedLocation,
+	const FRotator& BuildingRotation,
+	FOnFormationPlacementSolved OnSolved)
+{
+	if (!World || !BuildingMesh)
+	{
+		RTSFunctionLibrary::ReportError(
+			"Attempt to solve formation placement without world or building mesh!"
+			"\n At function SolveAsync in NomadicFormationPlacement.cpp");
+		return;
+	}
+
+	// Copy all UObject data on the game thread, the worker only reads plain data and performs scene queries.
+	FFormationPlacementJob Job;
+	UPlacementValidationSubsystem* PlacementValidation = World->GetSubsystem<UPlacementValidationSubsystem>();
+	Job.WorldGuard = PlacementValidation->GetWorldGuard();
+	for (ANomadicVehicle* NomadicVehicle : NomadicVehicles)
+	{
+		if (IsValid(NomadicVehicle))
+		{
+			Job.NomadicVehicles.Add(NomadicVehicle);
+			Job.VehicleLocations.Add(NomadicVehicle->GetActorLocation());
+		}
+	}
+	Job.BuildingRotation = BuildingRotation.Quaternion();
+	Job.Footprint = PlacementValidation->GetFootprint(BuildingMesh);
+	Job.Validator = PlacementPolicies::GetValidator(EPlacementCategory::PC_NomadicHQ, Job.Footprint, false);
+	Job.ClickedLocation = ClickedLocation;
+	// Account for the grid snap that can move two neighbouring sites towards each other.
+	Job.SiteSpacing = 2 * Job.Footprint.Radius + DeveloperSettings::GamePlay::Construction::GridSnapSize;
+
+	Async(EAsyncExecution::TaskGraph, [Job = MoveTemp(Job), OnSolved = MoveTemp(OnSolved)]() mutable
+	{
+		TArray<FNomadicSiteAssignment> Assignments = Solve(Job);
+		// Write the results back on the game thread.
+		AsyncTask(ENamedThreads::GameThread,
+		          [Assignments = MoveTemp(Assignments), OnSolved = MoveTemp(OnSolved)]()
+		          {
+			          OnSolved.ExecuteIfBound(Assignments);
+		          });
+	});
+}
+
+TArray<int32> NomadicFormationPlacement::SolveMinimalCostAssignment(
+	const TConstArrayView<float> CostMatrix,
+	const int32 NumRows,
+	const int32 NumColumns)
+{
+	check(NumRows <= NumColumns && CostMatrix.Num() == NumRows * NumColumns);
+	// Hungarian algorithm with potentials, O(NumRows^2 * NumColumns); indices are 1-based, 0 is a dummy.
+	TArray<double> RowPotential, ColumnPotential, MinSlack;
+	TArray<int32> ColumnToRow, Way;
+	TArray<bool> bColumnUsed;
+	RowPotential.SetNumZeroed(NumRows + 1);
+	ColumnPotential.SetNumZeroed(NumColumns + 1);
+	ColumnToRow.SetNumZeroed(NumColumns + 1);
+	Way.SetNumZeroed(NumColumns + 1);
+
+	for (int32 Row = 1; Row <= NumRows; ++Row)
+	{
+		ColumnToRow[0] = Row;
+		int32 Column0 = 0;
+		MinSlack.Init(TNumericLimits<double>::Max(), NumColumns + 1);
+		bColumnUsed.Init(false, NumColumns + 1);
+		do
+		{
+			bColumnUsed[Column0] = true;
+			const int32 Row0 = ColumnToRow[Column0];
+			double Delta = TNumericLimits<double>::Max();
+			int32 Column1 = 0;
+			for (int32 Column = 1; Column <= NumColumns; ++Column)
+			{
+				if (bColumnUsed[Column])
+				{
+					continue;
+				}
+				const double Slack = CostMatrix[(Row0 - 1) * NumColumns + Column - 1] - RowPotential[Row0] -
+					ColumnPotential[Column];
+				if (Slack < MinSlack[Column])
+				{
+					MinSlack[Column] = Slack;
+					Way[Column] = Column0;
+				}
+				if (MinSlack[Column] < Delta)
+				{
+					Delta = MinSlack[Column];
+					Column1 = Column;
+				}
+			}
+			for (int32 Column = 0; Column <= NumColumns; ++Column)
+			{
+				if (bColumnUsed[Column])
+				{
+					RowPotential[ColumnToRow[Column]] += Delta;
+					ColumnPotential[Column] -= Delta;
+				}
+				else
+				{
+					MinSlack[Column] -= Delta;
+				}
+			}
+			Column0 = Column1;
+		}
+		while (ColumnToRow[Column0] != 0);
+
+		// Augment along the alternating path.
+		do
+		{
+			const int32 Column1 = Way[Column0];
+			ColumnToRow[Column0] = ColumnToRow[Column1];
+			Column0 = Column1;
+		}
+		while (Column0 != 0);
+	}
+
+	TArray<int32> RowToColumn;
+	RowToColumn.Init(INDEX_NONE, NumRows);
+	for (int32 Column = 1; Column <= NumColumns; ++Column)
+	{
+		if (ColumnToRow[Column] != 0)
+		{
+			RowToColumn[ColumnToRow[Column] - 1] = Column - 1;
+		}
+	}
+	return RowToColumn;
+}
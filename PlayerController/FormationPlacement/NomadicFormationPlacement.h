@@ -0,0 +1,60 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ANomadicVehicle;
+class UStaticMesh;
+
+/** A truck with the building site it was assigned to. */
+struct FNomadicSiteAssignment
+{
+	TWeakObjectPtr<ANomadicVehicle> NomadicVehicle;
+
+	FVector BuildingLocation = FVector::ZeroVector;
+};
+
+DECLARE_DELEGATE_OneParam(FOnFormationPlacementSolved, const TArray<FNomadicSiteAssignment>& /*Assignments*/);
+
+/**
+ * @brief Computes non-overlapping, slope-valid building sites around a clicked location for a group of trucks
+ * and assigns the trucks to the sites with the minimal total travel distance.
+ * The sites are sampled on hexagonal rings around the click and validated with PlacementRules, so the same
+ * slope and overlap rules apply as for the construction preview.
+ * @note The computation runs on a worker thread, the result is delivered on the game thread. The scene queries of
+ * the worker go through the FPlacementWorldGuard of the world; the job stops without result once the world is cleaned
+ * up.
+ */
+namespace NomadicFormationPlacement
+{
+	/**
+	 * @brief Starts the background job that solves the formation placement.
+	 * @param World The world to validate the sites in.
+	 * @param NomadicVehicles The trucks to find building sites for.
+	 * @param BuildingMesh The (preview) mesh of the building the trucks convert into.
+	 * @param ClickedLocation The centre of the formation.
+	 * @param BuildingRotation The rotation of all buildings in the formation.
+	 * @param OnSolved Called on the game thread with one assignment per truck that received a site.
+	 * Trucks for which no valid site was found within the search rings are not part of the assignments.
+	 */
+	void SolveAsync(
+		UWorld* World,
+		const TArray<ANomadicVehicle*>& NomadicVehicles,
+		UStaticMesh* BuildingMesh,
+		const FVector& ClickedLocation,
+		const FRotator& BuildingRotation,
+		FOnFormationPlacementSolved OnSolved);
+
+	/**
+	 * @brief Solves the assignment problem with the Hungarian algorithm.
+	 * @param CostMatrix Row major matrix with NumRows rows of NumColumns costs.
+	 * @param NumRows Number of rows, needs to be smaller or equal to NumColumns.
+	 * @param NumColumns Number of columns.
+	 * @return For each row the column it is assigned to; every column is used at most once.
+	 */
+	TArray<int32> SolveMinimalCostAssignment(
+		TConstArrayView<float> CostMatrix,
+		const int32 NumRows,
+		const int32 NumColumns);
+}
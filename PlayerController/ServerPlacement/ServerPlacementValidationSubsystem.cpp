@@ -0,0 +1,174 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "ServerPlacementValidationSubsystem.h"
+
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "RTS_Survival/Benchmark/RTSBenchmark.h"
+#include "RTS_Survival/Player/AsyncRTSAssetsSpawner/RTSAsyncSpawner.h"
+#include "RTS_Survival/Player/CPPController.h"
+#include "RTS_Survival/Player/ConstructionPreview/PlacementRules/PlacementValidationSubsystem.h"
+#include "RTS_Survival/Units/Tanks/WheeledTank/BaseTruck/NomadicVehicle.h"
+#include "RTS_Survival/Utils/HFunctionLibary.h"
+
+void UServerPlacementValidationSubsystem::QueueRequest(
+	ACPPController* RequestingController,
+	const FPlacementRequestMessage& Request)
+{
+	if (!IsValid(RequestingController))
+	{
+		return;
+	}
+	int32 NumQueued = 0;
+	for (const FQueuedRequest& Queued : M_QueuedRequests)
+	{
+		if (Queued.Controller == RequestingController)
+		{
+			++NumQueued;
+		}
+	}
+	FQueuedRequest Queued;
+	if (NumQueued >= MaxQueuedRequestsPerController || !ResolveQuery(RequestingController, Request, Queued.Query))
+	{
+		// Sent with the next batch.
+		M_ImmediateReplies.FindOrAdd(RequestingController).Add(
+			FPlacementReplyMessage::Make(Request.RequestId, false));
+		return;
+	}
+	Queued.Controller = RequestingController;
+	Queued.RequestId = Request.RequestId;
+	M_QueuedRequests.Add(MoveTemp(Queued));
+}
+
+bool UServerPlacementValidationSubsystem::ResolveQuery(
+	const ACPPController* RequestingController,
+	const FPlacementRequestMessage& Request,
+	FPlacementQuery& OutQuery)
+{
+	// Everything in the request comes from the client; reject malformed requests without reporting errors.
+	if (!IsValid(RequestingController) || !IsValid(Request.Host)
+		|| !StaticEnum<EPlacementCategory>()->IsValidEnumValue(static_cast<int64>(Request.Category)))
+	{
+		return false;
+	}
+	// A client may only place with its own trucks and buildings.
+	if (!Request.Host->IsOwnedBy(RequestingController))
+	{
+		return false;
+	}
+	OutQuery.Transform = FTransform(FRotator(0.f, FRotator::DecompressAxisFromByte(Request.CompressedYaw), 0.f),
+	                                Request.Location);
+	OutQuery.Category = Request.Category;
+	switch (Request.Category)
+	{
+	case EPlacementCategory::PC_NomadicHQ:
+		if (const ANomadicVehicle* NomadicVehicle = Cast<ANomadicVehicle>(Request.Host))
+		{
+			OutQuery.Mesh = NomadicVehicle->GetPreviewMesh();
+			OutQuery.HostLocation = NomadicVehicle->GetActorLocation();
+		}
+		break;
+	case EPlacementCategory::PC_Expansion:
+		if (IBuildingExpansionOwner* BxpOwner = Cast<IBuildingExpansionOwner>(Request.Host))
+		{
+			const bool bIsValidType = Request.ExpansionType != EBuildingExpansionType::BXT_Invalid
+				&& StaticEnum<EBuildingExpansionType>()->IsValidEnumValue(static_cast<int64>(Request.ExpansionType));
+			if (ARTSAsyncSpawner* AsyncSpawner = RequestingController->GetRTSAsyncSpawner();
+				AsyncSpawner && bIsValidType && AsyncSpawner->HasBuildingExpansionPreviewMesh(Request.ExpansionType))
+			{
+				OutQuery.Mesh = AsyncSpawner->SyncGetBuildingExpansionPreviewMesh(Request.ExpansionType);
+			}
+			OutQuery.HostLocation = Request.Host->GetActorLocation();
+			OutQuery.BuildRadius = BxpOwner->GetBxpBuildRadius();
+		}
+		break;
+	default:
+		break;
+	}
+	return OutQuery.Mesh != nullptr;
+}
+
+void UServerPlacementValidationSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	M_TimeSinceLastBatch += DeltaTime;
+	// On a listen server the frame rate can be far above the net tick rate; batch at the net tick rate.
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	const float BatchInterval = NetDriver ? 1.f / FMath::Max(NetDriver->GetNetServerMaxTickRate(), 1) : 0.f;
+	if (M_TimeSinceLastBatch < BatchInterval)
+	{
+		return;
+	}
+	M_TimeSinceLastBatch = 0.f;
+	ValidateQueuedRequests();
+}
+
+TStatId UServerPlacementValidationSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UServerPlacementValidationSubsystem, STATGROUP_Tickables);
+}
+
+void UServerPlacementValidationSubsystem::ValidateQueuedRequests()
+{
+	RTS_BENCHMARK_SCOPE("ServerPlacement.ValidateBatch");
+	UPlacementValidationSubsystem* PlacementValidation = GetWorld()->GetSubsystem<UPlacementValidationSubsystem>();
+
+	TArray<FPlacementQuery> Queries;
+	TArray<FQueuedRequest> Batch;
+	Queries.Reserve(M_QueuedRequests.Num());
+	Batch.Reserve(M_QueuedRequests.Num());
+	for (FQueuedRequest& Queued : M_QueuedRequests)
+	{
+		if (Queued.Controller.IsValid())
+		{
+			Queries.Add(Queued.Query);
+			Batch.Add(MoveTemp(Queued));
+		}
+	}
+	M_QueuedRequests.Reset();
+
+	TMap<TWeakObjectPtr<ACPPController>, TArray<FPlacementReplyMessage>> ImmediateReplies =
+		MoveTemp(M_ImmediateReplies);
+	M_ImmediateReplies.Reset();
+	SendReplies(ImmediateReplies);
+
+	if (Queries.IsEmpty())
+	{
+		return;
+	}
+	// The game thread does not wait for the scene queries; the replies are sent once the worker is done.
+	PlacementValidation->ValidatePlacementsAsync(
+		Queries,
+		FOnPlacementsValidated::CreateUObject(this, &UServerPlacementValidationSubsystem::OnBatchValidated,
+		                                      MoveTemp(Batch)));
+}
+
+void UServerPlacementValidationSubsystem::OnBatchValidated(
+	const TArray<FPlacementQueryResult>& Results,
+	TArray<FQueuedRequest> Batch)
+{
+	TMap<TWeakObjectPtr<ACPPController>, TArray<FPlacementReplyMessage>> Replies;
+	for (int32 Index = 0; Index < Batch.Num(); ++Index)
+	{
+		Replies.FindOrAdd(Batch[Index].Controller).Add(
+			FPlacementReplyMessage::Make(Batch[Index].RequestId, Results[Index].bIsValid));
+	}
+	SendReplies(Replies);
+	if constexpr (DeveloperSettings::Debugging::GBuilding_Mode_Compile_DebugSymbols)
+	{
+		RTSFunctionLibrary::PrintString("Server validated placements: " + FString::FromInt(Batch.Num()));
+	}
+}
+
+void UServerPlacementValidationSubsystem::SendReplies(
+	TMap<TWeakObjectPtr<ACPPController>, TArray<FPlacementReplyMessage>>& Replies)
+{
+	for (TPair<TWeakObjectPtr<ACPPController>, TArray<FPlacementReplyMessage>>& Pair : Replies)
+	{
+		if (ACPPController* Controller = Pair.Key.Get())
+		{
+			Controller->ClientReceivePlacementReplies(Pair.Value);
+		}
+	}
+}
@@ -0,0 +1,149 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/NetSerialization.h"
+#include "RTS_Survival/Buildings/BuildingExpansion/BuildingExpansion.h"
+#include "RTS_Survival/Player/ConstructionPreview/PlacementRules/PlacementValidationSubsystem.h"
+#include "Subsystems/WorldSubsystem.h"
+
+#include "ServerPlacementValidationSubsystem.generated.h"
+
+class ACPPController;
+
+/** A placement a client asks the server to validate; sent with ACPPController::ServerRequestPlacement. */
+USTRUCT()
+struct FPlacementRequestMessage
+{
+	GENERATED_BODY()
+
+	// Id chosen by the client to match the reply with the request.
+	UPROPERTY()
+	uint16 RequestId = 0;
+
+	// Rounded to whole units, the location is grid snapped anyway.
+	UPROPERTY()
+	FVector_NetQuantize Location = FVector::ZeroVector;
+
+	// Yaw compressed with FRotator::CompressAxisToByte.
+	UPROPERTY()
+	uint8 CompressedYaw = 0;
+
+	UPROPERTY()
+	EPlacementCategory Category = EPlacementCategory::PC_NomadicHQ;
+
+	// The type of the placed expansion, only used for PC_Expansion.
+	UPROPERTY()
+	EBuildingExpansionType ExpansionType = EBuildingExpansionType::BXT_Invalid;
+
+	// The truck that converts for PC_NomadicHQ, the owner that places the expansion for PC_Expansion.
+	// The server derives the mesh and build radius from it; the client never sends a mesh.
+	UPROPERTY()
+	TObjectPtr<AActor> Host = nullptr;
+};
+
+/** Accept or reject of one request, packed into 16 bits. */
+USTRUCT()
+struct FPlacementReplyMessage
+{
+	GENERATED_BODY()
+
+	static FPlacementReplyMessage Make(const uint16 RequestId, const bool bAccepted)
+	{
+		FPlacementReplyMessage Reply;
+		Reply.Packed = (RequestId & RequestIdMask) | (bAccepted ? AcceptedBit : 0);
+		return Reply;
+	}
+
+	inline uint16 GetRequestId() const { return Packed & RequestIdMask; }
+
+	inline bool GetIsAccepted() const { return (Packed & AcceptedBit) != 0; }
+
+	// Request ids wrap within the lower 15 bits.
+	static constexpr uint16 RequestIdMask = 0x7FFF;
+
+private:
+	static constexpr uint16 AcceptedBit = 0x8000;
+
+	// Lower 15 bits: request id, highest bit: accepted.
+	UPROPERTY()
+	uint16 Packed = 0;
+};
+
+/**
+ * @brief Revalidates the building placements of all clients on the server.
+ * Requests received from the clients are queued and validated in one batch per network tick on a worker thread with
+ * the cached footprints of the UPlacementValidationSubsystem. Each controller then receives one reply message with the
+ * results of all its requests of that batch.
+ * The mesh and build radius are resolved on the server from the host and the expansion type of the request, so a
+ * client cannot have its placement validated against a smaller mesh.
+ * @note Only validates on the server; listen server and standalone players validate with their own preview.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UServerPlacementValidationSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/**
+	 * @brief Queues the request for the next batch.
+	 * @param RequestingController The controller of the client that sent the request.
+	 * @param Request The placement to validate.
+	 * @note Requests over MaxQueuedRequestsPerController for the same batch, or of which the building cannot be
+	 * resolved, are rejected without validation.
+	 */
+	void QueueRequest(ACPPController* RequestingController, const FPlacementRequestMessage& Request);
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual bool IsTickable() const override
+	{
+		return !M_QueuedRequests.IsEmpty() || !M_ImmediateReplies.IsEmpty();
+	}
+
+private:
+	// Bounds the work a single client can cause per batch.
+	static constexpr int32 MaxQueuedRequestsPerController = 8;
+
+	struct FQueuedRequest
+	{
+		TWeakObjectPtr<ACPPController> Controller;
+		uint16 RequestId = 0;
+		// Resolved on the server when the request is queued.
+		FPlacementQuery Query;
+	};
+
+	TArray<FQueuedRequest> M_QueuedRequests;
+
+	// Replies for requests that were rejected before validation, sent with the next batch.
+	TMap<TWeakObjectPtr<ACPPController>, TArray<FPlacementReplyMessage>> M_ImmediateReplies;
+
+	// Time since the last batch; batches are run at the net tick rate of the server.
+	float M_TimeSinceLastBatch = 0.f;
+
+	/**
+	 * @brief Derives the mesh, host location and build radius of the request from its host on the server.
+	 * @param RequestingController The controller of the client that sent the request.
+	 * @param Request The received request.
+	 * @param OutQuery The query to validate.
+	 * @return Whether the building of the request could be resolved; false for malformed requests and hosts that are
+	 * not owned by the requesting controller.
+	 */
+	static bool ResolveQuery(
+		const ACPPController* RequestingController,
+		const FPlacementRequestMessage& Request,
+		FPlacementQuery& OutQuery);
+
+	/** @brief Sends the replies of rejected requests and starts the validation of all queued requests. */
+	void ValidateQueuedRequests();
+
+	/**
+	 * @brief Sends the replies of a validated batch.
+	 * @param Results One result per request of the batch.
+	 * @param Batch The requests that were validated.
+	 */
+	void OnBatchValidated(const TArray<FPlacementQueryResult>& Results, TArray<FQueuedRequest> Batch);
+
+	static void SendReplies(TMap<TWeakObjectPtr<ACPPController>, TArray<FPlacementReplyMessage>>& Replies);
+};
@@ -0,0 +1,139 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+
+#include "ProgressBarLODSubsystem.h"
+
+#include "Camera/PlayerCameraManager.h"
+#include "Components/MeshComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "TimeProgressBarWidget.h"
+#include "RTS_Survival/Benchmark/RTSBenchmark.h"
+#include "RTS_Survival/DeveloperSettings.h"
+
+void UProgressBarLODSubsystem::RegisterProgressBar(UTimeProgressBarWidget* ProgressBar)
+{
+	UnregisterProgressBar(ProgressBar);
+	FManagedProgressBar& ManagedBar = M_ProgressBars.AddDefaulted_GetRef();
+	ManagedBar.ProgressBar = ProgressBar;
+	ManagedBar.UpdateInterval = DeveloperSettings::Optimisation::UpdateIntervalProgressBar;
+	// Classify the new bar on the next tick.
+	M_TimeSinceVisibilityCheck = VisibilityCheckInterval;
+}
+
+void UProgressBarLODSubsystem::UnregisterProgressBar(UTimeProgressBarWidget* ProgressBar)
+{
+	M_ProgressBars.RemoveAllSwap([ProgressBar](const FManagedProgressBar& ManagedBar)
+	{
+		if (ManagedBar.ProgressBar != ProgressBar)
+		{
+			return false;
+		}
+		// Show the mesh again, a restarted bar is registered as not culled.
+		if (ManagedBar.bIsCulled && ProgressBar && ProgressBar->M_BarAsMeshRef)
+		{
+			ProgressBar->M_BarAsMeshRef->SetVisibility(true);
+		}
+		return true;
+	});
+}
+
+void UProgressBarLODSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	RTS_BENCHMARK_SCOPE("ProgressBarLOD.Tick");
+	M_TimeSinceVisibilityCheck += DeltaTime;
+	if (M_TimeSinceVisibilityCheck >= VisibilityCheckInterval)
+	{
+		M_TimeSinceVisibilityCheck = 0.f;
+		ClassifyProgressBars();
+	}
+
+	const double Now = GetWorld()->GetTimeSeconds();
+	for (int32 i = M_ProgressBars.Num() - 1; i >= 0; --i)
+	{
+		FManagedProgressBar& ManagedBar = M_ProgressBars[i];
+		UTimeProgressBarWidget* ProgressBar = ManagedBar.ProgressBar.Get();
+		if (!ProgressBar)
+		{
+			M_ProgressBars.RemoveAtSwap(i);
+			continue;
+		}
+		// Completion is driven by the bar's own timer, culled bars need no work at all.
+		if (ManagedBar.bIsCulled || Now < ManagedBar.NextUpdateTime)
+		{
+			continue;
+		}
+		ManagedBar.NextUpdateTime = Now + ManagedBar.UpdateInterval;
+		ProgressBar->OrientProgressBar();
+		ProgressBar->UpdateProgressBar();
+	}
+}
+
+TStatId UProgressBarLODSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UProgressBarLODSubsystem, STATGROUP_Tickables);
+}
+
+void UProgressBarLODSubsystem::ClassifyProgressBars()
+{
+	FVector CameraLocation, CameraForward;
+	float HalfFOVRadians = 0.f;
+	const bool bHasCamera = GetCameraView(CameraLocation, CameraForward, HalfFOVRadians);
+	const float CosViewCone = FMath::Cos(FMath::Min(HalfFOVRadians + FMath::DegreesToRadians(ViewConeMarginDegrees),
+	                                                UE_HALF_PI));
+	const float TanHalfFOV = FMath::Tan(HalfFOVRadians);
+	const float BaseInterval = DeveloperSettings::Optimisation::UpdateIntervalProgressBar;
+
+	for (FManagedProgressBar& ManagedBar : M_ProgressBars)
+	{
+		UTimeProgressBarWidget* ProgressBar = ManagedBar.ProgressBar.Get();
+		if (!ProgressBar || !ProgressBar->M_BarAsMeshRef)
+		{
+			continue;
+		}
+		bool bIsCulled = false;
+		float UpdateInterval = BaseInterval;
+		// Without a camera (e.g. headless runs) every bar is treated as near and visible.
+		if (bHasCamera)
+		{
+			const FVector ToBar = ProgressBar->M_BarAsMeshRef->GetComponentLocation() - CameraLocation;
+			const float Distance = ToBar.Size();
+			const float Radius = ProgressBar->M_BarAsMeshRef->Bounds.SphereRadius;
+			const bool bIsInView = Distance <= Radius || FVector::DotProduct(ToBar / Distance, CameraForward) >=
+				CosViewCone;
+			const float ScreenSize = Distance > KINDA_SMALL_NUMBER ? Radius / (Distance * TanHalfFOV) : 1.f;
+			bIsCulled = !bIsInView || ScreenSize < MinScreenSize;
+			if (Distance > FarBandDistance)
+			{
+				UpdateInterval *= FarBandIntervalScale;
+			}
+			else if (Distance > NearBandDistance)
+			{
+				UpdateInterval *= MidBandIntervalScale;
+			}
+		}
+		ManagedBar.UpdateInterval = UpdateInterval;
+		if (bIsCulled != ManagedBar.bIsCulled)
+		{
+			ManagedBar.bIsCulled = bIsCulled;
+			ProgressBar->M_BarAsMeshRef->SetVisibility(!bIsCulled);
+			// Update right away when the bar becomes visible so it does not show stale progress.
+			ManagedBar.NextUpdateTime = 0.0;
+		}
+	}
+}
+
+bool UProgressBarLODSubsystem::GetCameraView(FVector& OutLocation, FVector& OutForward,
+                                             float& OutHalfFOVRadians) const
+{
+	const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController();
+	const APlayerCameraManager* CameraManager = PlayerController ? PlayerController->PlayerCameraManager : nullptr;
+	if (!CameraManager)
+	{
+		return false;
+	}
+	OutLocation = CameraManager->GetCameraLocation();
+	OutForward = CameraManager->GetCameraRotation().Vector();
+	OutHalfFOVRadians = FMath::DegreesToRadians(CameraManager->GetFOVAngle() * 0.5f);
+	return true;
+}
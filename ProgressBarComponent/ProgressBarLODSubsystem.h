@@ -0,0 +1,70 @@
+// Copyright Bas Blokzijl - All rights reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+
+#include "ProgressBarLODSubsystem.generated.h"
+
+class UTimeProgressBarWidget;
+
+/**
+ * @brief Updates all running progress bars from one place, at a rate that depends on how they are seen.
+ * Each bar is classified every VisibilityCheckInterval against the camera of the local player:
+ * - Outside the view or smaller than MinScreenSize on screen: culled, the bar mesh is hidden and not updated.
+ * - Otherwise updated and oriented towards the camera at a rate that decreases with the distance band.
+ * Completion does not depend on these updates; every bar completes on its own timer.
+ */
+UCLASS()
+class RTS_SURVIVAL_API UProgressBarLODSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	void RegisterProgressBar(UTimeProgressBarWidget* ProgressBar);
+
+	/** @brief Stops updating the bar and shows its mesh again if it was culled. */
+	void UnregisterProgressBar(UTimeProgressBarWidget* ProgressBar);
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual bool IsTickable() const override { return !M_ProgressBars.IsEmpty(); }
+
+private:
+	// How often the bars are classified.
+	static constexpr float VisibilityCheckInterval = 0.1f;
+
+	// Bars closer than this are updated at the base rate, further bars at MidBandIntervalScale.
+	static constexpr float NearBandDistance = 3000.f;
+
+	// Bars further than this are updated at FarBandIntervalScale.
+	static constexpr float FarBandDistance = 8000.f;
+
+	static constexpr float MidBandIntervalScale = 2.f;
+	static constexpr float FarBandIntervalScale = 4.f;
+
+	// Fraction of the half screen height that the bar needs to cover to be shown.
+	static constexpr float MinScreenSize = 0.01f;
+
+	// Widens the view cone so bars at the edge of the screen are not culled while they are partly visible.
+	static constexpr float ViewConeMarginDegrees = 10.f;
+
+	struct FManagedProgressBar
+	{
+		TWeakObjectPtr<UTimeProgressBarWidget> ProgressBar;
+		float UpdateInterval = 0.f;
+		double NextUpdateTime = 0.0;
+		bool bIsCulled = false;
+	};
+
+	TArray<FManagedProgressBar> M_ProgressBars;
+
+	float M_TimeSinceVisibilityCheck = VisibilityCheckInterval;
+
+	/** @brief Culls the bars and sets the update interval of the bars that are shown. */
+	void ClassifyProgressBars();
+
+	/** @return Whether the camera of the local player was found. */
+	bool GetCameraView(FVector& OutLocation, FVector& OutForward, float& OutHalfFOVRadians) const;
+};
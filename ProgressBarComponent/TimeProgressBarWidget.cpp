@@ -1,9 +1,11 @@
 // Copyright Bas Blokzijl - All rights reserved.
 #include "TimeProgressBarWidget.h"
+#include "ProgressBarLODSubsystem.h"
 #include "Components/StaticMeshComponent.h"
 #include "Kismet/GameplayStatics.h"
 #include "TimerManager.h"
 #include "RTS_Survival/DeveloperSettings.h"
+#include "RTS_Survival/Benchmark/RTSBenchmark.h"
 #include "RTS_Survival/Utils/HFunctionLibary.h"
 
 
@@ -20,43 +22,54 @@ void UTimeProgressBarWidget::InitTimeProgressComponent(
 	M_ProgressBar->SetVisibility(ESlateVisibility::Hidden);
 	M_ProgressBar->SetPercent(0.0f);
 	M_ProgressText->SetVisibility(ESlateVisibility::Hidden);
-	M_BarRotationDel.BindUObject(this, &UTimeProgressBarWidget::OrientProgressBar);
 	M_BarAsMeshRef = NewBarAsMeshRef;
 }
 
 void UTimeProgressBarWidget::StartProgressBar(float Time)
 {
-	M_TotalTime = Time;
+	M_World = GetWorld();
+	if (M_World)
+	{
+		StartProgressBarAt(M_World->GetTimeSeconds(), Time);
+	}
+}
+
+void UTimeProgressBarWidget::StartProgressBarAt(const double StartTime, const float Duration)
+{
+	M_World = GetWorld();
+	if (!M_World)
+	{
+		return;
+	}
+	M_TimedProgress.StartTime = StartTime;
+	M_TimedProgress.Duration = Duration;
+	M_ShownPercentage = INDEX_NONE;
 	M_ProgressBar->SetVisibility(ESlateVisibility::Visible);
-	M_ProgressBar->SetPercent(0.0f);
 	M_ProgressText->SetVisibility(ESlateVisibility::Visible);
+	UpdateProgressBar();
 
-	M_World = GetWorld();
-	if(M_World)
+	const float TimeRemaining = M_TimedProgress.GetEndTime() - M_World->GetTimeSeconds();
+	if (TimeRemaining <= 0.f)
 	{
-		M_StartTime = M_World->GetTimeSeconds();
-		M_World->GetTimerManager().SetTimer(M_ProgressUpdateHandle, this, &UTimeProgressBarWidget::UpdateProgressBar,
-			DeveloperSettings::Optimisation::UpdateIntervalProgressBar, true);
-		M_World->GetTimerManager().SetTimer(M_BarRotationHandle, M_BarRotationDel,
-	DeveloperSettings::Optimisation::OrientProgressBarInterval, true);
+		OnCompletionTimer();
+		return;
 	}
+	M_World->GetTimerManager().SetTimer(M_CompletionHandle, this, &UTimeProgressBarWidget::OnCompletionTimer,
+	                                    TimeRemaining, false);
+	// Updates and orients the bar at a rate depending on its distance to the camera.
+	M_World->GetSubsystem<UProgressBarLODSubsystem>()->RegisterProgressBar(this);
 }
 
 void UTimeProgressBarWidget::StopProgressBar()
 {
-	if (M_World)
+	if (!M_World)
 	{
-		M_World->GetTimerManager().ClearTimer(M_ProgressUpdateHandle);
-		M_World->GetTimerManager().ClearTimer(M_BarRotationHandle);
+		M_World = GetWorld();
 	}
-	else
+	if (M_World)
 	{
-		M_World = GetWorld();
-		if(M_World)
-		{
-			M_World->GetTimerManager().ClearTimer(M_ProgressUpdateHandle);
-			M_World->GetTimerManager().ClearTimer(M_BarRotationHandle);
-		}
+		M_World->GetTimerManager().ClearTimer(M_CompletionHandle);
+		M_World->GetSubsystem<UProgressBarLODSubsystem>()->UnregisterProgressBar(this);
 	}
 	M_ProgressBar->SetVisibility(ESlateVisibility::Hidden);
 	M_ProgressText->SetVisibility(ESlateVisibility::Hidden);
@@ -66,30 +79,36 @@ float UTimeProgressBarWidget::GetTimeElapsed() const
 {
 	if(M_World)
 	{
-		return M_World->GetTimeSeconds() - M_StartTime;
+		return M_World->GetTimeSeconds() - M_TimedProgress.StartTime;
 	}
 	return 0.0f;
 }
 
 void UTimeProgressBarWidget::UpdateProgressBar()
 {
+	RTS_BENCHMARK_SCOPE("TimeProgressBar.Update");
 	if(M_World)
 	{
-		// Calculate elapsed time and progress.
-		const float CurrentTime = M_World->GetTimeSeconds() - M_StartTime;
-		const float Progress = FMath::Clamp(CurrentTime / M_TotalTime, 0.0f, 1.0f);
+		// Purely visual; completion is handled by the completion timer.
+		const float Progress = M_TimedProgress.GetProgress(M_World->GetTimeSeconds());
 		M_ProgressBar->SetPercent(Progress);
 
 		// Update the progress text
 		const int32 Percentage = FMath::RoundToInt(Progress * 100);
-		M_ProgressText->SetText(FText::FromString(FString::Printf(TEXT("%d%%"), Percentage)));
-
-		if (CurrentTime >= M_TotalTime)
+		if (Percentage != M_ShownPercentage)
 		{
-			StopProgressBar();
+			M_ShownPercentage = Percentage;
+			M_ProgressText->SetText(FText::FromString(FString::Printf(TEXT("%d%%"), Percentage)));
 		}
 	}
+}
 
+void UTimeProgressBarWidget::OnCompletionTimer()
+{
+	// Stopped before the broadcast so a listener can start the bar again.
+	StopProgressBar();
+	M_ProgressBar->SetPercent(1.0f);
+	OnProgressCompleted.Broadcast(this);
 }
 
 void UTimeProgressBarWidget::OrientProgressBar()
@@ -8,18 +8,40 @@
 
 #include "TimeProgressBarWidget.generated.h"
 
+/** Progress that is fully described by when it started and how long it takes. */
+struct FTimedProgress
+{
+	// World time at which the progress started.
+	double StartTime = 0.0;
+
+	float Duration = 0.f;
+
+	inline double GetEndTime() const { return StartTime + Duration; }
+
+	/** @return The progress in [0, 1] at the world time. */
+	inline float GetProgress(const double WorldTime) const
+	{
+		return Duration > 0.f ? FMath::Clamp(static_cast<float>((WorldTime - StartTime) / Duration), 0.f, 1.f) : 1.f;
+	}
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnTimedProgressCompleted, UTimeProgressBarWidget* /*ProgressBar*/);
+
 /**
  * @class UTimeProgressBarWidget
  * 
  * @brief A widget component to display progress over time with an optional text display of progress percentage.
  * the m_ProgressText and m_ProgressBar are bound to the respective widgets in the UMG editor automatically
  * by giving the elements the same name as the variables.
+ * Running bars are updated and oriented by the UProgressBarLODSubsystem, which culls bars that are not seen.
  */
 UCLASS()
 class RTS_SURVIVAL_API UTimeProgressBarWidget : public UUserWidget
 {
 	GENERATED_BODY()
 
+	friend class UProgressBarLODSubsystem;
+
 public:
 	/**
 	 * @brief Initializes the time progress component with the camera sphere to orient the progress bar towards.
@@ -34,6 +56,13 @@ public:
 	UFUNCTION(BlueprintCallable, Category= "Progress Bar Control")
 	void StartProgressBar(float Time);
 
+	/**
+	 * @brief Starts the progress bar for progress that may have started earlier, e.g. a restored construction.
+	 * @param StartTime The world time at which the progress started.
+	 * @param Duration How long the progress takes in total.
+	 */
+	void StartProgressBarAt(const double StartTime, const float Duration);
+
 	/** Stops the progress bar and hides it. */
 	UFUNCTION(BlueprintCallable, Category= "Progress Bar Control")
 	void StopProgressBar();
@@ -41,6 +70,11 @@ public:
 	/** @return How long the progressbar has been running. */
 	float GetTimeElapsed() const;
 
+	inline const FTimedProgress& GetTimedProgress() const { return M_TimedProgress; }
+
+	// Broadcast exactly when the progress completes, right before the bar stops.
+	FOnTimedProgressCompleted OnProgressCompleted;
+
 	/** @brief Sets the local location of the progress bar. */
 	inline void SetLocalLocation(const FVector& NewLocation) const {M_BarAsMeshRef->SetRelativeLocation(NewLocation);};
 
@@ -64,28 +98,27 @@ private:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category="Settings", meta=(AllowPrivateAccess="true"))
 	UStaticMeshComponent* M_CameraSphere;
 
-	// Total time for the progress bar to complete
-	float M_TotalTime;
+	// When the progress started and how long it takes; the visuals are derived from it.
+	FTimedProgress M_TimedProgress;
 
-	// Timer handle for progress bar update
-	FTimerHandle M_ProgressUpdateHandle;
+	// The only timer of a running bar, fires at completion.
+	FTimerHandle M_CompletionHandle;
+
+	// Last shown percentage, the text is only rebuilt when it changes.
+	int32 M_ShownPercentage = INDEX_NONE;
 
 	// To update the progress bar's fill percentage and text display
 	void UpdateProgressBar();
 
+	/** @brief Shows the completed bar, broadcasts OnProgressCompleted and stops the bar. */
+	void OnCompletionTimer();
+
 	UPROPERTY()
 	// World spawned in
 	UWorld* M_World;
 
-	float M_StartTime;
-
 	/** @brief Orients the progressbar to the Player controller. */
 	void OrientProgressBar();
-	
-	// Used to set timer for the rotation of the healthBar.
-	FTimerHandle M_BarRotationHandle;
-	// Used to set timer for the rotation of the healthBar.
-	FTimerDelegate M_BarRotationDel;
 
 	// Reference to the bar widget as component on the owner of the TimeProgressBarWidget.
 	// This is used for rotation adjustments.